@@ -115,6 +115,7 @@ SimpleLibuvEpollServer::SimpleLibuvEpollServer()
       last_delay_in_usec_(0) */ {
 
   uv_loop_init(&loop);
+  uv_loop_configure(&loop, UV_METRICS_IDLE_TIME);
   uv_timer_init(&loop, &looptimer);
   uv_async_init(&loop, &asynchandle, asynccallback);
   uv_check_init(&loop, &checkhandle);
@@ -462,6 +462,13 @@ class SimpleLibuvEpollServer {
   //   epoch.
   virtual int64_t ApproximateNowInUsec() const;
 
+  // Summary:
+  //   Time the loop spent waiting for events since it was created, as
+  //   measured by libuv, for the utilization of the loop.
+  // Returns:
+  //   the idle time in nanoseconds.
+  uint64_t IdleTimeInNsec() { return uv_metrics_idle_time(&loop); }
+
   static std::string EventMaskToString(int event_mask);
 
   // Summary:
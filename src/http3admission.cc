@@ -0,0 +1,188 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3admission.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "openssl/aead.h"
+#include "openssl/rand.h"
+#include "quiche/quic/core/quic_constants.h"
+
+namespace quic
+{
+
+    namespace
+    {
+        constexpr int64_t kLoopSampleUs = 10000;
+        constexpr double kLoopSmoothing = 0.3;   // weight of the newest sample
+        constexpr double kUtilizationLow = 0.5;  // full budget below
+        constexpr double kUtilizationHigh = 0.9; // minimal budget above
+        // the buffered packet store of quiche gives up on a chlo after 5 s, too
+        constexpr int64_t kPendingChloUs = 5000000;
+        constexpr size_t kTokenNonceSize = 12;
+        constexpr size_t kTokenTagSize = 16;
+        constexpr size_t kTokenIssuedSize = 8;
+
+        // the token only serves for this address and the connection id of the retry
+        std::string tokenAad(const QuicIpAddress &peer, const QuicConnectionId &retry_id)
+        {
+            std::string aad = peer.ToPackedString();
+            aad.append(retry_id.data(), retry_id.length());
+            return aad;
+        }
+    }
+
+    Http3ChloAdmission::Http3ChloAdmission(int64_t retry_threshold) : retry_threshold_(retry_threshold)
+    {
+        // tokens only come back to this process, so the key never leaves it
+        RAND_bytes(token_key_, sizeof(token_key_));
+    }
+
+    void Http3ChloAdmission::sampleLoop(int64_t now_us, uint64_t idle_ns)
+    {
+        if (last_sample_us_ < 0)
+        {
+            last_sample_us_ = now_us;
+            last_idle_ns_ = idle_ns;
+            return;
+        }
+        int64_t wall_us = now_us - last_sample_us_;
+        if (wall_us < kLoopSampleUs)
+            return;
+        double idle_us = (idle_ns - last_idle_ns_) / 1000.;
+        double busy = std::min(std::max(1. - idle_us / wall_us, 0.), 1.);
+        utilization_ = (1. - kLoopSmoothing) * utilization_ + kLoopSmoothing * busy;
+        last_sample_us_ = now_us;
+        last_idle_ns_ = idle_ns;
+
+        double share = (utilization_ - kUtilizationLow) / (kUtilizationHigh - kUtilizationLow);
+        share = std::min(std::max(share, 0.), 1.);
+        budget_ = kMaxChlosPerSocketEvent -
+                  static_cast<size_t>(share * (kMaxChlosPerSocketEvent - kMinChlosPerSocketEvent) + 0.5);
+        budget_count_ = budget_;
+        utilization_permille_ = static_cast<uint32_t>(utilization_ * 1000.);
+        expire(now_us);
+    }
+
+    void Http3ChloAdmission::expire(int64_t now_us)
+    {
+        while (!arrivals_.empty() && arrivals_.front().first + kPendingChloUs < now_us)
+        {
+            auto it = pending_.find(arrivals_.front().second);
+            // a later chlo for the same id may have taken the place
+            if (it != pending_.end() && it->second.since_us == arrivals_.front().first)
+            {
+                pending_.erase(it);
+                dropped_++;
+            }
+            arrivals_.pop_front();
+        }
+        pending_count_ = pending_.size();
+    }
+
+    void Http3ChloAdmission::onChlo(const QuicConnectionId &connection_id, int64_t now_us)
+    {
+        expire(now_us);
+        // a chlo may span several initial packets
+        if (pending_.find(connection_id) != pending_.end())
+            return;
+        pending_[connection_id] = Pending{now_us, EmptyQuicConnectionId()};
+        arrivals_.emplace_back(now_us, connection_id);
+        pending_count_ = pending_.size();
+    }
+
+    void Http3ChloAdmission::onValidated(const QuicConnectionId &connection_id, const QuicConnectionId &original_id)
+    {
+        auto it = pending_.find(connection_id);
+        if (it != pending_.end())
+            it->second.original_id = original_id;
+    }
+
+    QuicConnectionId Http3ChloAdmission::originalId(const QuicConnectionId &connection_id) const
+    {
+        auto it = pending_.find(connection_id);
+        if (it == pending_.end())
+            return EmptyQuicConnectionId();
+        return it->second.original_id;
+    }
+
+    int64_t Http3ChloAdmission::pendingSince(const QuicConnectionId &connection_id) const
+    {
+        auto it = pending_.find(connection_id);
+        return it == pending_.end() ? 0 : it->second.since_us;
+    }
+
+    void Http3ChloAdmission::onAccepted(const QuicConnectionId &connection_id)
+    {
+        pending_.erase(connection_id);
+        pending_count_ = pending_.size();
+        accepted_++;
+    }
+
+    bool Http3ChloAdmission::shouldRetry() const
+    {
+        return retry_threshold_ >= 0 && static_cast<int64_t>(pending_.size()) >= retry_threshold_;
+    }
+
+    std::string Http3ChloAdmission::makeToken(const QuicIpAddress &peer, const QuicConnectionId &original_id,
+                                              const QuicConnectionId &retry_id, int64_t now_us)
+    {
+        bssl::ScopedEVP_AEAD_CTX ctx;
+        if (!EVP_AEAD_CTX_init(ctx.get(), EVP_aead_aes_128_gcm(), token_key_, sizeof(token_key_), kTokenTagSize,
+                               nullptr))
+            return std::string();
+        std::string plain(kTokenIssuedSize, '\0');
+        for (size_t i = 0; i < kTokenIssuedSize; i++)
+            plain[i] = static_cast<char>(static_cast<uint64_t>(now_us) >> (8 * (kTokenIssuedSize - 1 - i)));
+        plain.append(original_id.data(), original_id.length());
+        std::string aad = tokenAad(peer, retry_id);
+
+        std::string token(kTokenNonceSize + plain.size() + kTokenTagSize, '\0');
+        uint8_t *nonce = reinterpret_cast<uint8_t *>(&token[0]);
+        RAND_bytes(nonce, kTokenNonceSize);
+        size_t len = 0;
+        if (!EVP_AEAD_CTX_seal(ctx.get(), nonce + kTokenNonceSize, &len, token.size() - kTokenNonceSize, nonce,
+                               kTokenNonceSize, reinterpret_cast<const uint8_t *>(plain.data()), plain.size(),
+                               reinterpret_cast<const uint8_t *>(aad.data()), aad.size()))
+            return std::string();
+        token.resize(kTokenNonceSize + len);
+        return token;
+    }
+
+    bool Http3ChloAdmission::checkToken(absl::string_view token, const QuicIpAddress &peer,
+                                        const QuicConnectionId &retry_id, int64_t now_us,
+                                        QuicConnectionId *original_id)
+    {
+        if (token.size() < kTokenNonceSize + kTokenIssuedSize + kTokenTagSize)
+            return false;
+        bssl::ScopedEVP_AEAD_CTX ctx;
+        if (!EVP_AEAD_CTX_init(ctx.get(), EVP_aead_aes_128_gcm(), token_key_, sizeof(token_key_), kTokenTagSize,
+                               nullptr))
+            return false;
+        const uint8_t *nonce = reinterpret_cast<const uint8_t *>(token.data());
+        size_t cipherlen = token.size() - kTokenNonceSize;
+        std::string aad = tokenAad(peer, retry_id);
+        std::vector<uint8_t> plain(cipherlen);
+        size_t len = 0;
+        if (!EVP_AEAD_CTX_open(ctx.get(), plain.data(), &len, plain.size(), nonce, kTokenNonceSize,
+                               nonce + kTokenNonceSize, cipherlen, reinterpret_cast<const uint8_t *>(aad.data()),
+                               aad.size()))
+            return false;
+        if (len < kTokenIssuedSize || len - kTokenIssuedSize > kQuicMaxConnectionIdWithLengthPrefixLength)
+            return false;
+        uint64_t issued = 0;
+        for (size_t i = 0; i < kTokenIssuedSize; i++)
+            issued = (issued << 8) | plain[i];
+        int64_t age = now_us - static_cast<int64_t>(issued);
+        if (age < 0 || age > kRetryTokenLifetimeUs)
+            return false;
+        *original_id = QuicConnectionId(reinterpret_cast<const char *>(plain.data() + kTokenIssuedSize),
+                                        static_cast<uint8_t>(len - kTokenIssuedSize));
+        return true;
+    }
+
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_ADMISSION_H_
+#define HTTP3_ADMISSION_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "quiche/quic/core/quic_connection_id.h"
+#include "quiche/quic/platform/api/quic_ip_address.h"
+
+namespace quic
+{
+    constexpr int64_t kDefaultRetryThreshold = 64;
+    constexpr size_t kMaxChlosPerSocketEvent = 64;
+    constexpr size_t kMinChlosPerSocketEvent = 1;
+    constexpr int64_t kRetryTokenLifetimeUs = 10000000;
+
+    // decides how many buffered chlos become sessions per socket event and
+    // when new clients have to prove their address with a retry first,
+    // the budget shrinks, while the loop is busy, so that a flood of
+    // handshakes does not starve the established sessions
+    // loop thread only, except for the counters
+    class Http3ChloAdmission
+    {
+    public:
+        // retry_threshold pending chlos, before retries start, -1 never
+        explicit Http3ChloAdmission(int64_t retry_threshold);
+
+        // idle_ns is the total idle time of the loop
+        void sampleLoop(int64_t now_us, uint64_t idle_ns);
+        // chlos to process for the current socket event
+        size_t budget() const { return budget_; }
+
+        // a chlo for a connection id without a session arrived
+        void onChlo(const QuicConnectionId &connection_id, int64_t now_us);
+        // the session was created
+        void onAccepted(const QuicConnectionId &connection_id);
+        // the original id of a client, that came back with a valid token
+        void onValidated(const QuicConnectionId &connection_id, const QuicConnectionId &original_id);
+        QuicConnectionId originalId(const QuicConnectionId &connection_id) const;
+        bool isPending(const QuicConnectionId &connection_id) const { return pending_.count(connection_id) > 0; }
+        // arrival of the first chlo packet, 0 if unknown
+        int64_t pendingSince(const QuicConnectionId &connection_id) const;
+        bool shouldRetry() const;
+        void onRetried() { retried_++; }
+
+        // retry tokens, bound to the address of the client
+        std::string makeToken(const QuicIpAddress &peer, const QuicConnectionId &original_id,
+                              const QuicConnectionId &retry_id, int64_t now_us);
+        // false, if the token is not ours, too old or from another address
+        bool checkToken(absl::string_view token, const QuicIpAddress &peer, const QuicConnectionId &retry_id,
+                        int64_t now_us, QuicConnectionId *original_id);
+
+        // js thread
+        size_t pending() const { return pending_count_.load(); }
+        uint64_t accepted() const { return accepted_.load(); }
+        uint64_t retried() const { return retried_.load(); }
+        uint64_t dropped() const { return dropped_.load(); }
+        double utilization() const { return utilization_permille_.load() / 1000.; }
+        size_t currentBudget() const { return budget_count_.load(); }
+
+    protected:
+        struct Pending
+        {
+            int64_t since_us;
+            QuicConnectionId original_id; // empty without a retry
+        };
+
+        void expire(int64_t now_us);
+
+        int64_t retry_threshold_;
+        uint8_t token_key_[16];
+
+        int64_t last_sample_us_ = -1;
+        uint64_t last_idle_ns_ = 0;
+        double utilization_ = 0.;
+        size_t budget_ = kMaxChlosPerSocketEvent;
+
+        std::map<QuicConnectionId, Pending> pending_;
+        std::deque<std::pair<int64_t, QuicConnectionId>> arrivals_; // oldest first
+
+        std::atomic<size_t> pending_count_{0};
+        std::atomic<uint64_t> accepted_{0};
+        std::atomic<uint64_t> retried_{0};
+        std::atomic<uint64_t> dropped_{0}; // chlos, that never became a session
+        std::atomic<uint32_t> utilization_permille_{0};
+        std::atomic<size_t> budget_count_{kMaxChlosPerSocketEvent};
+    };
+
+}
+
+#endif
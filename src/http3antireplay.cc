@@ -0,0 +1,70 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3antireplay.h"
+
+#include <algorithm>
+
+#include "openssl/sha.h"
+
+namespace quic
+{
+
+    Http3ReplayFilter::Http3ReplayFilter(int64_t window_s)
+        : window_s_(std::max<int64_t>(window_s, 1)),
+          // the slices still in the ring cover at least the window
+          slice_s_((window_s_ + kReplaySlices - 2) / (kReplaySlices - 1))
+    {
+        for (auto &filter : filters_)
+            filter.assign(kReplaySliceBits / 64, 0);
+    }
+
+    void Http3ReplayFilter::rotate(int64_t now_s)
+    {
+        int64_t slice = now_s / slice_s_;
+        if (current_slice_ < 0)
+        {
+            current_slice_ = slice;
+            return;
+        }
+        if (slice <= current_slice_)
+            return; // the clock may step back, keep the current slice
+        int64_t last = std::min<int64_t>(slice, current_slice_ + kReplaySlices);
+        for (int64_t i = current_slice_ + 1; i <= last; i++)
+            std::fill(filters_[i % kReplaySlices].begin(), filters_[i % kReplaySlices].end(), 0);
+        current_slice_ = slice;
+    }
+
+    bool Http3ReplayFilter::checkAndInsert(absl::string_view ticket, int64_t now_s)
+    {
+        rotate(now_s);
+        uint8_t digest[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const uint8_t *>(ticket.data()), ticket.size(), digest);
+        size_t bits[kReplayHashes];
+        for (size_t i = 0; i < kReplayHashes; i++)
+            bits[i] = ((static_cast<size_t>(digest[4 * i]) << 24) | (static_cast<size_t>(digest[4 * i + 1]) << 16) |
+                       (static_cast<size_t>(digest[4 * i + 2]) << 8) | digest[4 * i + 3]) %
+                      kReplaySliceBits;
+
+        for (auto &filter : filters_)
+        {
+            bool all = true;
+            for (size_t bit : bits)
+            {
+                if (!(filter[bit / 64] & (uint64_t(1) << (bit % 64))))
+                {
+                    all = false;
+                    break;
+                }
+            }
+            if (all)
+                return true;
+        }
+        std::vector<uint64_t> &current = filters_[current_slice_ % kReplaySlices];
+        for (size_t bit : bits)
+            current[bit / 64] |= uint64_t(1) << (bit % 64);
+        return false;
+    }
+
+}
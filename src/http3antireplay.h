@@ -0,0 +1,46 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_ANTI_REPLAY_H_
+#define HTTP3_ANTI_REPLAY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace quic
+{
+    constexpr int64_t kDefaultEarlyDataWindowS = 600;
+    constexpr size_t kReplaySlices = 4;
+    constexpr size_t kReplaySliceBits = 1 << 20; // 128 kB, about 100000 tickets at 1% false positives
+    constexpr size_t kReplayHashes = 7;
+
+    // remembers the tickets offered for early data within a time window,
+    // a ring of bloom filters, each covers a third of the window, the
+    // oldest is cleared, when the next slice begins, so memory is fixed
+    // a false positive only costs the client a full handshake
+    class Http3ReplayFilter
+    {
+    public:
+        explicit Http3ReplayFilter(int64_t window_s);
+
+        // true, if the ticket was seen before, remembers it otherwise
+        bool checkAndInsert(absl::string_view ticket, int64_t now_s);
+
+        int64_t window() const { return window_s_; }
+
+    protected:
+        void rotate(int64_t now_s);
+
+        int64_t window_s_;
+        int64_t slice_s_;
+        int64_t current_slice_ = -1;
+        std::vector<uint64_t> filters_[kReplaySlices];
+    };
+
+}
+
+#endif
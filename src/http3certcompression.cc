@@ -0,0 +1,137 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3certcompression.h"
+
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zlib.h"
+
+namespace quic
+{
+
+    namespace
+    {
+        constexpr uint16_t kCertCompressionZlib = 1; // TLSEXT_cert_compression_zlib
+        constexpr size_t kCompressedCertCacheSize = 16;
+        // certificate messages of any sane chain are far smaller
+        constexpr size_t kMaxUncompressedCertSize = 1024 * 1024;
+
+        // keyed by the whole uncompressed message, most recent last
+        struct CompressedCertCache
+        {
+            struct Entry
+            {
+                std::string uncompressed;
+                std::string compressed;
+            };
+
+            bool lookup(const uint8_t *in, size_t in_len, std::string &out)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto it = entries.begin(); it != entries.end(); ++it)
+                {
+                    if (it->uncompressed.size() == in_len && memcmp(it->uncompressed.data(), in, in_len) == 0)
+                    {
+                        out = it->compressed;
+                        if (it + 1 != entries.end())
+                        {
+                            Entry cur = std::move(*it);
+                            entries.erase(it);
+                            entries.push_back(std::move(cur));
+                        }
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void insert(const uint8_t *in, size_t in_len, const std::string &compressed)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (entries.size() >= kCompressedCertCacheSize)
+                    entries.erase(entries.begin());
+                Entry entry;
+                entry.uncompressed.assign(reinterpret_cast<const char *>(in), in_len);
+                entry.compressed = compressed;
+                entries.push_back(std::move(entry));
+            }
+
+            std::mutex mutex;
+            std::vector<Entry> entries;
+        };
+
+        CompressedCertCache &certCache()
+        {
+            static CompressedCertCache cache;
+            return cache;
+        }
+
+        int compressZlib(SSL *ssl, CBB *out, const uint8_t *in, size_t in_len)
+        {
+            Http3CertCompressionStats &stats = Http3GetCertCompressionStats();
+            std::string compressed;
+            if (certCache().lookup(in, in_len, compressed))
+            {
+                stats.cache_hits++;
+            }
+            else
+            {
+                uLongf len = compressBound(in_len);
+                compressed.resize(len);
+                if (compress2(reinterpret_cast<Bytef *>(&compressed[0]), &len, in, in_len, Z_BEST_COMPRESSION) != Z_OK)
+                {
+                    stats.failures++;
+                    return 0;
+                }
+                compressed.resize(len);
+                certCache().insert(in, in_len, compressed);
+            }
+            stats.compressions++;
+            stats.bytes_in += in_len;
+            stats.bytes_out += compressed.size();
+            return CBB_add_bytes(out, reinterpret_cast<const uint8_t *>(compressed.data()), compressed.size());
+        }
+
+        int decompressZlib(SSL *ssl, CRYPTO_BUFFER **out, size_t uncompressed_len, const uint8_t *in, size_t in_len)
+        {
+            Http3CertCompressionStats &stats = Http3GetCertCompressionStats();
+            if (uncompressed_len > kMaxUncompressedCertSize)
+            {
+                stats.failures++;
+                return 0;
+            }
+            uint8_t *data = nullptr;
+            CRYPTO_BUFFER *buffer = CRYPTO_BUFFER_alloc(&data, uncompressed_len);
+            if (!buffer)
+                return 0;
+            uLongf len = uncompressed_len;
+            if (uncompress(data, &len, in, in_len) != Z_OK || len != uncompressed_len)
+            {
+                CRYPTO_BUFFER_free(buffer);
+                stats.failures++;
+                return 0;
+            }
+            stats.decompressions++;
+            *out = buffer;
+            return 1;
+        }
+    }
+
+    Http3CertCompressionStats &Http3GetCertCompressionStats()
+    {
+        static Http3CertCompressionStats stats;
+        return stats;
+    }
+
+    void Http3EnableCertCompression(SSL_CTX *ctx)
+    {
+        if (ctx)
+            SSL_CTX_add_cert_compression_alg(ctx, kCertCompressionZlib, compressZlib, decompressZlib);
+    }
+
+}
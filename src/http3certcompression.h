@@ -0,0 +1,35 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_CERT_COMPRESSION_H_
+#define HTTP3_CERT_COMPRESSION_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "openssl/ssl.h"
+
+namespace quic
+{
+    // tls certificate compression (RFC 8879) with zlib, so that the server's
+    // first flight stays below the anti amplification limit
+    // compressed certificate messages are cached, a server sends the same
+    // chain over and over
+    void Http3EnableCertCompression(SSL_CTX *ctx);
+
+    struct Http3CertCompressionStats
+    {
+        std::atomic<uint64_t> compressions{0};  // certificate messages sent compressed
+        std::atomic<uint64_t> cache_hits{0};
+        std::atomic<uint64_t> bytes_in{0};  // uncompressed size of what was sent
+        std::atomic<uint64_t> bytes_out{0}; // compressed size
+        std::atomic<uint64_t> decompressions{0};
+        std::atomic<uint64_t> failures{0};
+    };
+
+    // for all contexts of the process
+    Http3CertCompressionStats &Http3GetCertCompressionStats();
+}
+
+#endif
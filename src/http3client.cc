@@ -10,9 +10,12 @@
 #include "src/http3client.h"
 #include "src/http3eventloop.h"
 #include "src/http3clientsession.h"
+#include "src/http3clientstream.h"
 #include "src/http3wtsessionvisitor.h"
 #include "src/http3sessioncache.h"
+#include "src/http3certcompression.h"
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -113,6 +116,8 @@ namespace quic
     {
         set_server_address(server_address);
         Initialize();
+        // we can always take compressed certificates
+        Http3EnableCertCompression(crypto_config_.ssl_ctx());
     }
 
     Http3Client::~Http3Client()
@@ -621,6 +626,8 @@ namespace quic
                 {
                     connect_attempted_ = true;
                     connection_in_progress_ = false;
+                    timeline_.mark(kTimelineEncrypted, eventloop_->NowInUsec());
+                    eventloop_->clientTimings().encryption.record(timeline_.between(kTimelineStart, kTimelineEncrypted));
                     eventloop_->informAboutClientConnected(this, true);
                     webtransport_server_support_inform_ = true;
                     recheck = true;
@@ -636,6 +643,8 @@ namespace quic
         {
             if (session_->SupportsWebTransport())
             {
+                timeline_.mark(kTimelineSettings, eventloop_->NowInUsec());
+                eventloop_->clientTimings().settings.record(timeline_.between(kTimelineStart, kTimelineSettings));
                 eventloop_->informClientWebtransportSupport(this);
                 webtransport_server_support_inform_ = false;
             }
@@ -643,6 +652,32 @@ namespace quic
                 recheck = true;
         }
 
+        recordConnectProgress();
+        updatePoolState();
+
+        // the early session goes out, as soon as there are keys for it, no trip to js
+        if (!early_path_.empty() && !early_opened_ && connected() && !EncryptionBeingEstablished() &&
+            session_->SupportsWebTransport() && session_->CanOpenNextOutgoingBidirectionalStream())
+        {
+            early_opened_ = true;
+            openEarlySessionInt();
+        }
+        if (replay_early_ && connected() && session_->OneRttKeysAvailable() &&
+            session_->CanOpenNextOutgoingBidirectionalStream())
+        {
+            replay_early_ = false;
+            openEarlySessionInt();
+        }
+
+        openQueuedStreams();
+
+        return recheck;
+    }
+
+    void Http3Client::openQueuedStreams()
+    {
+        if (!connected())
+            return;
         while (finish_stream_open_.size() > 0 && session_->CanOpenNextOutgoingBidirectionalStream())
         {
             auto *stream = static_cast<QuicSpdyClientStream *>(
@@ -652,37 +687,82 @@ namespace quic
                 stream->set_visitor(this);
             }
             finish_stream_open_.front()(stream);
-            if (stream != nullptr)
+            if (stream != nullptr && stream->web_transport() != nullptr)
             {
-                if (stream->web_transport() != nullptr)
-                {
-                    WebTransportSessionId id = stream->id();
-                    WebTransportHttp3 *wtsession = session_->GetWebTransportSession(id);
-                    if (wtsession == nullptr)
-                    {
-                        eventloop_->informNewClientSession(this, nullptr);
-                        // may be throw error
-                    }
-                    else
-                    {
-                        // ok we have our session, do we wait for session ready, no set visitor immediatele
-                        Http3WTSession *wtsessionobj =
-                            new Http3WTSession(
-                                static_cast<WebTransportSession *>(wtsession),
-                                eventloop_);
-                        eventloop_->informNewClientSession(this, wtsessionobj);
-                        auto visitor = std::make_unique<Http3WTSession::Visitor>(wtsessionobj);
-                        wtsession->SetVisitor(std::move(visitor));
-                    }
-                }
+                if (pooling_)
+                    holdPooledSession(static_cast<Http3ClientStream *>(stream), eventloop_->NowInUsec());
+                else
+                    attachWTSession(stream, eventloop_->NowInUsec());
             }
             finish_stream_open_.pop();
         }
+    }
 
-        return recheck;
+    void Http3Client::updatePoolState()
+    {
+        if (pooling_ && connect_attempted_ && (!connected() || session_->goaway_received()))
+            pool_closed_ = true;
     }
 
-    void Http3Client::openWTSessionInt(absl::string_view path)
+    void Http3Client::recordConnectProgress()
+    {
+        // the client has the server's finished, once it has 1-rtt keys
+        if (!timeline_.reached(kTimelineHandshakeComplete) && connected() && session_->OneRttKeysAvailable())
+        {
+            timeline_.mark(kTimelineHandshakeComplete, eventloop_->NowInUsec());
+            eventloop_->clientTimings().handshake.record(
+                timeline_.between(kTimelineStart, kTimelineHandshakeComplete));
+        }
+    }
+
+    void Http3Client::recordSessionResponse(Http3WTSession *wtsessionobj, int64_t sent_us)
+    {
+        int64_t now = eventloop_->NowInUsec();
+        wtsessionobj->markTimeline(kTimelineResponse, now);
+        eventloop_->clientTimings().session.record(now - sent_us);
+        if (!timeline_.reached(kTimelineResponse))
+        {
+            timeline_.mark(kTimelineResponse, now);
+            eventloop_->clientTimings().total.record(timeline_.between(kTimelineStart, kTimelineResponse));
+        }
+    }
+
+    WebTransportVisitor *Http3Client::attachWTSession(QuicSpdyClientStream *stream, int64_t sent_us)
+    {
+        WebTransportSessionId id = stream->id();
+        WebTransportHttp3 *wtsession = session_->GetWebTransportSession(id);
+        if (wtsession == nullptr)
+        {
+            eventloop_->informNewClientSession(this, nullptr);
+            // may be throw error
+            return nullptr;
+        }
+        // ok we have our session, do we wait for session ready, no set visitor immediatele
+        Http3WTSession *wtsessionobj =
+            new Http3WTSession(
+                static_cast<WebTransportSession *>(wtsession),
+                session_.get(), static_cast<Http3ClientSession *>(session_.get()),
+                eventloop_);
+        timeline_.mark(kTimelineConnect, sent_us);
+        Http3HandshakeTimeline sessiontimeline = timeline_;
+        sessiontimeline.at[kTimelineConnect] = sent_us;
+        sessiontimeline.at[kTimelineResponse] = 0;
+        wtsessionobj->setTimeline(sessiontimeline);
+        // a session from 0-rtt is attached, when its answer is there already
+        if (stream->headers_decompressed())
+            recordSessionResponse(wtsessionobj, sent_us);
+        else
+            static_cast<Http3ClientStream *>(stream)->addResponseHook(
+                [this, wtsessionobj, sent_us](Http3ClientStream *)
+                { recordSessionResponse(wtsessionobj, sent_us); });
+        eventloop_->informNewClientSession(this, wtsessionobj);
+        auto visitor = std::make_unique<Http3WTSession::Visitor>(wtsessionobj);
+        WebTransportVisitor *ret = visitor.get();
+        wtsession->SetVisitor(std::move(visitor));
+        return ret;
+    }
+
+    spdy::SpdyHeaderBlock Http3Client::connectHeaders(absl::string_view path)
     {
         spdy::SpdyHeaderBlock headers;
         headers[":scheme"] = "https";
@@ -690,8 +770,138 @@ namespace quic
         headers[":path"] = path;
         headers[":method"] = "CONNECT";
         headers[":protocol"] = "webtransport";
+        return headers;
+    }
+
+    void Http3Client::openEarlySessionInt()
+    {
+        auto *stream = static_cast<Http3ClientStream *>(session_->CreateOutgoingBidirectionalStream());
+        if (stream == nullptr)
+        {
+            eventloop_->informNewClientSession(this, nullptr);
+            return;
+        }
+        open_streams_[stream->id()] = stream;
+        stream->set_visitor(this);
+        // with 0-rtt keys, but before the handshake completes, the request goes as early data
+        bool early = !session_->OneRttKeysAvailable();
+        int64_t sent = eventloop_->NowInUsec();
+        stream->SendRequest(connectHeaders(early_path_), "", /*fin=*/false);
+        ++num_requests_;
+        if (stream->web_transport() == nullptr)
+        {
+            eventloop_->informNewClientSession(this, nullptr);
+            return;
+        }
+        if (!early)
+        {
+            attachWTSession(stream, sent);
+            return;
+        }
+        // js gets the session, when the server took it, so that a refused
+        // request can be replayed without js noticing
+        early_stream_ = stream;
+        early_sent_us_ = sent;
+        stream->addResponseHook([this](Http3ClientStream *stream)
+                                { resolveEarlySession(stream, /*closed=*/false); });
+    }
+
+    void Http3Client::resolveEarlySession(Http3ClientStream *stream, bool closed)
+    {
+        if (stream != early_stream_)
+            return; // settled already
+        early_stream_ = nullptr;
+        WebTransportHttp3 *wtsession = stream->web_transport();
+        if (!closed && wtsession != nullptr && wtsession->ready())
+        {
+            WebTransportVisitor *visitor = attachWTSession(stream, early_sent_us_);
+            if (visitor == nullptr)
+                return;
+            // quiche told the default visitor, so pass on, what we missed
+            visitor->OnSessionReady(stream->response_headers());
+            visitor->OnIncomingBidirectionalStreamAvailable();
+            visitor->OnIncomingUnidirectionalStreamAvailable();
+            return;
+        }
+        if (!closed && !stream->rst_sent())
+            stream->Reset(QUIC_STREAM_CANCELLED);
+        if (stream->response_code() == 425)
+        {
+            // the server does not take this path in 0-rtt, send it again after the handshake
+            replay_early_ = true;
+            return;
+        }
+        eventloop_->informNewClientSession(this, nullptr);
+    }
+
+    void Http3Client::holdPooledSession(Http3ClientStream *stream, int64_t sent_us)
+    {
+        held_sessions_.push_back({stream, sent_us, PooledSession::Waiting});
+        stream->addResponseHook([this](Http3ClientStream *stream)
+                                { settlePooledSession(stream, /*closed=*/false); });
+    }
+
+    void Http3Client::settlePooledSession(Http3ClientStream *stream, bool closed)
+    {
+        auto it = std::find_if(held_sessions_.begin(), held_sessions_.end(),
+                               [stream](const PooledSession &cur)
+                               { return cur.stream == stream; });
+        if (it == held_sessions_.end())
+            return; // handed to js already
+        if (closed)
+        {
+            // gone before js got it, a refused one stays refused
+            if (it->state != PooledSession::Refused)
+                it->state = PooledSession::Failed;
+        }
+        else if (it->state == PooledSession::Waiting)
+        {
+            WebTransportHttp3 *wtsession = stream->web_transport();
+            if (wtsession != nullptr && wtsession->ready())
+                it->state = PooledSession::Ready;
+            else
+            {
+                if (stream->response_code() == kPooledSessionRefusedStatus)
+                {
+                    // the server's session limit, later sessions go to a new connection
+                    it->state = PooledSession::Refused;
+                    pool_closed_ = true;
+                }
+                else
+                    it->state = PooledSession::Failed;
+                if (!stream->rst_sent())
+                    stream->Reset(QUIC_STREAM_CANCELLED);
+            }
+        }
+        flushPooledSessions();
+    }
+
+    void Http3Client::flushPooledSessions()
+    {
+        while (!held_sessions_.empty() && held_sessions_.front().state != PooledSession::Waiting)
+        {
+            PooledSession cur = held_sessions_.front();
+            held_sessions_.pop_front();
+            if (cur.state != PooledSession::Ready)
+            {
+                eventloop_->informNewClientSession(this, nullptr, cur.state == PooledSession::Refused);
+                continue;
+            }
+            WebTransportVisitor *visitor = attachWTSession(cur.stream, cur.sent_us);
+            if (visitor == nullptr)
+                continue;
+            // quiche told the default visitor, so pass on, what we missed
+            visitor->OnSessionReady(cur.stream->response_headers());
+            visitor->OnIncomingBidirectionalStreamAvailable();
+            visitor->OnIncomingUnidirectionalStreamAvailable();
+        }
+    }
 
-        SendMessageAsync(headers, "", /*fin=*/false);
+    void Http3Client::openWTSessionInt(absl::string_view path)
+    {
+        SendMessageAsync(connectHeaders(path), "", /*fin=*/false);
+        // a pooled connection may be idle, so do not wait for its next packet
+        openQueuedStreams();
     }
 
     int Http3Client::GetLatestFD() const
@@ -725,6 +935,8 @@ namespace quic
             // no stats for me!
             // UpdateStats();
         }
+        // reconnects with another version count to the first attempt
+        timeline_.mark(kTimelineStart, eventloop_->NowInUsec());
         QuicConnectionId newconnid = QuicUtils::CreateRandomConnectionId(server_connection_id_length_);
 
         const quic::ParsedQuicVersionVector client_supported_versions =
@@ -1034,6 +1246,10 @@ namespace quic
         QUICHE_DCHECK(stream != nullptr);
         QuicSpdyClientStream *client_stream =
             static_cast<QuicSpdyClientStream *>(stream);
+        if (client_stream == early_stream_)
+            resolveEarlySession(early_stream_, /*closed=*/true);
+        if (pooling_)
+            settlePooledSession(static_cast<Http3ClientStream *>(client_stream), /*closed=*/true);
 
         const Http2HeaderBlock &response_headers = client_stream->response_headers();
 
@@ -1288,6 +1504,9 @@ namespace quic
             std::string port = "443";
             v8::Isolate *isolate = info.GetIsolate();
             bool allowPooling = false;
+            uint32_t maxPooledSessions = kDefaultMaxPooledSessions;
+            bool sessionCache = false;
+            std::string earlyPath;
             std::vector<WebTransportHash> serverCertificateHashes;
             std::string privkey;
             std::string hostname = "localhost";
@@ -1306,6 +1525,9 @@ namespace quic
                 v8::Local<v8::String> portProp = Nan::New("port").ToLocalChecked();
                 v8::Local<v8::String> hostnameProp = Nan::New("hostname").ToLocalChecked();
                 v8::Local<v8::String> localPortProp = Nan::New("localPort").ToLocalChecked();
+                v8::Local<v8::String> cacheProp = Nan::New("sessionCache").ToLocalChecked();
+                v8::Local<v8::String> earlyPathProp = Nan::New("earlyPath").ToLocalChecked();
+                v8::Local<v8::String> maxPooledProp = Nan::New("maxPooledSessions").ToLocalChecked();
                 if (!obj.IsEmpty())
                 {
 
@@ -1315,6 +1537,15 @@ namespace quic
                         allowPooling = Nan::To<bool>(poolValue).FromJust();
                     }
 
+                    if (Nan::HasOwnProperty(lobj, maxPooledProp).FromJust() && !Nan::Get(lobj, maxPooledProp).IsEmpty())
+                    {
+                        v8::Local<v8::Value> maxPooledValue = Nan::Get(lobj, maxPooledProp).ToLocalChecked();
+                        if (!maxPooledValue->IsNumber() || Nan::To<int64_t>(maxPooledValue).FromJust() < 1)
+                            return Nan::ThrowError("maxPooledSessions must be a number >= 1");
+                        maxPooledSessions = static_cast<uint32_t>(
+                            std::min<int64_t>(Nan::To<int64_t>(maxPooledValue).FromJust(), UINT32_MAX));
+                    }
+
                     if (Nan::HasOwnProperty(lobj, portProp).FromJust() && !Nan::Get(lobj, portProp).IsEmpty())
                     {
                         v8::Local<v8::Value> portValue = Nan::Get(lobj, portProp).ToLocalChecked();
@@ -1377,6 +1608,20 @@ namespace quic
                         else
                             return Nan::ThrowError("localPort is not a number");
                     }
+
+                    // resume with the tickets of the other clients on the loop
+                    if (Nan::HasOwnProperty(lobj, cacheProp).FromJust() && !Nan::Get(lobj, cacheProp).IsEmpty())
+                    {
+                        v8::Local<v8::Value> cacheValue = Nan::Get(lobj, cacheProp).ToLocalChecked();
+                        sessionCache = Nan::To<bool>(cacheValue).FromJust();
+                    }
+
+                    // the client opens the session on this path itself, in 0-rtt if it can
+                    if (Nan::HasOwnProperty(lobj, earlyPathProp).FromJust() && !Nan::Get(lobj, earlyPathProp).IsEmpty())
+                    {
+                        v8::Local<v8::Value> earlyPathValue = Nan::Get(lobj, earlyPathProp).ToLocalChecked();
+                        earlyPath = *v8::String::Utf8Value(isolate, earlyPathValue->ToString(context).ToLocalChecked());
+                    }
                 }
             }
 
@@ -1415,7 +1660,9 @@ namespace quic
             else
                 return Nan::ThrowError("No supported verification method included");
 
-            std::unique_ptr<Http3SessionCache> cache;
+            std::unique_ptr<SessionCache> cache;
+            if (sessionCache)
+                cache = std::make_unique<Http3SharedSessionCache>(eventloop->sessionCache());
 
             /* Http3Client(Http3EventLoop *eventloop, QuicSocketAddress server_address,
                 const std::string &server_hostname,
@@ -1454,6 +1701,11 @@ namespace quic
             Http3Client *object = new Http3Client(eventloop, address, hostname, local_port,
                                                   std::move(verifier), std::move(cache), std::move(helper));
             object->SetUserAgentID("fails-components/webtransport");
+            object->early_path_ = earlyPath;
+            // the session, that js opens the client for, counts as well
+            object->pooling_ = allowPooling;
+            object->max_pooled_sessions_ = maxPooledSessions;
+            object->pooled_sessions_ = allowPooling ? 1 : 0;
             object->Wrap(info.This());
             info.GetReturnValue().Set(info.This());
 
@@ -1496,6 +1748,29 @@ namespace quic
             return Nan::ThrowError("openWTSession without path");
     }
 
+    NAN_METHOD(Http3Client::reservePooledSession)
+    {
+        Http3Client *obj = Nan::ObjectWrap::Unwrap<Http3Client>(info.Holder());
+        // a client without sessions is closing already
+        bool reserved = obj->pooling_ && !obj->pool_closed_.load() && obj->pooled_sessions_ > 0 &&
+                        obj->pooled_sessions_ < obj->max_pooled_sessions_;
+        if (reserved)
+            obj->pooled_sessions_++;
+        info.GetReturnValue().Set(Nan::New(reserved));
+    }
+
+    NAN_METHOD(Http3Client::releasePooledSession)
+    {
+        Http3Client *obj = Nan::ObjectWrap::Unwrap<Http3Client>(info.Holder());
+        if (obj->pooled_sessions_ > 0)
+            obj->pooled_sessions_--;
+        // true for the last session, then js closes the client
+        bool last = obj->pooled_sessions_ == 0;
+        if (last)
+            obj->pool_closed_ = true;
+        info.GetReturnValue().Set(Nan::New(last));
+    }
+
     NAN_METHOD(Http3Client::closeClient)
     {
         Http3Client *obj = Nan::ObjectWrap::Unwrap<Http3Client>(info.Holder());
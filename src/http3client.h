@@ -12,11 +12,14 @@
 
 #include <nan.h>
 
+#include <atomic>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
 
 #include "src/http3eventloop.h"
+#include "src/http3timing.h"
 #include "absl/base/attributes.h"
 #include "absl/strings/string_view.h"
 #include "quiche/quic/core/crypto/crypto_handshake.h"
@@ -30,6 +33,7 @@
 #include "quiche/quic/core/quic_framer.h"
 #include "quiche/quic/core/quic_packet_creator.h"
 #include "quiche/quic/core/quic_packets.h"
+#include "quiche/quic/core/web_transport_interface.h"
 #include "quiche/quic/platform/api/quic_epoll.h"
 #include "quiche/common/quiche_linked_hash_map.h"
 #include "quiche/quic/core/crypto/web_transport_fingerprint_proof_verifier.h"
@@ -37,11 +41,17 @@
 namespace quic
 {
 
+    // sessions on one pooled connection, quiche's default stream limit
+    constexpr uint32_t kDefaultMaxPooledSessions = 100;
+    // the answer of a server, that takes no more sessions on the connection
+    constexpr int kPooledSessionRefusedStatus = 429;
+
     class ProofVerifier;
     class QuicServerId;
     class SessionCache;
     class QuicPacketWriterWrapper;
     class Http3EventLoop;
+    class Http3ClientStream;
 
     class Http3Client : public QuicSpdyStream::Visitor,
                         public QuicEpollCallbackInterface,
@@ -251,6 +261,8 @@ namespace quic
 
         static NAN_METHOD(openWTSession);
         static NAN_METHOD(closeClient);
+        static NAN_METHOD(reservePooledSession);
+        static NAN_METHOD(releasePooledSession);
 
         static inline Nan::Persistent<v8::Function> &constructor()
         {
@@ -356,6 +368,29 @@ namespace quic
         void SetLatestCreatedStream(QuicSpdyClientStream *stream);
 
         void openWTSessionInt(absl::string_view path);
+        // creates the streams, that wait for the stream limit of the server
+        void openQueuedStreams();
+        // no new pooled sessions, once the connection is gone or going
+        void updatePoolState();
+
+        spdy::SpdyHeaderBlock connectHeaders(absl::string_view path);
+        // creates the session object for js and returns its visitor,
+        // sent_us is the time the CONNECT went out
+        WebTransportVisitor *attachWTSession(QuicSpdyClientStream *stream, int64_t sent_us);
+        // the server answered the CONNECT of the session
+        void recordSessionResponse(Http3WTSession *wtsessionobj, int64_t sent_us);
+        // the stages of the connection setup reached since the last event
+        void recordConnectProgress();
+        // the session on early_path_, opened without waiting for js
+        void openEarlySessionInt();
+        // the response or the end of the stream of a request sent in 0-rtt
+        void resolveEarlySession(Http3ClientStream *stream, bool closed);
+        // a pooled connection hands sessions to js, once the server answered,
+        // so that a refused one can go to a new connection, in CONNECT order
+        void holdPooledSession(Http3ClientStream *stream, int64_t sent_us);
+        // the response or the end of the stream of a held session
+        void settlePooledSession(Http3ClientStream *stream, bool closed);
+        void flushPooledSessions();
 
         bool closeClientInt();
 
@@ -526,6 +561,36 @@ namespace quic
         bool webtransport_server_support_inform_;
 
         std::queue<std::function<void(QuicSpdyClientStream *)>> finish_stream_open_;
+
+        // 0-rtt session establishment
+        std::string early_path_; // empty if js opens the sessions
+        bool early_opened_ = false;
+        bool replay_early_ = false; // the server answered 425
+        Http3ClientStream *early_stream_ = nullptr; // sent in 0-rtt, no answer yet
+        int64_t early_sent_us_ = 0;
+
+        Http3HandshakeTimeline timeline_; // loop thread only
+
+        // connection pooling, js counts the sessions on the connection and
+        // closes it after the last one, the loop closes the pool for new
+        // sessions, if the connection ends or the server refuses a session
+        bool pooling_ = false;
+        uint32_t max_pooled_sessions_ = kDefaultMaxPooledSessions;
+        uint32_t pooled_sessions_ = 0; // js thread only
+        std::atomic<bool> pool_closed_{false};
+        struct PooledSession
+        {
+            Http3ClientStream *stream;
+            int64_t sent_us;
+            enum
+            {
+                Waiting,
+                Ready,
+                Refused,
+                Failed
+            } state;
+        };
+        std::deque<PooledSession> held_sessions_; // loop thread only
     };
 
 } // namespace quic
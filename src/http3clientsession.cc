@@ -33,7 +33,9 @@ Http3ClientSession::Http3ClientSession(
     : QuicSpdyClientSession(config, supported_versions, connection, server_id,
                             crypto_config, push_promise_index),
       drop_response_body_(drop_response_body),
-      enable_web_transport_(enable_web_transport) {}
+      enable_web_transport_(enable_web_transport) {
+  keepDatagramQueue();
+}
 
 std::unique_ptr<QuicSpdyClientStream>
 Http3ClientSession::CreateClientStream() {
@@ -51,4 +53,20 @@ HttpDatagramSupport Http3ClientSession::LocalHttpDatagramSupport() {
                                : HttpDatagramSupport::kNone;
 }
 
+void Http3ClientSession::OnCanWrite() {
+  QuicSpdyClientSession::OnCanWrite();
+  notifyDatagramSources();
+}
+
+void Http3ClientSession::OnMessageAcked(QuicMessageId message_id,
+                                        QuicTime receive_timestamp) {
+  QuicSpdyClientSession::OnMessageAcked(message_id, receive_timestamp);
+  onMessageAcked(message_id);
+}
+
+void Http3ClientSession::OnMessageLost(QuicMessageId message_id) {
+  QuicSpdyClientSession::OnMessageLost(message_id);
+  onMessageLost(message_id);
+}
+
 }  // namespace quic
@@ -13,10 +13,11 @@
 
 #include "quiche/quic/core/http/quic_spdy_client_session.h"
 #include "src/http3clientstream.h"
+#include "src/http3datagramhooks.h"
 
 namespace quic {
 
-class Http3ClientSession : public QuicSpdyClientSession {
+class Http3ClientSession : public Http3DatagramHooks, public QuicSpdyClientSession {
  public:
   Http3ClientSession(const QuicConfig& config,
                           const ParsedQuicVersionVector& supported_versions,
@@ -36,6 +37,19 @@ class Http3ClientSession : public QuicSpdyClientSession {
   std::unique_ptr<QuicSpdyClientStream> CreateClientStream() override;
   bool ShouldNegotiateWebTransport() override;
   HttpDatagramSupport LocalHttpDatagramSupport() override;
+  void OnCanWrite() override;
+
+  // Http3DatagramHooks
+  size_t QueuedDatagrams() override { return datagram_queue()->queue_size(); }
+  void SetDatagramQueueMaxAge(int64_t max_time) override {
+    datagram_queue()->SetMaxTimeInQueue(
+        max_time < 0 ? QuicTime::Delta::Infinite()
+                     : QuicTime::Delta::FromMicroseconds(max_time));
+  }
+
+  void OnMessageAcked(QuicMessageId message_id,
+                      QuicTime receive_timestamp) override;
+  void OnMessageLost(QuicMessageId message_id) override;
 
  private:
   const bool drop_response_body_;
@@ -12,6 +12,21 @@
 
 namespace quic {
 
+void Http3ClientStream::OnInitialHeadersComplete(
+    bool fin, size_t frame_len, const QuicHeaderList& header_list) {
+  QuicSpdyClientStream::OnInitialHeadersComplete(fin, frame_len, header_list);
+  // informational responses come before the final one
+  if (response_hooks_.empty() ||
+      (response_code() >= 100 && response_code() < 200)) {
+    return;
+  }
+  std::vector<std::function<void(Http3ClientStream*)>> hooks;
+  hooks.swap(response_hooks_);
+  for (auto& hook : hooks) {
+    hook(this);
+  }
+}
+
 void Http3ClientStream::OnBodyAvailable() {
   if (!drop_response_body_) {
     QuicSpdyClientStream::OnBodyAvailable();
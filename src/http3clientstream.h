@@ -11,6 +11,9 @@
 #ifndef HTTP3_CLIENT_STREAM_H
 #define HTTP3_CLIENT_STREAM_H
 
+#include <functional>
+#include <vector>
+
 #include "quiche/quic/core/http/quic_spdy_client_stream.h"
 
 namespace quic {
@@ -22,9 +25,18 @@ class Http3ClientStream : public QuicSpdyClientStream {
       : QuicSpdyClientStream(id, session, type),
         drop_response_body_(drop_response_body) {}
   void OnBodyAvailable() override;
+  void OnInitialHeadersComplete(bool fin, size_t frame_len,
+                                const QuicHeaderList& header_list) override;
+
+  // called once with the final response headers, after quiche has seen
+  // them, e.g. to decide about a request sent in 0-rtt, in the order added
+  void addResponseHook(std::function<void(Http3ClientStream*)> hook) {
+    response_hooks_.push_back(std::move(hook));
+  }
 
  private:
   const bool drop_response_body_;
+  std::vector<std::function<void(Http3ClientStream*)>> response_hooks_;
 };
 
 }  // namespace quic
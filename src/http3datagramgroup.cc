@@ -0,0 +1,169 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3datagramgroup.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "src/http3wtsessionvisitor.h"
+
+namespace quic
+{
+
+    Http3SharedDatagram::Http3SharedDatagram(const char *data, size_t len)
+        : data_(new char[len > 0 ? len : 1]), len_(len)
+    {
+        memcpy(data_, data, len);
+    }
+
+    quiche::QuicheMemSlice Http3SharedDatagram::slice()
+    {
+        refs_++;
+        auto ubuffer = quiche::QuicheUniqueBufferPtr(data_, quiche::QuicheBufferDeleter(this));
+        return quiche::QuicheMemSlice(quiche::QuicheBuffer(std::move(ubuffer), len_));
+    }
+
+    void Http3DatagramGroup::addMemberInt(Http3WTSession *session)
+    {
+        if (closed_ || !session->canSendDatagrams())
+            return;
+        if (std::find(members_.begin(), members_.end(), session) != members_.end())
+            return;
+        members_.push_back(session);
+        session->joinDatagramGroup(this);
+        members_count_ = members_.size();
+    }
+
+    void Http3DatagramGroup::removeMemberInt(Http3WTSession *session)
+    {
+        members_.erase(std::remove(members_.begin(), members_.end(), session), members_.end());
+        members_count_ = members_.size();
+    }
+
+    void Http3DatagramGroup::sendInt(Http3SharedDatagram *datagram)
+    {
+        int64_t now = eventloop_->NowInUsec();
+        for (auto member : members_)
+        {
+            size_t dropped = member->queueDatagram(datagram->slice(), now);
+            if (dropped < 1)
+                queued_++;
+            dropped_ += dropped;
+            member->OnDatagramsCanWrite();
+        }
+        datagram->release();
+    }
+
+    void Http3DatagramGroup::closeInt()
+    {
+        for (auto member : members_)
+        {
+            member->leaveDatagramGroup(this);
+        }
+        members_.clear();
+        members_count_ = 0;
+        closed_ = true;
+        eventloop_->informUnref(this);
+    }
+
+    NAN_METHOD(Http3DatagramGroup::New)
+    {
+        if (info.IsConstructCall())
+        {
+            Http3EventLoop *eventloop = nullptr;
+            if (!info[0]->IsUndefined())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> obj = info[0]->ToObject(context);
+                v8::Local<v8::Object> lobj = obj.ToLocalChecked();
+                eventloop = Nan::ObjectWrap::Unwrap<Http3EventLoop>(lobj);
+            }
+            else
+            {
+                return Nan::ThrowError("No eventloop arguments passed to Http3DatagramGroup");
+            }
+            Http3DatagramGroup *object = new Http3DatagramGroup(eventloop);
+            object->Wrap(info.This());
+            object->Ref(); // until close, the loop thread has pointers to it
+            info.GetReturnValue().Set(info.This());
+        }
+        else
+        {
+            const int argc = 1;
+            v8::Local<v8::Value> argv[argc] = {info[0]};
+            v8::Local<v8::Function> cons = Nan::New(constructor());
+            auto instance = Nan::NewInstance(cons, argc, argv);
+            if (!instance.IsEmpty())
+                info.GetReturnValue().Set(instance.ToLocalChecked());
+        }
+    }
+
+    NAN_METHOD(Http3DatagramGroup::addSession)
+    {
+        Http3DatagramGroup *obj = Nan::ObjectWrap::Unwrap<Http3DatagramGroup>(info.Holder());
+        if (info[0]->IsUndefined() || !info[0]->IsObject())
+            return Nan::ThrowError("addSession needs a session");
+        v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+        Http3WTSession *session = Nan::ObjectWrap::Unwrap<Http3WTSession>(info[0]->ToObject(context).ToLocalChecked());
+        session->Ref(); // keep it, until the loop has seen it
+        std::function<void()> task = [obj, session]()
+        {
+            obj->addMemberInt(session);
+            obj->eventloop_->informUnref(session);
+        };
+        obj->eventloop_->Schedule(task);
+    }
+
+    NAN_METHOD(Http3DatagramGroup::removeSession)
+    {
+        Http3DatagramGroup *obj = Nan::ObjectWrap::Unwrap<Http3DatagramGroup>(info.Holder());
+        if (info[0]->IsUndefined() || !info[0]->IsObject())
+            return Nan::ThrowError("removeSession needs a session");
+        v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+        Http3WTSession *session = Nan::ObjectWrap::Unwrap<Http3WTSession>(info[0]->ToObject(context).ToLocalChecked());
+        session->Ref();
+        std::function<void()> task = [obj, session]()
+        {
+            obj->removeMemberInt(session);
+            session->leaveDatagramGroup(obj);
+            obj->eventloop_->informUnref(session);
+        };
+        obj->eventloop_->Schedule(task);
+    }
+
+    NAN_METHOD(Http3DatagramGroup::send)
+    {
+        Http3DatagramGroup *obj = Nan::ObjectWrap::Unwrap<Http3DatagramGroup>(info.Holder());
+        if (!info[0]->IsArrayBufferView())
+            return Nan::ThrowTypeError("send needs an Uint8Array");
+        // one copy for all members, js may reuse its buffer right away
+        Http3SharedDatagram *datagram =
+            new Http3SharedDatagram(node::Buffer::Data(info[0]), node::Buffer::Length(info[0]));
+        std::function<void()> task = [obj, datagram]()
+        { obj->sendInt(datagram); };
+        obj->eventloop_->Schedule(task);
+    }
+
+    NAN_METHOD(Http3DatagramGroup::getStats)
+    {
+        Http3DatagramGroup *obj = Nan::ObjectWrap::Unwrap<Http3DatagramGroup>(info.Holder());
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("members").ToLocalChecked(), Nan::New(obj->members_count_.load()));
+        Nan::Set(retObj, Nan::New("queued").ToLocalChecked(),
+                 Nan::New<v8::Number>(static_cast<double>(obj->queued_.load())));
+        Nan::Set(retObj, Nan::New("dropped").ToLocalChecked(),
+                 Nan::New<v8::Number>(static_cast<double>(obj->dropped_.load())));
+        info.GetReturnValue().Set(retObj);
+    }
+
+    NAN_METHOD(Http3DatagramGroup::close)
+    {
+        Http3DatagramGroup *obj = Nan::ObjectWrap::Unwrap<Http3DatagramGroup>(info.Holder());
+        std::function<void()> task = [obj]()
+        { obj->closeInt(); };
+        obj->eventloop_->Schedule(task);
+    }
+
+}
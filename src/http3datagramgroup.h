@@ -0,0 +1,100 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_DATAGRAM_GROUP_H_
+#define HTTP3_DATAGRAM_GROUP_H_
+
+#include <nan.h>
+
+#include <atomic>
+#include <vector>
+
+#include "quiche/common/platform/api/quiche_mem_slice.h"
+#include "quiche/common/quiche_buffer_allocator.h"
+
+#include "src/http3eventloop.h"
+
+namespace quic
+{
+    class Http3WTSession;
+
+    // one copy of a datagram, shared by the slices handed to all members
+    // it frees itself, when the last slice is released
+    class Http3SharedDatagram : public quiche::QuicheBufferAllocator
+    {
+    public:
+        Http3SharedDatagram(const char *data, size_t len);
+
+        char *New(size_t size) override { return nullptr; }
+        char *New(size_t size, bool flag_enable) override { return nullptr; }
+
+        // called by quiche, once per slice
+        void Delete(char *buffer) override { release(); }
+
+        quiche::QuicheMemSlice slice();
+
+        void release()
+        {
+            if (--refs_ == 0)
+                delete this;
+        }
+
+    protected:
+        ~Http3SharedDatagram() { delete[] data_; }
+
+        char *data_;
+        size_t len_;
+        size_t refs_ = 1; // loop thread only, the creator holds the first one
+    };
+
+    // a set of sessions, that receive the same datagrams, e.g. a room
+    class Http3DatagramGroup : public Nan::ObjectWrap, public LifetimeHelper
+    {
+    public:
+        explicit Http3DatagramGroup(Http3EventLoop *eventloop) : eventloop_(eventloop) {}
+
+        // called by a closing session on the loop thread
+        void removeMemberInt(Http3WTSession *session);
+
+        void doUnref() override
+        {
+            Unref();
+        }
+
+        // nan stuff
+
+        static NAN_METHOD(New);
+
+        static NAN_METHOD(addSession);
+
+        static NAN_METHOD(removeSession);
+
+        static NAN_METHOD(send);
+
+        static NAN_METHOD(getStats);
+
+        static NAN_METHOD(close);
+
+        static inline Nan::Persistent<v8::Function> &constructor()
+        {
+            static Nan::Persistent<v8::Function> my_constructor;
+            return my_constructor;
+        }
+
+    protected:
+        void addMemberInt(Http3WTSession *session);
+        void sendInt(Http3SharedDatagram *datagram);
+        void closeInt();
+
+        Http3EventLoop *eventloop_;
+        std::vector<Http3WTSession *> members_; // loop thread only
+        bool closed_ = false;                   // loop thread only
+        std::atomic<uint64_t> queued_{0};       // copies queued at members
+        std::atomic<uint64_t> dropped_{0};      // copies dropped at members
+        std::atomic<uint32_t> members_count_{0};
+    };
+
+}
+
+#endif
@@ -0,0 +1,161 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_DATAGRAM_HOOKS_H_
+#define HTTP3_DATAGRAM_HOOKS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace quic
+{
+
+    // a webtransport session, that keeps its own datagram queue
+    class Http3DatagramSource
+    {
+    public:
+        virtual ~Http3DatagramSource() {}
+
+        // the connection can write, refill quiche's datagram queue
+        virtual void OnDatagramsCanWrite() = 0;
+
+        // feedback for datagrams handed over with a tag
+        virtual void OnDatagramAcked(uint64_t tag, int64_t sendtime) = 0;
+        virtual void OnDatagramLost(uint64_t tag, int64_t sendtime) = 0;
+    };
+
+    // mixed into our quic sessions, so that webtransport sessions can see
+    // quiche's datagram queue and feed it only when it drains
+    // must be the first base class, so that it outlives the streams
+    class Http3DatagramHooks
+    {
+    public:
+        virtual ~Http3DatagramHooks() {}
+
+        // datagrams waiting in quiche's queue
+        virtual size_t QueuedDatagrams() = 0;
+        // the age, after which quiche drops queued datagrams, in us, -1 is never
+        virtual void SetDatagramQueueMaxAge(int64_t max_time) = 0;
+
+        void addDatagramSource(Http3DatagramSource *source)
+        {
+            if (std::find(datagram_sources_.begin(), datagram_sources_.end(), source) == datagram_sources_.end())
+                datagram_sources_.push_back(source);
+        }
+
+        void removeDatagramSource(Http3DatagramSource *source)
+        {
+            datagram_sources_.erase(std::remove(datagram_sources_.begin(), datagram_sources_.end(), source),
+                                    datagram_sources_.end());
+            for (auto it = tracked_.begin(); it != tracked_.end();)
+            {
+                if (it->second.source == source)
+                    it = tracked_.erase(it);
+                else
+                    ++it;
+            }
+            // still in quiche's queue, they take their ids, but nobody asks
+            for (auto &cur : blocked_)
+            {
+                if (cur.source == source)
+                    cur.tag = 0;
+            }
+        }
+
+        // quiche must not expire queued datagrams, so that every one of them
+        // is sent and takes a message id; our sources expire by their own age
+        // call once from the constructor of the session
+        void keepDatagramQueue()
+        {
+            SetDatagramQueueMaxAge(-1);
+        }
+
+        // a source handed a datagram to quiche, sent or blocked in quiche's queue
+        // quiche numbers the messages it sends from 1 and consumes an id
+        // only on success, so a sent one takes the next id and a blocked
+        // one waits, until it leaves the queue; tag 0 is not tracked
+        void noteDatagramHandedOver(Http3DatagramSource *source, uint64_t tag, int64_t now, bool sent)
+        {
+            syncDatagramQueue();
+            if (sent)
+                assignMessageId({source, tag, now});
+            else
+                blocked_.push_back({source, tag, now});
+        }
+
+    protected:
+        // the queue never expires and a datagram, that fitted once, fits
+        // again, so whatever left it was sent, in the order of the queue
+        void syncDatagramQueue()
+        {
+            size_t queued = QueuedDatagrams();
+            while (blocked_.size() > queued)
+            {
+                assignMessageId(blocked_.front());
+                blocked_.pop_front();
+            }
+        }
+
+        void onMessageAcked(uint64_t id)
+        {
+            syncDatagramQueue();
+            auto it = tracked_.find(id);
+            if (it == tracked_.end())
+                return;
+            TrackedDatagram cur = it->second;
+            tracked_.erase(it);
+            cur.source->OnDatagramAcked(cur.tag, cur.sendtime);
+        }
+
+        void onMessageLost(uint64_t id)
+        {
+            syncDatagramQueue();
+            auto it = tracked_.find(id);
+            if (it == tracked_.end())
+                return;
+            TrackedDatagram cur = it->second;
+            tracked_.erase(it);
+            cur.source->OnDatagramLost(cur.tag, cur.sendtime);
+        }
+
+        // call from OnCanWrite
+        void notifyDatagramSources()
+        {
+            syncDatagramQueue();
+            // a source may remove itself
+            std::vector<Http3DatagramSource *> sources(datagram_sources_);
+            for (auto source : sources)
+            {
+                source->OnDatagramsCanWrite();
+            }
+        }
+
+        std::vector<Http3DatagramSource *> datagram_sources_;
+
+        struct TrackedDatagram
+        {
+            Http3DatagramSource *source;
+            uint64_t tag;
+            int64_t sendtime; // us
+        };
+
+        void assignMessageId(const TrackedDatagram &cur)
+        {
+            uint64_t id = ++last_message_id_;
+            if (cur.tag > 0)
+                tracked_[id] = cur;
+        }
+
+        uint64_t last_message_id_ = 0;
+        std::unordered_map<uint64_t, TrackedDatagram> tracked_;
+        std::deque<TrackedDatagram> blocked_; // in quiche's queue, in its order
+    };
+
+}
+
+#endif
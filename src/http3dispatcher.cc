@@ -12,11 +12,26 @@
 #include "src/http3serversession.h"
 
 #include "absl/strings/string_view.h"
+#include "openssl/aead.h"
 #include "quiche/quic/core/quic_epoll_alarm_factory.h"
 #include "quiche/quic/core/quic_epoll_connection_helper.h"
+#include "quiche/quic/core/quic_utils.h"
+#include "quiche/quic/core/quic_versions.h"
 
 namespace quic {
 
+namespace {
+
+// retry integrity key and nonce of quic version 1, rfc 9001 section 5.8
+const uint8_t kRetryIntegrityKeyV1[] = {0xbe, 0x0c, 0x69, 0x0b, 0x9f, 0x66,
+                                        0x57, 0x5a, 0x1d, 0x76, 0x6b, 0x54,
+                                        0xe3, 0x68, 0xc8, 0x4e};
+const uint8_t kRetryIntegrityNonceV1[] = {0x46, 0x15, 0x99, 0xd3, 0x5d, 0x63,
+                                          0x2b, 0xf2, 0x23, 0x98, 0x25, 0xbb};
+const size_t kRetryIntegrityTagLength = 16;
+
+}  // namespace
+
 Http3Dispatcher::Http3Dispatcher(
     const QuicConfig* config,
     const QuicCryptoServerConfig* crypto_config,
@@ -25,6 +40,8 @@ Http3Dispatcher::Http3Dispatcher(
     std::unique_ptr<QuicCryptoServerStreamBase::Helper> session_helper,
     std::unique_ptr<QuicAlarmFactory> alarm_factory,
     Http3ServerBackend* http3_server_backend,
+    Http3ChloAdmission* admission,
+    Http3SourceLimiter* source_limiter,
     uint8_t expected_server_connection_id_length)
     : QuicDispatcher(config,
                      crypto_config,
@@ -33,11 +50,113 @@ Http3Dispatcher::Http3Dispatcher(
                      std::move(session_helper),
                      std::move(alarm_factory),
                      expected_server_connection_id_length),
-      http3_server_backend_(http3_server_backend) {}
+      http3_server_backend_(http3_server_backend),
+      admission_(admission),
+      source_limiter_(source_limiter),
+      expected_server_connection_id_length_(
+          expected_server_connection_id_length) {}
 
 Http3Dispatcher::~Http3Dispatcher() = default;
 
+int64_t Http3Dispatcher::NowInUsec() {
+  return (helper()->GetClock()->ApproximateNow() - QuicTime::Zero())
+      .ToMicroseconds();
+}
+
+QuicPacketFate Http3Dispatcher::ValidityChecks(
+    const ReceivedPacketInfo& packet_info) {
+  QuicPacketFate fate = QuicDispatcher::ValidityChecks(packet_info);
+  if (fate != kFateProcess || admission_ == nullptr ||
+      packet_info.form != IETF_QUIC_LONG_HEADER_PACKET ||
+      packet_info.long_packet_type != INITIAL ||
+      packet_info.version != ParsedQuicVersion::RFCv1()) {
+    return fate;
+  }
+  int64_t now = NowInUsec();
+  const QuicConnectionId& connection_id =
+      packet_info.destination_connection_id;
+  QuicConnectionId original_id;
+  // a client, that returns with a token, already paid for the handshake,
+  // tokens of other servers or from NEW_TOKEN count as no token
+  if (packet_info.retry_token.has_value() &&
+      admission_->checkToken(*packet_info.retry_token,
+                             packet_info.peer_address.host(), connection_id,
+                             now, &original_id)) {
+    admission_->onChlo(connection_id, now);
+    admission_->onValidated(connection_id, original_id);
+    return fate;
+  }
+  // the rest of a chlo, that was already let in, is not stopped
+  if (admission_->isPending(connection_id)) {
+    return fate;
+  }
+  if (source_limiter_ != nullptr &&
+      !source_limiter_->allow(packet_info.peer_address.host(), now)) {
+    return kFateDrop;
+  }
+  if (admission_->shouldRetry()) {
+    SendRetry(packet_info);
+    return kFateDrop;
+  }
+  admission_->onChlo(connection_id, now);
+  return fate;
+}
+
+void Http3Dispatcher::SendRetry(const ReceivedPacketInfo& packet_info) {
+  QuicConnectionId retry_id = QuicUtils::CreateRandomConnectionId(
+      expected_server_connection_id_length_);
+  std::string token = admission_->makeToken(
+      packet_info.peer_address.host(), packet_info.destination_connection_id,
+      retry_id, NowInUsec());
+  if (token.empty()) {
+    return;
+  }
+
+  // long header of type retry, rfc 9000 section 17.2.5
+  std::string packet;
+  uint8_t random = 0;
+  QuicRandom::GetInstance()->RandBytes(&random, 1);
+  packet.push_back(static_cast<char>(0xf0 | (random & 0x0f)));
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    packet.push_back(
+        static_cast<char>(packet_info.version_label >> shift));
+  }
+  const QuicConnectionId& client_id = packet_info.source_connection_id;
+  packet.push_back(static_cast<char>(client_id.length()));
+  packet.append(client_id.data(), client_id.length());
+  packet.push_back(static_cast<char>(retry_id.length()));
+  packet.append(retry_id.data(), retry_id.length());
+  packet.append(token);
 
+  // the integrity tag covers the original connection id and the packet
+  const QuicConnectionId& original_id = packet_info.destination_connection_id;
+  std::string pseudo;
+  pseudo.push_back(static_cast<char>(original_id.length()));
+  pseudo.append(original_id.data(), original_id.length());
+  pseudo.append(packet);
+  bssl::ScopedEVP_AEAD_CTX ctx;
+  uint8_t tag[kRetryIntegrityTagLength];
+  size_t tag_length = 0;
+  if (!EVP_AEAD_CTX_init(ctx.get(), EVP_aead_aes_128_gcm(),
+                         kRetryIntegrityKeyV1, sizeof(kRetryIntegrityKeyV1),
+                         kRetryIntegrityTagLength, nullptr) ||
+      !EVP_AEAD_CTX_seal(
+          ctx.get(), tag, &tag_length, sizeof(tag), kRetryIntegrityNonceV1,
+          sizeof(kRetryIntegrityNonceV1), nullptr, 0,
+          reinterpret_cast<const uint8_t*>(pseudo.data()), pseudo.size())) {
+    return;
+  }
+  packet.append(reinterpret_cast<const char*>(tag), tag_length);
+
+  // like a stateless reset, a blocked writer just loses the packet
+  if (writer()->IsWriteBlocked()) {
+    return;
+  }
+  writer()->WritePacket(packet.data(), packet.size(),
+                        packet_info.self_address.host(),
+                        packet_info.peer_address, nullptr);
+  admission_->onRetried();
+}
 
 std::unique_ptr<QuicSession> Http3Dispatcher::CreateQuicSession(
     QuicConnectionId connection_id, const QuicSocketAddress& self_address,
@@ -50,10 +169,27 @@ std::unique_ptr<QuicSession> Http3Dispatcher::CreateQuicSession(
                          alarm_factory(), writer(),
                          /* owns_writer= */ false, Perspective::IS_SERVER,
                          ParsedQuicVersionVector{version});
+  // after a retry both ids go into the transport parameters
+  QuicConnectionId original_id;
+  int64_t now = NowInUsec();
+  int64_t first_chlo = 0;
+  if (admission_ != nullptr) {
+    original_id = admission_->originalId(connection_id);
+    first_chlo = admission_->pendingSince(connection_id);
+    admission_->onAccepted(connection_id);
+  }
+  if (!original_id.IsEmpty()) {
+    connection->SetOriginalDestinationConnectionId(original_id);
+  }
 
   auto session = std::make_unique<Http3ServerSession>(
       config(), GetSupportedVersions(), connection, this, session_helper(),
       crypto_config(), compressed_certs_cache(), http3_server_backend_);
+  if (!original_id.IsEmpty()) {
+    session->config()->SetRetrySourceConnectionIdToSend(connection_id);
+  }
+  session->timeline()->mark(kTimelineStart, first_chlo != 0 ? first_chlo : now);
+  session->timeline()->mark(kTimelineSessionCreated, now);
   session->Initialize();
   return session;
 }
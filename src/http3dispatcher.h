@@ -11,6 +11,8 @@
 #ifndef HTTP3_DISPATCHER
 #define HTTP3_DISPATCHER
 
+#include "src/http3admission.h"
+#include "src/http3ratelimit.h"
 #include "src/http3serverbackend.h"
 #include "absl/strings/string_view.h"
 #include "quiche/quic/core/http/quic_server_session_base.h"
@@ -30,11 +32,17 @@ namespace quic
         std::unique_ptr<QuicCryptoServerStreamBase::Helper> session_helper,
         std::unique_ptr<QuicAlarmFactory> alarm_factory,
         Http3ServerBackend *http3_server_backend,
+        Http3ChloAdmission *admission,
+        Http3SourceLimiter *source_limiter,
         uint8_t expected_server_connection_id_length);
 
     ~Http3Dispatcher() override;
 
   protected:
+    // drops handshakes of sources over their rate and sends new clients a
+    // retry, while too many chlos wait for a session
+    QuicPacketFate ValidityChecks(const ReceivedPacketInfo &packet_info) override;
+
     std::unique_ptr<QuicSession> CreateQuicSession(
         QuicConnectionId connection_id, const QuicSocketAddress &self_address,
         const QuicSocketAddress &peer_address, absl::string_view alpn,
@@ -47,7 +55,13 @@ namespace quic
     }
 
   private:
+    void SendRetry(const ReceivedPacketInfo &packet_info);
+    int64_t NowInUsec();
+
     Http3ServerBackend *http3_server_backend_; // Unowned.
+    Http3ChloAdmission *admission_;            // Unowned.
+    Http3SourceLimiter *source_limiter_;       // Unowned.
+    uint8_t expected_server_connection_id_length_;
   };
 
 } // namespace quic
@@ -7,11 +7,16 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+
 #include "src/http3server.h"
 #include "src/http3client.h"
 #include "src/http3eventloop.h"
 #include "src/http3dispatcher.h"
 #include "src/http3wtsessionvisitor.h"
+#include "src/http3datagramgroup.h"
+#include "src/http3sessioncache.h"
+#include "src/http3testing.h"
 #include "quiche/quic/core/quic_epoll_alarm_factory.h"
 #include "quiche/quic/core/quic_epoll_connection_helper.h"
 #include "quiche/quic/tools/quic_simple_crypto_server_stream_helper.h"
@@ -28,7 +33,8 @@ namespace quic
 
   Http3EventLoop::Http3EventLoop(Callback *cbeventloop, Callback *cbtransport, Callback *cbstream, Callback *cbsession)
       : AsyncProgressQueueWorker(cbeventloop), cbtransport_(cbtransport), 
-        progress_(nullptr), cbstream_(cbstream), cbsession_(cbsession)
+        progress_(nullptr), cbstream_(cbstream), cbsession_(cbsession),
+        session_cache_(std::make_shared<Http3SessionCache>())
   {
     epoll_server_.SetAsyncCallback(this);
   }
@@ -48,6 +54,9 @@ namespace quic
     tpl->InstanceTemplate()->SetInternalFieldCount(2);
     Nan::SetPrototypeMethod(tpl, "startEventLoop", Http3EventLoop::startEventLoop);
     Nan::SetPrototypeMethod(tpl, "shutDownEventLoop", Http3EventLoop::shutDownEventLoop);
+    Nan::SetPrototypeMethod(tpl, "getSessionCacheStats", Http3EventLoop::getSessionCacheStats);
+    Nan::SetPrototypeMethod(tpl, "setSessionCacheOptions", Http3EventLoop::setSessionCacheOptions);
+    Nan::SetPrototypeMethod(tpl, "getClientHandshakeTimings", Http3EventLoop::getClientHandshakeTimings);
     Http3EventLoop::constructor().Reset(Nan::GetFunction(tpl).ToLocalChecked());
     Nan::Set(target, Nan::New("Http3EventLoop").ToLocalChecked(),
              Nan::GetFunction(tpl).ToLocalChecked());
@@ -58,6 +67,12 @@ namespace quic
     Nan::SetPrototypeMethod(tplsrv, "startServer", Http3Server::startServer);
     Nan::SetPrototypeMethod(tplsrv, "stopServer", Http3Server::stopServer);
     Nan::SetPrototypeMethod(tplsrv, "addPath", Http3Server::addPath);
+    Nan::SetPrototypeMethod(tplsrv, "getHandshakeStats", Http3Server::getHandshakeStats);
+    Nan::SetPrototypeMethod(tplsrv, "getHandshakeTimings", Http3Server::getHandshakeTimings);
+    Nan::SetPrototypeMethod(tplsrv, "setTicketKeys", Http3Server::setTicketKeys);
+    Nan::SetPrototypeMethod(tplsrv, "setCertificate", Http3Server::setCertificate);
+    Nan::SetPrototypeMethod(tplsrv, "removeCertificate", Http3Server::removeCertificate);
+    Nan::SetPrototypeMethod(tplsrv, "setPacketLossForTesting", Http3Server::setPacketLossForTesting);
     Http3Server::constructor().Reset(Nan::GetFunction(tplsrv).ToLocalChecked());
     Nan::Set(target, Nan::New("Http3WebTransportServer").ToLocalChecked(),
              Nan::GetFunction(tplsrv).ToLocalChecked());
@@ -67,18 +82,42 @@ namespace quic
     tplcl->InstanceTemplate()->SetInternalFieldCount(2);
     Nan::SetPrototypeMethod(tplcl, "openWTSession", Http3Client::openWTSession);
     Nan::SetPrototypeMethod(tplcl, "closeClient", Http3Client::closeClient);
+    Nan::SetPrototypeMethod(tplcl, "reservePooledSession", Http3Client::reservePooledSession);
+    Nan::SetPrototypeMethod(tplcl, "releasePooledSession", Http3Client::releasePooledSession);
     Http3Client::constructor().Reset(Nan::GetFunction(tplcl).ToLocalChecked());
     Nan::Set(target, Nan::New("Http3WebTransportClient").ToLocalChecked(),
              Nan::GetFunction(tplcl).ToLocalChecked());
 
+    v8::Local<v8::FunctionTemplate> tplgrp = Nan::New<v8::FunctionTemplate>(Http3DatagramGroup::New);
+    tplgrp->SetClassName(Nan::New("Http3DatagramGroup").ToLocalChecked());
+    tplgrp->InstanceTemplate()->SetInternalFieldCount(1);
+    Nan::SetPrototypeMethod(tplgrp, "addSession", Http3DatagramGroup::addSession);
+    Nan::SetPrototypeMethod(tplgrp, "removeSession", Http3DatagramGroup::removeSession);
+    Nan::SetPrototypeMethod(tplgrp, "send", Http3DatagramGroup::send);
+    Nan::SetPrototypeMethod(tplgrp, "getStats", Http3DatagramGroup::getStats);
+    Nan::SetPrototypeMethod(tplgrp, "close", Http3DatagramGroup::close);
+    Http3DatagramGroup::constructor().Reset(Nan::GetFunction(tplgrp).ToLocalChecked());
+    Nan::Set(target, Nan::New("Http3DatagramGroup").ToLocalChecked(),
+             Nan::GetFunction(tplgrp).ToLocalChecked());
+
     // http3wtsessionvisitor
     v8::Local<v8::FunctionTemplate> tplwt = Nan::New<v8::FunctionTemplate>(Http3WTSession::New);
     tplwt->SetClassName(Nan::New("Http3WTSession").ToLocalChecked());
     tplwt->InstanceTemplate()->SetInternalFieldCount(1);
     Nan::SetPrototypeMethod(tplwt, "orderBidiStream", Http3WTSession::orderBidiStream);
     Nan::SetPrototypeMethod(tplwt, "orderUnidiStream", Http3WTSession::orderUnidiStream);
-    Nan::SetPrototypeMethod(tplwt, "writeDatagram", Http3WTSession::writeDatagram);
+    Nan::SetPrototypeMethod(tplwt, "writeDatagrams", Http3WTSession::writeDatagrams);
+    Nan::SetPrototypeMethod(tplwt, "setDatagramOptions", Http3WTSession::setDatagramOptions);
+    Nan::SetPrototypeMethod(tplwt, "getDatagramStats", Http3WTSession::getDatagramStats);
+    Nan::SetPrototypeMethod(tplwt, "getHandshakeTiming", Http3WTSession::getHandshakeTiming);
+    Nan::SetPrototypeMethod(tplwt, "setDatagramFeedback", Http3WTSession::setDatagramFeedback);
+    Nan::SetPrototypeMethod(tplwt, "setDatagramFec", Http3WTSession::setDatagramFec);
+    Nan::SetPrototypeMethod(tplwt, "setDatagramFragmentation", Http3WTSession::setDatagramFragmentation);
+    Nan::SetPrototypeMethod(tplwt, "pullDatagrams", Http3WTSession::pullDatagrams);
+    Nan::SetPrototypeMethod(tplwt, "setIncomingDatagramOptions", Http3WTSession::setIncomingDatagramOptions);
     Nan::SetPrototypeMethod(tplwt, "close", Http3WTSession::close);
+    Nan::SetPrototypeMethod(tplwt, "setStreamReadOptions", Http3WTSession::setStreamReadOptions);
+    Nan::SetPrototypeMethod(tplwt, "setStreamReadFraming", Http3WTSession::setStreamReadFraming);
 
     Http3WTSession::constructor().Reset(Nan::GetFunction(tplwt).ToLocalChecked());
     Nan::Set(target, Nan::New("Http3WTSession").ToLocalChecked(),
@@ -94,10 +133,20 @@ namespace quic
     Nan::SetPrototypeMethod(tplwtsv, "streamFinal", Http3WTStream::streamFinal);
     Nan::SetPrototypeMethod(tplwtsv, "startReading", Http3WTStream::startReading);
     Nan::SetPrototypeMethod(tplwtsv, "stopReading", Http3WTStream::stopReading);
+    Nan::SetPrototypeMethod(tplwtsv, "getDesiredSize", Http3WTStream::getDesiredSize);
+    Nan::SetPrototypeMethod(tplwtsv, "setReadOptions", Http3WTStream::setReadOptions);
+    Nan::SetPrototypeMethod(tplwtsv, "setReadFraming", Http3WTStream::setReadFraming);
+    Nan::SetPrototypeMethod(tplwtsv, "setPriority", Http3WTStream::setPriority);
+    Nan::SetPrototypeMethod(tplwtsv, "setWriteDeadline", Http3WTStream::setWriteDeadline);
 
     Http3WTStream::constructor().Reset(Nan::GetFunction(tplwtsv).ToLocalChecked());
     Nan::Set(target, Nan::New("Http3WTStream").ToLocalChecked(),
              Nan::GetFunction(tplwtsv).ToLocalChecked());
+
+    // for the test suite only
+    v8::Local<v8::Object> testing = Nan::New<v8::Object>();
+    Http3Testing::Init(testing);
+    Nan::Set(target, Nan::New("Http3Testing").ToLocalChecked(), testing);
   }
 
   void Http3EventLoop::Destroy()
@@ -113,6 +162,7 @@ namespace quic
     while (loop_running_)
     {
       epoll_server_.WaitForEventsAndExecuteCallbacks();
+      flushDatagramBatches();
     }
     printf("event loop exited\n");
     progress_ = nullptr;
@@ -147,6 +197,27 @@ namespace quic
     epoll_server_.TriggerAsync();
   }
 
+  void Http3EventLoop::addDatagramBatch(Http3WTSession *sessionobj)
+  {
+    datagram_batches_.push_back(sessionobj);
+  }
+
+  void Http3EventLoop::removeDatagramBatch(Http3WTSession *sessionobj)
+  {
+    datagram_batches_.erase(std::remove(datagram_batches_.begin(), datagram_batches_.end(), sessionobj),
+                            datagram_batches_.end());
+  }
+
+  void Http3EventLoop::flushDatagramBatches()
+  {
+    std::vector<Http3WTSession *> batches;
+    batches.swap(datagram_batches_);
+    for (auto sessionobj : batches)
+    {
+      sessionobj->flushDatagramBatch();
+    }
+  }
+
   void Http3EventLoop::informAboutStream(bool incom, bool bidir, Http3WTSession *sessionobj, Http3WTStream *stream)
   {
     struct Http3ProgressReport report;
@@ -200,13 +271,15 @@ namespace quic
       progress_->Send(&report, 1);
   }
 
-  void Http3EventLoop::informAboutStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle, bool success)
+  void Http3EventLoop::informAboutStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle,
+                                              bool success, int64_t desiredsize)
   {
     struct Http3ProgressReport report;
     report.type = Http3ProgressReport::StreamWrite;
     report.streamobj = streamobj;
     report.bufferhandle = bufferhandle;
     report.success = success;
+    report.desiredsize = desiredsize;
     if (progress_)
       progress_->Send(&report, 1);
   }
@@ -222,6 +295,20 @@ namespace quic
 
   }
 
+  void Http3EventLoop::informAboutStreamDeadlineExpired(Http3WTStream *streamobj, std::vector<uint64_t> *writeseqs,
+                                                        WebTransportStreamError code)
+  {
+    struct Http3ProgressReport report;
+    report.type = Http3ProgressReport::StreamDeadlineExpired;
+    report.streamobj = streamobj;
+    report.writeseqs = writeseqs;
+    report.resetcode = code;
+    if (progress_)
+      progress_->Send(&report, 1);
+    else
+      delete writeseqs;
+  }
+
   void Http3EventLoop::informAboutStreamReset(Http3WTStream *streamobj)
   {
     struct Http3ProgressReport report;
@@ -231,31 +318,35 @@ namespace quic
       progress_->Send(&report, 1);
   }
 
-  void Http3EventLoop::informDatagramReceived(Http3WTSession *sessionobj, absl::string_view datagram)
+  void Http3EventLoop::informDatagramsReceived(Http3WTSession *sessionobj, Http3DatagramBatch *datagrams)
   {
     struct Http3ProgressReport report;
-    report.type = Http3ProgressReport::DatagramReceived;
+    report.type = Http3ProgressReport::DatagramsReceived;
     report.sessionobj = sessionobj;
-    report.para = new std::string(datagram);
+    report.datagrams = datagrams;
     if (progress_)
       progress_->Send(&report, 1);
+    else
+      delete datagrams;
   }
 
-  void Http3EventLoop::informDatagramSend(Http3WTSession *sessionobj)
+  void Http3EventLoop::informDatagramFeedback(Http3WTSession *sessionobj, Http3DatagramFeedback *feedback)
   {
     struct Http3ProgressReport report;
-    report.type = Http3ProgressReport::DatagramSend;
+    report.type = Http3ProgressReport::DatagramFeedback;
     report.sessionobj = sessionobj;
+    report.feedback = feedback;
     if (progress_)
       progress_->Send(&report, 1);
+    else
+      delete feedback;
   }
 
-  void Http3EventLoop::informDatagramBufferFree(Nan::Persistent<v8::Object> *bufferhandle)
+  void Http3EventLoop::informDatagramSend(Http3WTSession *sessionobj)
   {
     struct Http3ProgressReport report;
-    report.type = Http3ProgressReport::DatagramBufferFree;
-    report.bufferhandle = bufferhandle;
-
+    report.type = Http3ProgressReport::DatagramSend;
+    report.sessionobj = sessionobj;
     if (progress_)
       progress_->Send(&report, 1);
   }
@@ -300,12 +391,13 @@ namespace quic
       progress_->Send(&report, 1);
   }
 
-  void Http3EventLoop::informNewClientSession(Http3Client *client, Http3WTSession *session)
+  void Http3EventLoop::informNewClientSession(Http3Client *client, Http3WTSession *session, bool refused)
   {
     struct Http3ProgressReport report;
     report.type = Http3ProgressReport::NewClientSession;
     report.clientobj = client;
     report.session = session;
+    report.refused = refused;
     if (progress_)
       progress_->Send(&report, 1);
   }
@@ -338,6 +430,12 @@ namespace quic
     delete sdata;
   }
 
+  void Http3EventLoop::freeDatagramBatch(char *data, void *hint)
+  {
+    Http3DatagramBatch *batch = static_cast<Http3DatagramBatch *>(hint);
+    delete batch;
+  }
+
   void Http3EventLoop::processClientConnected(Http3Client * clientobj, bool success)
   {
     HandleScope scope;
@@ -435,6 +533,9 @@ namespace quic
       case NetworkTask::streamFinal: {
         nettaskstr = "streamFinal";
       } break;
+      case NetworkTask::framingError: {
+        nettaskstr = "framingError";
+      } break;
       default: return;
     };
 
@@ -479,13 +580,16 @@ namespace quic
     Nan::Call(*cbstream_, 1, argv);
   }
 
-  void Http3EventLoop::processStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle, bool success)
+  void Http3EventLoop::processStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle,
+                                          bool success, int64_t desiredsize)
   {
     HandleScope scope;
     v8::Local<v8::String> purposeProp = Nan::New("purpose").ToLocalChecked();
     v8::Local<v8::String> purposeVal = Nan::New("StreamWrite").ToLocalChecked();
     v8::Local<v8::String> successProp = Nan::New("success").ToLocalChecked();
     v8::Local<v8::Boolean> successVal = Nan::New(success);
+    v8::Local<v8::String> desiredSizeProp = Nan::New("desiredSize").ToLocalChecked();
+    v8::Local<v8::Number> desiredSizeVal = Nan::New<v8::Number>(static_cast<double>(desiredsize));
 
     v8::Local<v8::String> objProp = Nan::New("object").ToLocalChecked();
     v8::Local<v8::Object> objVal = streamobj->handle();
@@ -497,6 +601,7 @@ namespace quic
     v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
     retObj->Set(context, purposeProp, purposeVal).FromJust();
     retObj->Set(context, successProp, successVal).FromJust();
+    retObj->Set(context, desiredSizeProp, desiredSizeVal).FromJust();
     retObj->Set(context, objProp, objVal).FromJust();
 
     v8::Local<v8::Value> argv[] = {retObj};
@@ -559,21 +664,99 @@ namespace quic
     Nan::Call(*cbstream_, 1, argv);
   }
 
-  void Http3EventLoop::processDatagramBufferFree(Nan::Persistent<v8::Object> *bufferhandle)
+  void Http3EventLoop::processStreamDeadlineExpired(Http3WTStream *streamobj, std::vector<uint64_t> *writeseqs,
+                                                    WebTransportStreamError code)
   {
-    bufferhandle->Reset(); // release the outgoing buffer
-    delete bufferhandle;   // free the handle object
+    HandleScope scope;
+    v8::Local<v8::String> purposeProp = Nan::New("purpose").ToLocalChecked();
+    v8::Local<v8::String> purposeVal = Nan::New("StreamDeadlineExpired").ToLocalChecked();
+    v8::Local<v8::String> codeProp = Nan::New("code").ToLocalChecked();
+    v8::Local<v8::Uint32> codeVal = Nan::New(code);
+    v8::Local<v8::String> writesProp = Nan::New("writes").ToLocalChecked();
+    v8::Local<v8::Array> writesVal = Nan::New<v8::Array>(writeseqs->size());
+
+    auto context = GetCurrentContext();
+    for (size_t i = 0; i < writeseqs->size(); i++)
+    {
+      writesVal->Set(context, i, Nan::New<v8::Number>(static_cast<double>((*writeseqs)[i]))).FromJust();
+    }
+    delete writeseqs;
+
+    v8::Local<v8::String> objProp = Nan::New("object").ToLocalChecked();
+    v8::Local<v8::Object> objVal = streamobj->handle();
+
+    v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+    retObj->Set(context, purposeProp, purposeVal).FromJust();
+    retObj->Set(context, codeProp, codeVal).FromJust();
+    retObj->Set(context, writesProp, writesVal).FromJust();
+    retObj->Set(context, objProp, objVal).FromJust();
+
+    v8::Local<v8::Value> argv[] = {retObj};
+    Nan::Call(*cbstream_, 1, argv);
   }
 
-  void Http3EventLoop::processDatagramReceived(Http3WTSession *sessionobj, std::string *datagram)
+  void Http3EventLoop::processDatagramsReceived(Http3WTSession *sessionobj, Http3DatagramBatch *datagrams)
   {
     HandleScope scope;
     v8::Local<v8::String> purposeProp = Nan::New("purpose").ToLocalChecked();
-    v8::Local<v8::String> purposeVal = Nan::New("DatagramReceived").ToLocalChecked();
-    v8::Local<v8::String> datagramProp = Nan::New("datagram").ToLocalChecked();
-    v8::Local<v8::Object> datagramVal = Nan::NewBuffer(&(*datagram)[0], datagram->length(),
-                                                       freeData, static_cast<void *>(datagram))
-                                            .ToLocalChecked();
+    v8::Local<v8::String> purposeVal = Nan::New("DatagramsReceived").ToLocalChecked();
+    v8::Local<v8::String> lengthsProp = Nan::New("lengths").ToLocalChecked();
+    v8::Local<v8::Array> lengthsVal = Nan::New<v8::Array>(datagrams->lengths.size());
+
+    auto context = GetCurrentContext();
+    for (size_t i = 0; i < datagrams->lengths.size(); i++)
+    {
+      lengthsVal->Set(context, i, Nan::New(datagrams->lengths[i])).FromJust();
+    }
+
+    // one buffer for the whole batch, js cuts views out of it
+    v8::Local<v8::String> datagramsProp = Nan::New("datagrams").ToLocalChecked();
+    v8::Local<v8::Object> datagramsVal = Nan::NewBuffer(&datagrams->data[0], datagrams->data.length(),
+                                                        freeDatagramBatch, static_cast<void *>(datagrams))
+                                             .ToLocalChecked();
+
+    v8::Local<v8::String> objProp = Nan::New("object").ToLocalChecked();
+    v8::Local<v8::Object> objVal = sessionobj->handle();
+
+    v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+    retObj->Set(context, purposeProp, purposeVal).FromJust();
+    retObj->Set(context, datagramsProp, datagramsVal).FromJust();
+    retObj->Set(context, lengthsProp, lengthsVal).FromJust();
+    retObj->Set(context, objProp, objVal).FromJust();
+
+    v8::Local<v8::Value> argv[] = {retObj};
+    Nan::Call(*cbsession_, 1, argv);
+  }
+
+  static v8::Local<v8::Array> feedbackEntries(const std::vector<Http3DatagramFeedback::Entry> &entries)
+  {
+    auto context = GetCurrentContext();
+    v8::Local<v8::Array> arr = Nan::New<v8::Array>(entries.size());
+    v8::Local<v8::String> idProp = Nan::New("id").ToLocalChecked();
+    v8::Local<v8::String> sendTimeProp = Nan::New("sendTime").ToLocalChecked();
+    v8::Local<v8::String> elapsedProp = Nan::New("elapsed").ToLocalChecked();
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      // times in ms like everywhere in js
+      v8::Local<v8::Object> entry = Nan::New<v8::Object>();
+      entry->Set(context, idProp, Nan::New<v8::Number>(static_cast<double>(entries[i].id))).FromJust();
+      entry->Set(context, sendTimeProp, Nan::New<v8::Number>(entries[i].sendtime / 1000.)).FromJust();
+      entry->Set(context, elapsedProp, Nan::New<v8::Number>(entries[i].elapsed / 1000.)).FromJust();
+      arr->Set(context, i, entry).FromJust();
+    }
+    return arr;
+  }
+
+  void Http3EventLoop::processDatagramFeedback(Http3WTSession *sessionobj, Http3DatagramFeedback *feedback)
+  {
+    HandleScope scope;
+    v8::Local<v8::String> purposeProp = Nan::New("purpose").ToLocalChecked();
+    v8::Local<v8::String> purposeVal = Nan::New("DatagramFeedback").ToLocalChecked();
+    v8::Local<v8::String> ackedProp = Nan::New("acked").ToLocalChecked();
+    v8::Local<v8::Array> ackedVal = feedbackEntries(feedback->acked);
+    v8::Local<v8::String> lostProp = Nan::New("lost").ToLocalChecked();
+    v8::Local<v8::Array> lostVal = feedbackEntries(feedback->lost);
+    delete feedback;
 
     v8::Local<v8::String> objProp = Nan::New("object").ToLocalChecked();
     v8::Local<v8::Object> objVal = sessionobj->handle();
@@ -581,7 +764,8 @@ namespace quic
     auto context = GetCurrentContext();
     v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
     retObj->Set(context, purposeProp, purposeVal).FromJust();
-    retObj->Set(context, datagramProp, datagramVal).FromJust();
+    retObj->Set(context, ackedProp, ackedVal).FromJust();
+    retObj->Set(context, lostProp, lostVal).FromJust();
     retObj->Set(context, objProp, objVal).FromJust();
 
     v8::Local<v8::Value> argv[] = {retObj};
@@ -633,7 +817,7 @@ namespace quic
   }
 
   
-  void  Http3EventLoop::processNewClientSession(Http3Client *clientobj, Http3WTSession *session)
+  void  Http3EventLoop::processNewClientSession(Http3Client *clientobj, Http3WTSession *session, bool refused)
   {
     HandleScope scope;
 
@@ -653,6 +837,8 @@ namespace quic
       auto sessionobj = Http3WTSession::NewInstance(session);
       retObj->Set(context, sessProp, sessionobj).FromJust();
     }
+    if (refused)
+      retObj->Set(context, Nan::New("refused").ToLocalChecked(), Nan::New(true)).FromJust();
     retObj->Set(context, objProp, objVal).FromJust();
 
     v8::Local<v8::Value> argv[] = {retObj};
@@ -720,7 +906,7 @@ namespace quic
       } break;
       case Http3ProgressReport::NewClientSession:
       {
-        processNewClientSession(cur.clientobj, cur.session);
+        processNewClientSession(cur.clientobj, cur.session, cur.refused);
       }
       break;
       case Http3ProgressReport::NewSession:
@@ -771,7 +957,7 @@ namespace quic
       break;
       case Http3ProgressReport::StreamWrite:
       {
-        processStreamWrite(cur.streamobj, cur.bufferhandle, cur.success);
+        processStreamWrite(cur.streamobj, cur.bufferhandle, cur.success, cur.desiredsize);
       }
       break;
       case Http3ProgressReport::StreamReset:
@@ -783,20 +969,24 @@ namespace quic
       {
         processStreamNetworkFinish(cur.streamobj, cur.nettask);
       } break;
-      case Http3ProgressReport::DatagramReceived:
+      case Http3ProgressReport::StreamDeadlineExpired:
       {
-        processDatagramReceived(cur.sessionobj, cur.para);
-        cur.para = nullptr; // take ownership of the data
+        processStreamDeadlineExpired(cur.streamobj, cur.writeseqs, cur.resetcode);
       }
       break;
-      case Http3ProgressReport::DatagramSend:
+      case Http3ProgressReport::DatagramsReceived:
       {
-        processDatagramSend(cur.sessionobj);
+        processDatagramsReceived(cur.sessionobj, cur.datagrams);
       }
       break;
-      case Http3ProgressReport::DatagramBufferFree:
+      case Http3ProgressReport::DatagramFeedback:
       {
-        processDatagramBufferFree(cur.bufferhandle);
+        processDatagramFeedback(cur.sessionobj, cur.feedback);
+      }
+      break;
+      case Http3ProgressReport::DatagramSend:
+      {
+        processDatagramSend(cur.sessionobj);
       }
       break;
       case Http3ProgressReport::Unref:
@@ -926,6 +1116,68 @@ namespace quic
     }
   }
 
+  // the counters are atomics, so no trip to the loop thread
+  NAN_METHOD(Http3EventLoop::getSessionCacheStats)
+  {
+    Http3EventLoop *obj = Nan::ObjectWrap::Unwrap<Http3EventLoop>(info.Holder());
+    Http3SessionCache *cache = obj->session_cache_.get();
+    v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+    Nan::Set(retObj, Nan::New("servers").ToLocalChecked(),
+             Nan::New(static_cast<uint32_t>(cache->servers())));
+    Nan::Set(retObj, Nan::New("hits").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(cache->hits())));
+    Nan::Set(retObj, Nan::New("misses").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(cache->misses())));
+    Nan::Set(retObj, Nan::New("expired").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(cache->expired())));
+    Nan::Set(retObj, Nan::New("evictions").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(cache->evictions())));
+    info.GetReturnValue().Set(retObj);
+  }
+
+  // histograms of the connection setup of the clients, read without the loop
+  NAN_METHOD(Http3EventLoop::getClientHandshakeTimings)
+  {
+    Http3EventLoop *obj = Nan::ObjectWrap::Unwrap<Http3EventLoop>(info.Holder());
+    info.GetReturnValue().Set(obj->client_timings_.toObject());
+  }
+
+  // { maxServers, ticketsPerServer }
+  NAN_METHOD(Http3EventLoop::setSessionCacheOptions)
+  {
+    Http3EventLoop *obj = Nan::ObjectWrap::Unwrap<Http3EventLoop>(info.Holder());
+    if (!info[0]->IsObject())
+      return Nan::ThrowTypeError("setSessionCacheOptions needs an object");
+    v8::Local<v8::Object> lobj = info[0].As<v8::Object>();
+    double maxservers = kDefaultSessionCacheServers;
+    double tickets = kDefaultSessionCacheTickets;
+    v8::Local<v8::String> serversProp = Nan::New("maxServers").ToLocalChecked();
+    v8::Local<v8::String> ticketsProp = Nan::New("ticketsPerServer").ToLocalChecked();
+    // as doubles, so that -1 does not wrap to a huge limit
+    if (Nan::HasOwnProperty(lobj, serversProp).FromJust())
+    {
+      Nan::Maybe<double> value = Nan::To<double>(Nan::Get(lobj, serversProp).ToLocalChecked());
+      if (value.IsNothing())
+        return;
+      maxservers = value.FromJust();
+    }
+    if (Nan::HasOwnProperty(lobj, ticketsProp).FromJust())
+    {
+      Nan::Maybe<double> value = Nan::To<double>(Nan::Get(lobj, ticketsProp).ToLocalChecked());
+      if (value.IsNothing())
+        return;
+      tickets = value.FromJust();
+    }
+    if (!(maxservers >= 1. && maxservers <= UINT32_MAX && tickets >= 1. && tickets <= UINT32_MAX))
+      return Nan::ThrowRangeError("setSessionCacheOptions needs limits between 1 and 2^32 - 1");
+    std::shared_ptr<Http3SessionCache> cache = obj->session_cache_;
+    size_t servers = static_cast<size_t>(maxservers);
+    size_t perserver = static_cast<size_t>(tickets);
+    std::function<void()> task = [cache, servers, perserver]()
+    { cache->setLimits(servers, perserver); };
+    obj->Schedule(task);
+  }
+
   NODE_MODULE(webtransport, Http3EventLoop::Init)
 
 }
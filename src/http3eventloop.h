@@ -10,11 +10,14 @@
 #ifndef WT_HTTP3_EVENTLOOP_H
 #define WT_HTTP3_EVENTLOOP_H
 
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include <nan.h>
 
 #include "src/http3serverbackend.h"
+#include "src/http3timing.h"
 #include "quiche/quic/core/crypto/quic_crypto_server_config.h"
 #include "quiche/quic/core/quic_udp_socket.h"
 #include "quiche/quic/core/quic_dispatcher.h"
@@ -31,16 +34,65 @@ namespace quic
     class Http3Client;
     class Http3WTSession;
     class Http3WTStream;
+    class Http3SessionCache;
 
     class LifetimeHelper {
     public:
         virtual void doUnref() = 0;
     };
 
+    // alarm on the event loop thread, it calls back into its owner
+    // must be unregistered on the event loop thread before the owner dies
+    class Http3LoopAlarm : public QuicEpollAlarmBase
+    {
+    public:
+        explicit Http3LoopAlarm(std::function<void()> action) : action_(std::move(action)) {}
+
+        int64_t OnAlarm() override
+        {
+            QuicEpollAlarmBase::OnAlarm();
+            action_();
+            return 0;
+        }
+
+        // (re)arms the alarm for the absolute time deadline_us
+        void Arm(QuicEpollServer *eps, int64_t deadline_us)
+        {
+            if (registered())
+                ReregisterAlarm(deadline_us);
+            else
+                eps->RegisterAlarm(deadline_us, this);
+        }
+
+    private:
+        std::function<void()> action_;
+    };
+
+    // datagrams received within one loop iteration, packed back to back
+    struct Http3DatagramBatch
+    {
+        std::string data;
+        std::vector<uint32_t> lengths;
+    };
+
+    // acknowledgements and losses of tracked outgoing datagrams
+    struct Http3DatagramFeedback
+    {
+        struct Entry
+        {
+            uint64_t id;      // the session's datagram sequence number
+            int64_t sendtime; // us, loop clock
+            int64_t elapsed;  // us between hand over and ack or loss
+        };
+        std::vector<Entry> acked;
+        std::vector<Entry> lost;
+    };
+
     enum NetworkTask {
         resetStream,
         stopSending,
-        streamFinal
+        streamFinal,
+        framingError
     };
 
 
@@ -64,9 +116,10 @@ namespace quic
             StreamWrite,
             StreamReset,
             StreamNetworkFinish,
-            DatagramReceived,
+            StreamDeadlineExpired,
+            DatagramsReceived,
+            DatagramFeedback,
             DatagramSend,
-            DatagramBufferFree,
             Unref
         } type;
         union { // always the originating obj
@@ -80,18 +133,27 @@ namespace quic
         {
             WebTransportSessionError wtecode;
             NetworkTask nettask;
+            WebTransportStreamError resetcode;
         };
         union
         {
             Http3WTStream *stream;       // unowned
             Http3WTSession *session;     // unowned
             Nan::Persistent<v8::Object> *bufferhandle; // we own it and must delete it if present
+            std::vector<uint64_t> *writeseqs;          // we own it and must delete it
+            Http3DatagramBatch *datagrams;             // we own it and must delete it
+            Http3DatagramFeedback *feedback;           // we own it and must delete it
             bool fin;
             WebTransportStreamError wtscode;
         };
         union
         {
             bool success;
+            bool refused;
+        };
+        union
+        {
+            int64_t desiredsize; // send budget of a stream in bytes
         };
 
         std::string *para = nullptr; // for session, we own it, and must delete it
@@ -128,7 +190,8 @@ namespace quic
 
         void informAboutClientConnected(Http3Client *client, bool success);
         void informClientWebtransportSupport(Http3Client *client);
-        void informNewClientSession(Http3Client *client, Http3WTSession *session);
+        // refused: the server took no more sessions on the pooled connection
+        void informNewClientSession(Http3Client *client, Http3WTSession *session, bool refused = false);
 
         void informAboutNewSession(Http3Server *server, Http3WTSession *session, absl::string_view path);
         void informSessionClosed(Http3WTSession *sessionobj, WebTransportSessionError error_code, absl::string_view error_message);
@@ -137,28 +200,43 @@ namespace quic
         void informAboutStream(bool incom, bool bidir, Http3WTSession *sessionobj, Http3WTStream *stream);
         void informStreamRecvSignal(Http3WTStream *streamobj, WebTransportStreamError error_code, NetworkTask task);
         void informAboutStreamRead(Http3WTStream *streamobj, std::string *data, bool fin);
-        void informAboutStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle, bool success);
+        void informAboutStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle, bool success, int64_t desiredsize);
         void informAboutStreamReset(Http3WTStream *streamobj);
         void informAboutStreamNetworkFinish(Http3WTStream *streamobj, NetworkTask task);
+        void informAboutStreamDeadlineExpired(Http3WTStream *streamobj, std::vector<uint64_t> *writeseqs,
+                                              WebTransportStreamError code);
 
-        void informDatagramReceived(Http3WTSession *sessionobj, absl::string_view datagram);
-        void informDatagramBufferFree(Nan::Persistent<v8::Object> *bufferhandle);
+        void informDatagramsReceived(Http3WTSession *sessionobj, Http3DatagramBatch *datagrams);
+        void informDatagramFeedback(Http3WTSession *sessionobj, Http3DatagramFeedback *feedback);
         void informDatagramSend(Http3WTSession *sessionobj);
 
         void informUnref(LifetimeHelper * obj);
 
         void Schedule(std::function<void()> action);
 
+        // the session has received datagrams, they go to js after this loop iteration
+        void addDatagramBatch(Http3WTSession *sessionobj);
+        void removeDatagramBatch(Http3WTSession *sessionobj);
+
         int64_t NowInUsec() const {return epoll_server_.NowInUsec();} // remove later
 
+        // tickets of all clients on this loop
+        std::shared_ptr<Http3SessionCache> sessionCache() { return session_cache_; }
+        // connection setup of all clients on this loop
+        Http3ClientTimings &clientTimings() { return client_timings_; }
+
 
     private:
         static NAN_METHOD(New);
         static NAN_METHOD(startEventLoop);
         static NAN_METHOD(shutDownEventLoop);
+        static NAN_METHOD(getSessionCacheStats);
+        static NAN_METHOD(setSessionCacheOptions);
+        static NAN_METHOD(getClientHandshakeTimings);
 
 
         static void freeData(char *data, void *hint);
+        static void freeDatagramBatch(char *data, void *hint);
 
         static inline Nan::Persistent<v8::Function> &constructor()
         {
@@ -167,6 +245,11 @@ namespace quic
         }
 
         void ExecuteScheduledActions();
+        void flushDatagramBatches();
+
+        std::vector<Http3WTSession *> datagram_batches_; // loop thread only
+        std::shared_ptr<Http3SessionCache> session_cache_; // shared with the clients
+        Http3ClientTimings client_timings_;
 
         QuicMutex scheduled_actions_lock_;
         quiche::QuicheCircularDeque<std::function<void()>> scheduled_actions_
@@ -178,7 +261,7 @@ namespace quic
 
         void processClientConnected(Http3Client * clientobj, bool success);
         void processClientWebtransportSupport(Http3Client *client);
-        void processNewClientSession(Http3Client *client, Http3WTSession *session);
+        void processNewClientSession(Http3Client *client, Http3WTSession *session, bool refused);
         
 
         void processNewSession(Http3Server * serverobj, Http3WTSession *session, const std::string &path);
@@ -188,13 +271,15 @@ namespace quic
         void processStream(bool incom, bool bidi, Http3WTSession *sessionobj, Http3WTStream *stream);
         void processStreamRecvSignal(Http3WTStream *streamobj, WebTransportStreamError error_code, NetworkTask task);
         void processStreamRead(Http3WTStream *streamobj, std::string *data, bool fin);
-        void processStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle, bool success);
+        void processStreamWrite(Http3WTStream *streamobj, Nan::Persistent<v8::Object> *bufferhandle, bool success, int64_t desiredsize);
         void processStreamReset(Http3WTStream *streamobj);
         void processStreamNetworkFinish(Http3WTStream *streamobj, NetworkTask task);
+        void processStreamDeadlineExpired(Http3WTStream *streamobj, std::vector<uint64_t> *writeseqs,
+                                          WebTransportStreamError code);
 
-        void processDatagramReceived(Http3WTSession *sessionobj, std::string *datagram);
+        void processDatagramsReceived(Http3WTSession *sessionobj, Http3DatagramBatch *datagrams);
+        void processDatagramFeedback(Http3WTSession *sessionobj, Http3DatagramFeedback *feedback);
         void processDatagramSend(Http3WTSession *sessionobj);
-        void processDatagramBufferFree(Nan::Persistent<v8::Object> *bufferhandle);
 
         bool startEventLoopInt();
         bool shutDownEventLoopInt();
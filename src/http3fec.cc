@@ -0,0 +1,449 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3fec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HTTP3_FEC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace quic
+{
+
+    namespace
+    {
+        enum FecType : uint8_t
+        {
+            kFecSource = 1,
+            kFecRepair = 2
+        };
+
+        // GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1
+        struct GfTables
+        {
+            uint8_t exp[512];
+            uint8_t log[256];
+            uint8_t mul[256][256];
+            // products with the low and the high nibble, for pshufb
+            uint8_t nibble_lo[256][16];
+            uint8_t nibble_hi[256][16];
+
+            GfTables()
+            {
+                unsigned x = 1;
+                for (int i = 0; i < 255; i++)
+                {
+                    exp[i] = static_cast<uint8_t>(x);
+                    log[x] = static_cast<uint8_t>(i);
+                    x <<= 1;
+                    if (x & 0x100)
+                        x ^= 0x11d;
+                }
+                for (int i = 255; i < 512; i++)
+                    exp[i] = exp[i - 255];
+                log[0] = 0;
+                for (int a = 0; a < 256; a++)
+                {
+                    for (int b = 0; b < 256; b++)
+                        mul[a][b] = (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+                    for (int n = 0; n < 16; n++)
+                    {
+                        nibble_lo[a][n] = mul[a][n];
+                        nibble_hi[a][n] = mul[a][n << 4];
+                    }
+                }
+            }
+        };
+
+        const GfTables &gf()
+        {
+            static const GfTables tables;
+            return tables;
+        }
+
+        uint8_t gfMul(uint8_t a, uint8_t b) { return gf().mul[a][b]; }
+
+        uint8_t gfInv(uint8_t a) { return gf().exp[255 - gf().log[a]]; }
+
+        // cauchy matrix, sources are 0..63 and repairs 128..143, so that
+        // every square submatrix is invertible and the code is MDS
+        uint8_t coefficient(size_t repair, size_t source)
+        {
+            return gfInv(static_cast<uint8_t>((128 + repair) ^ source));
+        }
+
+        void mulAddScalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+        {
+            const uint8_t *row = gf().mul[c];
+            for (size_t i = 0; i < len; i++)
+                dst[i] ^= row[src[i]];
+        }
+
+#ifdef HTTP3_FEC_X86
+        __attribute__((target("ssse3"))) void mulAddSsse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+        {
+            const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gf().nibble_lo[c]));
+            const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gf().nibble_hi[c]));
+            const __m128i mask = _mm_set1_epi8(0x0f);
+            size_t i = 0;
+            for (; i + 16 <= len; i += 16)
+            {
+                __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                                          _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(d, p));
+            }
+            mulAddScalar(dst + i, src + i, c, len - i);
+        }
+
+        __attribute__((target("avx2"))) void mulAddAvx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+        {
+            const __m256i lo = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(gf().nibble_lo[c])));
+            const __m256i hi = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(gf().nibble_hi[c])));
+            const __m256i mask = _mm256_set1_epi8(0x0f);
+            size_t i = 0;
+            for (; i + 32 <= len; i += 32)
+            {
+                __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+                                             _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+                __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(d, p));
+            }
+            mulAddSsse3(dst + i, src + i, c, len - i);
+        }
+#endif
+
+        typedef void (*MulAddFunc)(uint8_t *, const uint8_t *, uint8_t, size_t);
+
+        struct Kernel
+        {
+            MulAddFunc func = mulAddScalar;
+            const char *name = "scalar";
+
+            Kernel()
+            {
+#ifdef HTTP3_FEC_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2"))
+                {
+                    func = mulAddAvx2;
+                    name = "avx2";
+                }
+                else if (__builtin_cpu_supports("ssse3"))
+                {
+                    func = mulAddSsse3;
+                    name = "ssse3";
+                }
+#endif
+            }
+        };
+
+        const Kernel &kernel()
+        {
+            static const Kernel cur;
+            return cur;
+        }
+
+        void writeHeader(std::string &out, uint8_t type, uint16_t group, uint8_t index, uint8_t count)
+        {
+            out.push_back(static_cast<char>(type));
+            out.push_back(static_cast<char>(group >> 8));
+            out.push_back(static_cast<char>(group & 0xff));
+            out.push_back(static_cast<char>(index));
+            out.push_back(static_cast<char>(count));
+        }
+
+        // inverts the n x n matrix in place, gauss jordan
+        bool invertMatrix(std::vector<uint8_t> &m, size_t n)
+        {
+            std::vector<uint8_t> inv(n * n, 0);
+            for (size_t i = 0; i < n; i++)
+                inv[i * n + i] = 1;
+            for (size_t col = 0; col < n; col++)
+            {
+                size_t pivot = col;
+                while (pivot < n && m[pivot * n + col] == 0)
+                    pivot++;
+                if (pivot == n)
+                    return false;
+                if (pivot != col)
+                {
+                    for (size_t k = 0; k < n; k++)
+                    {
+                        std::swap(m[pivot * n + k], m[col * n + k]);
+                        std::swap(inv[pivot * n + k], inv[col * n + k]);
+                    }
+                }
+                uint8_t factor = gfInv(m[col * n + col]);
+                for (size_t k = 0; k < n; k++)
+                {
+                    m[col * n + k] = gfMul(m[col * n + k], factor);
+                    inv[col * n + k] = gfMul(inv[col * n + k], factor);
+                }
+                for (size_t row = 0; row < n; row++)
+                {
+                    uint8_t cur = m[row * n + col];
+                    if (row == col || cur == 0)
+                        continue;
+                    for (size_t k = 0; k < n; k++)
+                    {
+                        m[row * n + k] ^= gfMul(cur, m[col * n + k]);
+                        inv[row * n + k] ^= gfMul(cur, inv[col * n + k]);
+                    }
+                }
+            }
+            m.swap(inv);
+            return true;
+        }
+    }
+
+    void fecMulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+    {
+        if (c == 0)
+            return;
+        if (c == 1)
+        {
+            for (size_t i = 0; i < len; i++)
+                dst[i] ^= src[i];
+            return;
+        }
+        kernel().func(dst, src, c, len);
+    }
+
+    const char *fecKernelName() { return kernel().name; }
+
+    std::string Http3FecEncoder::addSource(absl::string_view payload)
+    {
+        std::string out;
+        out.reserve(kFecHeaderSize + payload.size());
+        writeHeader(out, kFecSource, group_, static_cast<uint8_t>(symbols_.size()), 0);
+        out.append(payload.data(), payload.size());
+
+        std::string symbol;
+        symbol.reserve(payload.size() + 2);
+        symbol.push_back(static_cast<char>((payload.size() >> 8) & 0xff));
+        symbol.push_back(static_cast<char>(payload.size() & 0xff));
+        symbol.append(payload.data(), payload.size());
+        symbols_.push_back(std::move(symbol));
+        return out;
+    }
+
+    void Http3FecEncoder::finishGroup(std::vector<std::string> &repairs)
+    {
+        if (symbols_.empty())
+            return;
+        size_t size = 0;
+        for (auto &symbol : symbols_)
+            size = std::max(size, symbol.size());
+        for (size_t j = 0; j < repairs_; j++)
+        {
+            std::string out;
+            out.reserve(kFecHeaderSize + size);
+            writeHeader(out, kFecRepair, group_, static_cast<uint8_t>(j), static_cast<uint8_t>(symbols_.size()));
+            out.resize(kFecHeaderSize + size, 0);
+            uint8_t *dst = reinterpret_cast<uint8_t *>(&out[kFecHeaderSize]);
+            for (size_t i = 0; i < symbols_.size(); i++)
+                fecMulAdd(dst, reinterpret_cast<const uint8_t *>(symbols_[i].data()), coefficient(j, i),
+                          symbols_[i].size());
+            repairs.push_back(std::move(out));
+        }
+        symbols_.clear();
+        group_++;
+    }
+
+    Http3FecDecoder::Group *Http3FecDecoder::findGroup(uint16_t id)
+    {
+        for (auto &group : groups_)
+        {
+            if (group.id == id)
+                return &group;
+        }
+        if (seen_)
+        {
+            int16_t distance = static_cast<int16_t>(id - newest_);
+            // already evicted, or so far ahead, that it is garbage
+            if (distance <= -static_cast<int>(kFecMaxGroups) || distance > 1024)
+                return nullptr;
+            if (distance > 0)
+                newest_ = id;
+        }
+        else
+        {
+            newest_ = id;
+            seen_ = true;
+        }
+        Group group;
+        group.id = id;
+        group.sources.resize(kFecMaxSources);
+        groups_.push_back(std::move(group));
+        while (groups_.size() > kFecMaxGroups)
+            evictGroup();
+        return &groups_.back();
+    }
+
+    void Http3FecDecoder::evictGroup()
+    {
+        Group &group = groups_.front();
+        if (!group.done)
+        {
+            size_t count = group.count > 0 ? group.count : group.highest;
+            if (count > group.received)
+                lost_ += count - group.received;
+        }
+        groups_.pop_front();
+    }
+
+    bool Http3FecDecoder::receive(absl::string_view datagram, absl::string_view &payload,
+                                  std::vector<std::string> &recovered)
+    {
+        if (datagram.size() < kFecHeaderSize)
+        {
+            malformed_++;
+            return false;
+        }
+        const uint8_t *header = reinterpret_cast<const uint8_t *>(datagram.data());
+        uint8_t type = header[0];
+        uint16_t id = static_cast<uint16_t>((header[1] << 8) | header[2]);
+        uint8_t index = header[3];
+        uint8_t count = header[4];
+        absl::string_view body = datagram.substr(kFecHeaderSize);
+
+        if (type == kFecSource)
+        {
+            if (index >= kFecMaxSources)
+            {
+                malformed_++;
+                return false;
+            }
+            // the source goes to js right away, the group only keeps a copy
+            payload = body;
+            Group *group = findGroup(id);
+            if (!group || group->done || !group->sources[index].empty() || (group->count > 0 && index >= group->count))
+                return true;
+            std::string &symbol = group->sources[index];
+            symbol.reserve(body.size() + 2);
+            symbol.push_back(static_cast<char>((body.size() >> 8) & 0xff));
+            symbol.push_back(static_cast<char>(body.size() & 0xff));
+            symbol.append(body.data(), body.size());
+            group->received++;
+            group->highest = std::max(group->highest, static_cast<size_t>(index) + 1);
+            tryRecover(*group, recovered);
+            return true;
+        }
+        if (type == kFecRepair)
+        {
+            if (index >= kFecMaxRepairs || count == 0 || count > kFecMaxSources || body.size() < 2)
+            {
+                malformed_++;
+                return false;
+            }
+            repairs_received_++;
+            Group *group = findGroup(id);
+            if (!group || group->done)
+                return false;
+            if (group->count == 0)
+                group->count = count;
+            if (group->count != count || (!group->repairs.empty() && group->repairs.front().second.size() != body.size()))
+            {
+                malformed_++;
+                return false;
+            }
+            for (auto &repair : group->repairs)
+            {
+                if (repair.first == index)
+                    return false;
+            }
+            group->repairs.push_back(std::make_pair(index, std::string(body)));
+            tryRecover(*group, recovered);
+            return false;
+        }
+        malformed_++;
+        return false;
+    }
+
+    void Http3FecDecoder::tryRecover(Group &group, std::vector<std::string> &recovered)
+    {
+        if (group.count == 0)
+            return;
+        if (group.received >= group.count)
+        {
+            // nothing lost, free the copies
+            group.done = true;
+            group.sources.clear();
+            group.repairs.clear();
+            return;
+        }
+        if (group.received + group.repairs.size() < group.count)
+            return;
+
+        std::vector<size_t> missing;
+        for (size_t i = 0; i < group.count; i++)
+        {
+            if (group.sources[i].empty())
+                missing.push_back(i);
+        }
+        size_t n = missing.size();
+        size_t size = group.repairs.front().second.size();
+
+        // take the known sources out of the first n repairs
+        std::vector<std::string> rhs;
+        std::vector<uint8_t> matrix(n * n);
+        for (size_t r = 0; r < n; r++)
+        {
+            auto &repair = group.repairs[r];
+            std::string cur(repair.second);
+            uint8_t *dst = reinterpret_cast<uint8_t *>(&cur[0]);
+            for (size_t i = 0; i < group.count; i++)
+            {
+                const std::string &symbol = group.sources[i];
+                if (symbol.empty())
+                    continue;
+                if (symbol.size() > size)
+                {
+                    malformed_++;
+                    group.done = true;
+                    return;
+                }
+                fecMulAdd(dst, reinterpret_cast<const uint8_t *>(symbol.data()), coefficient(repair.first, i),
+                          symbol.size());
+            }
+            rhs.push_back(std::move(cur));
+            for (size_t c = 0; c < n; c++)
+                matrix[r * n + c] = coefficient(repair.first, missing[c]);
+        }
+        if (!invertMatrix(matrix, n))
+        {
+            group.done = true;
+            return;
+        }
+        for (size_t c = 0; c < n; c++)
+        {
+            std::string symbol(size, 0);
+            uint8_t *dst = reinterpret_cast<uint8_t *>(&symbol[0]);
+            for (size_t r = 0; r < n; r++)
+                fecMulAdd(dst, reinterpret_cast<const uint8_t *>(rhs[r].data()), matrix[c * n + r], size);
+            size_t len = (static_cast<uint8_t>(symbol[0]) << 8) | static_cast<uint8_t>(symbol[1]);
+            if (len + 2 > size)
+            {
+                malformed_++;
+                continue;
+            }
+            recovered.push_back(symbol.substr(2, len));
+            recovered_++;
+        }
+        group.received = group.count;
+        group.done = true;
+        group.sources.clear();
+        group.repairs.clear();
+    }
+
+}
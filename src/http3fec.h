@@ -0,0 +1,100 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_FEC_H_
+#define HTTP3_FEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace quic
+{
+    // forward error correction for datagram flows, a reed solomon erasure
+    // code over GF(2^8): the K source datagrams of a group are followed by
+    // M repair datagrams, and any K of them restore the whole group
+    //
+    // every datagram carries a small header:
+    // type (1: source, 2: repair), group (16 bit), index, source count
+    // the source count is only known, once the group is closed, so it is
+    // 0 in source datagrams; source payloads are coded with a 16 bit length
+    // prefix and zero padding up to the longest one of the group
+
+    constexpr size_t kFecHeaderSize = 5;
+    constexpr size_t kFecMaxSources = 64;
+    constexpr size_t kFecMaxRepairs = 16;
+    constexpr size_t kFecMaxGroups = 32; // groups a decoder keeps open
+    // a repair datagram is this much larger, than the largest source payload
+    constexpr size_t kFecRepairOverhead = kFecHeaderSize + 2;
+
+    // dst ^= c * src, the kernel (avx2, ssse3 or scalar) is picked at runtime
+    void fecMulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+    const char *fecKernelName();
+
+    class Http3FecEncoder
+    {
+    public:
+        Http3FecEncoder(size_t sources, size_t repairs) : sources_(sources), repairs_(repairs) {}
+
+        // returns the source datagram for the wire
+        std::string addSource(absl::string_view payload);
+
+        bool groupFull() const { return symbols_.size() >= sources_; }
+        bool groupOpen() const { return !symbols_.empty(); }
+
+        // closes the current group, also a partial one, and appends its repairs
+        void finishGroup(std::vector<std::string> &repairs);
+
+    protected:
+        size_t sources_;
+        size_t repairs_;
+        uint16_t group_ = 0;
+        std::vector<std::string> symbols_; // length prefixed payloads of the open group
+    };
+
+    class Http3FecDecoder
+    {
+    public:
+        // returns true if payload is a source payload to deliver, recovered
+        // payloads of the datagram's group are appended to recovered
+        bool receive(absl::string_view datagram, absl::string_view &payload,
+                     std::vector<std::string> &recovered);
+
+        uint64_t repairsReceived() const { return repairs_received_; }
+        uint64_t recovered() const { return recovered_; }
+        uint64_t lost() const { return lost_; } // sources of closed groups, that were neither received nor recovered
+        uint64_t malformed() const { return malformed_; }
+
+    protected:
+        struct Group
+        {
+            uint16_t id;
+            size_t count = 0;    // sources, known from the first repair
+            size_t received = 0; // sources received or recovered
+            size_t highest = 0;  // highest source index + 1 seen
+            bool done = false;   // all sources are there
+            std::vector<std::string> sources; // symbols by index, empty is missing
+            std::vector<std::pair<uint8_t, std::string>> repairs;
+        };
+
+        Group *findGroup(uint16_t id);
+        void evictGroup();
+        void tryRecover(Group &group, std::vector<std::string> &recovered);
+
+        std::deque<Group> groups_; // oldest first
+        uint16_t newest_ = 0;
+        bool seen_ = false;
+        uint64_t repairs_received_ = 0;
+        uint64_t recovered_ = 0;
+        uint64_t lost_ = 0;
+        uint64_t malformed_ = 0;
+    };
+
+}
+
+#endif
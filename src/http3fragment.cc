@@ -0,0 +1,181 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3fragment.h"
+
+#include <algorithm>
+
+namespace quic
+{
+
+    namespace
+    {
+        enum FragmentType : uint8_t
+        {
+            kWholeMessage = 0,
+            kFragment = 1
+        };
+
+        void writeFragmentHeader(std::string &out, uint32_t id, uint16_t index, uint16_t count)
+        {
+            out.push_back(static_cast<char>(kFragment));
+            for (int shift = 24; shift >= 0; shift -= 8)
+                out.push_back(static_cast<char>((id >> shift) & 0xff));
+            out.push_back(static_cast<char>(index >> 8));
+            out.push_back(static_cast<char>(index & 0xff));
+            out.push_back(static_cast<char>(count >> 8));
+            out.push_back(static_cast<char>(count & 0xff));
+        }
+    }
+
+    bool Http3DatagramFragmenter::split(absl::string_view message, size_t max_datagram,
+                                        std::vector<std::string> &out)
+    {
+        if (message.size() + kWholeMessageHeaderSize <= max_datagram)
+        {
+            std::string cur;
+            cur.reserve(message.size() + kWholeMessageHeaderSize);
+            cur.push_back(static_cast<char>(kWholeMessage));
+            cur.append(message.data(), message.size());
+            out.push_back(std::move(cur));
+            return true;
+        }
+        if (max_datagram <= kFragmentHeaderSize || message.size() > max_message_size)
+            return false;
+        size_t chunk = max_datagram - kFragmentHeaderSize;
+        size_t count = (message.size() + chunk - 1) / chunk;
+        if (count > kMaxFragments)
+            return false;
+        uint32_t id = next_id_++;
+        for (size_t i = 0; i < count; i++)
+        {
+            absl::string_view data = message.substr(i * chunk, chunk);
+            std::string cur;
+            cur.reserve(kFragmentHeaderSize + data.size());
+            writeFragmentHeader(cur, id, static_cast<uint16_t>(i), static_cast<uint16_t>(count));
+            cur.append(data.data(), data.size());
+            out.push_back(std::move(cur));
+        }
+        return true;
+    }
+
+    void Http3DatagramReassembler::dropPartial(uint32_t id)
+    {
+        auto it = partials_.find(id);
+        if (it == partials_.end())
+            return;
+        bytes_ -= it->second.bytes + it->second.overhead;
+        partials_.erase(it);
+    }
+
+    void Http3DatagramReassembler::prune(int64_t now)
+    {
+        while (!order_.empty())
+        {
+            auto &front = order_.front();
+            auto it = partials_.find(front.first);
+            if (it == partials_.end() || it->second.created != front.second)
+            {
+                order_.pop_front(); // finished or dropped already
+                continue;
+            }
+            if (now - front.second <= timeout_us && bytes_ <= max_bytes)
+                break;
+            dropPartial(front.first);
+            dropped_++;
+            order_.pop_front();
+        }
+    }
+
+    bool Http3DatagramReassembler::receive(absl::string_view datagram, int64_t now, absl::string_view &view,
+                                           std::string &message)
+    {
+        if (datagram.empty())
+        {
+            malformed_++;
+            return false;
+        }
+        const uint8_t *header = reinterpret_cast<const uint8_t *>(datagram.data());
+        if (header[0] == kWholeMessage)
+        {
+            prune(now);
+            view = datagram.substr(kWholeMessageHeaderSize);
+            return true;
+        }
+        if (header[0] != kFragment || datagram.size() <= kFragmentHeaderSize)
+        {
+            malformed_++;
+            return false;
+        }
+        uint32_t id = (static_cast<uint32_t>(header[1]) << 24) | (static_cast<uint32_t>(header[2]) << 16) |
+                      (static_cast<uint32_t>(header[3]) << 8) | header[4];
+        size_t index = (header[5] << 8) | header[6];
+        size_t count = (header[7] << 8) | header[8];
+        absl::string_view data = datagram.substr(kFragmentHeaderSize);
+        // all fragments but the last are full, so the count must fit
+        // max_message_size at this size, a short last one is held in
+        // check by the slots charged to the memory cap
+        if (count < 2 || index >= count || count > max_message_size / data.size() + 1)
+        {
+            malformed_++;
+            return false;
+        }
+
+        auto it = partials_.find(id);
+        if (it == partials_.end())
+        {
+            size_t overhead = count * kFragmentSlotSize;
+            if (overhead > max_bytes)
+            {
+                malformed_++;
+                return false;
+            }
+            Partial partial;
+            partial.created = now;
+            partial.count = count;
+            partial.overhead = overhead;
+            bytes_ += overhead;
+            partial.fragments.resize(count);
+            partial.present.resize(count, false);
+            it = partials_.emplace(id, std::move(partial)).first;
+            order_.push_back(std::make_pair(id, now));
+        }
+        Partial &partial = it->second;
+        if (partial.count != count)
+        {
+            malformed_++;
+            return false;
+        }
+        if (partial.present[index])
+            return false; // duplicate
+        partial.fragments[index] = std::string(data);
+        partial.present[index] = true;
+        partial.received++;
+        partial.bytes += data.size();
+        bytes_ += data.size();
+        if (partial.bytes > max_message_size)
+        {
+            dropPartial(id);
+            dropped_++;
+            return false;
+        }
+
+        if (partial.received < partial.count)
+        {
+            // the new fragment may push the memory over the cap, the oldest go first
+            prune(now);
+            return false;
+        }
+        message.clear();
+        message.reserve(partial.bytes);
+        for (auto &fragment : partial.fragments)
+            message.append(fragment);
+        dropPartial(id);
+        reassembled_++;
+        prune(now);
+        view = message;
+        return true;
+    }
+
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_FRAGMENT_H_
+#define HTTP3_FRAGMENT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace quic
+{
+    // unreliable messages larger than a datagram, split into numbered
+    // fragments, a message is delivered whole or not at all
+    //
+    // with fragmentation every datagram starts with a type byte:
+    // 0: a whole message follows
+    // 1: a fragment, message id (32 bit), index (16 bit), count (16 bit), data
+
+    constexpr size_t kFragmentHeaderSize = 9;
+    constexpr size_t kWholeMessageHeaderSize = 1;
+    constexpr size_t kMaxFragments = 65535;
+    constexpr size_t kDefaultMaxFragmentedMessageSize = 256 * 1024;
+    constexpr int64_t kDefaultReassemblyTimeoutUs = 1000000;
+    constexpr size_t kDefaultReassemblyBytes = 4 * 1024 * 1024; // per session
+    // memory of each announced fragment, before its data arrives
+    constexpr size_t kFragmentSlotSize = sizeof(std::string) + 1;
+
+    class Http3DatagramFragmenter
+    {
+    public:
+        // splits message into datagrams of at most max_datagram bytes,
+        // returns false, if it can not be sent this way
+        bool split(absl::string_view message, size_t max_datagram, std::vector<std::string> &out);
+
+        size_t max_message_size = kDefaultMaxFragmentedMessageSize;
+
+    protected:
+        uint32_t next_id_ = 0;
+    };
+
+    class Http3DatagramReassembler
+    {
+    public:
+        // returns true, if a message is complete, it is either a view into
+        // datagram or moved into message
+        bool receive(absl::string_view datagram, int64_t now, absl::string_view &view, std::string &message);
+
+        size_t max_message_size = kDefaultMaxFragmentedMessageSize;
+        int64_t timeout_us = kDefaultReassemblyTimeoutUs;
+        size_t max_bytes = kDefaultReassemblyBytes;
+
+        uint64_t reassembled() const { return reassembled_; }
+        uint64_t dropped() const { return dropped_; } // incomplete messages given up
+        uint64_t malformed() const { return malformed_; }
+
+    protected:
+        struct Partial
+        {
+            int64_t created; // us
+            size_t count;
+            size_t received = 0;
+            size_t bytes = 0;
+            size_t overhead = 0; // the slots, charged to bytes_ as well
+            std::vector<std::string> fragments; // by index, empty is missing
+            std::vector<bool> present;
+        };
+
+        void prune(int64_t now);
+        void dropPartial(uint32_t id);
+
+        std::unordered_map<uint32_t, Partial> partials_;
+        // creation order for expiry, entries of finished messages are skipped
+        std::deque<std::pair<uint32_t, int64_t>> order_;
+        size_t bytes_ = 0;
+        uint64_t reassembled_ = 0;
+        uint64_t dropped_ = 0;
+        uint64_t malformed_ = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_LOSSY_WRITER_H_
+#define HTTP3_LOSSY_WRITER_H_
+
+#include <cstdint>
+
+#include "quiche/quic/core/crypto/quic_random.h"
+#include "quiche/quic/core/quic_packet_writer_wrapper.h"
+
+namespace quic
+{
+    // drops a share of the outgoing packets, as if they were lost on the
+    // way, only for benchmarks and tests of loss recovery
+    class Http3LossyPacketWriter : public QuicPacketWriterWrapper
+    {
+    public:
+        Http3LossyPacketWriter(QuicPacketWriter *writer, double loss)
+            : threshold_(static_cast<uint64_t>(loss * static_cast<double>(UINT32_MAX)))
+        {
+            set_writer(writer); // owned
+        }
+
+        WriteResult WritePacket(const char *buffer, size_t buf_len, const QuicIpAddress &self_address,
+                                const QuicSocketAddress &peer_address, PerPacketOptions *options) override
+        {
+            if ((QuicRandom::GetInstance()->RandUint64() & UINT32_MAX) < threshold_)
+            {
+                dropped_++;
+                return WriteResult(WRITE_STATUS_OK, buf_len);
+            }
+            return QuicPacketWriterWrapper::WritePacket(buffer, buf_len, self_address, peer_address, options);
+        }
+
+        uint64_t dropped() const { return dropped_; }
+
+    protected:
+        uint64_t threshold_;
+        uint64_t dropped_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,240 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3proofsource.h"
+
+#include <chrono>
+#include <sstream>
+
+#include "absl/strings/ascii.h"
+#include "quiche/quic/core/crypto/crypto_utils.h"
+#include "src/http3certcompression.h"
+#include "src/http3eventloop.h"
+#include "src/http3timing.h"
+
+namespace quic
+{
+
+    namespace
+    {
+        // workers and the loop take the time, so it is not the loop's clock
+        int64_t steadyNowUs()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+    }
+
+    Http3SigningPool::Http3SigningPool(size_t threads)
+    {
+        for (size_t i = 0; i < threads; i++)
+            workers_.emplace_back([this]()
+                                  { run(); });
+    }
+
+    Http3SigningPool::~Http3SigningPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            queued_ -= jobs_.size();
+            jobs_.clear();
+        }
+        cond_.notify_all();
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+    void Http3SigningPool::post(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+            queued_++;
+        }
+        cond_.notify_one();
+    }
+
+    void Http3SigningPool::run()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this]()
+                           { return stop_ || !jobs_.empty(); });
+                if (stop_)
+                    return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+            queued_--;
+        }
+    }
+
+    Http3ProofSource::Http3ProofSource(Http3EventLoop *eventloop, Certificate certificate, size_t signing_threads)
+        : eventloop_(eventloop), default_certificate_(std::move(certificate))
+    {
+        if (signing_threads > 0)
+            pool_ = std::make_unique<Http3SigningPool>(signing_threads);
+    }
+
+    std::string Http3ProofSource::loadCertificate(const std::string &cert_pem, const std::string &key_pem,
+                                                  Certificate *certificate)
+    {
+        std::stringstream certstream(cert_pem, std::ios_base::in);
+        quiche::QuicheReferenceCountedPointer<Chain> chain(new Chain(CertificateView::LoadPemFromStream(&certstream)));
+        std::stringstream keystream(key_pem, std::ios_base::in);
+        std::unique_ptr<CertificatePrivateKey> key = CertificatePrivateKey::LoadPemFromStream(&keystream);
+        if (key == nullptr)
+            return "LoadPemFromStream privKey failed";
+        if (chain->certs.empty())
+            return "LoadPemFromStream cert failed";
+        std::unique_ptr<CertificateView> leaf = CertificateView::ParseSingleCertificate(chain->certs[0]);
+        if (leaf == nullptr || !key->MatchesPublicKey(*leaf))
+            return "privKey does not match cert";
+        certificate->chain = chain;
+        certificate->key = std::shared_ptr<CertificatePrivateKey>(std::move(key));
+        certificate->leaf = std::shared_ptr<CertificateView>(std::move(leaf));
+        return std::string();
+    }
+
+    void Http3ProofSource::setCertificate(const std::vector<std::string> &server_names, Certificate certificate)
+    {
+        if (server_names.empty())
+            default_certificate_ = certificate;
+        for (auto &name : server_names)
+            sni_certificates_[absl::AsciiStrToLower(name)] = certificate;
+        certificates_ = sni_certificates_.size() + 1;
+        certificate_updates_++;
+    }
+
+    void Http3ProofSource::removeCertificate(const std::string &server_name)
+    {
+        if (sni_certificates_.erase(absl::AsciiStrToLower(server_name)) > 0)
+            certificate_updates_++;
+        certificates_ = sni_certificates_.size() + 1;
+    }
+
+    std::map<std::string, Http3ProofSource::Certificate>::const_iterator Http3ProofSource::matchServerName(
+        const std::map<std::string, Certificate> &certificates, const std::string &hostname)
+    {
+        std::string name = absl::AsciiStrToLower(hostname);
+        auto it = certificates.find(name);
+        // a wildcard covers a single label
+        size_t dot = name.find('.');
+        if (it == certificates.end() && dot != std::string::npos)
+            it = certificates.find("*" + name.substr(dot));
+        return it;
+    }
+
+    const Http3ProofSource::Certificate *Http3ProofSource::certificateFor(const std::string &hostname,
+                                                                           bool *cert_matched_sni)
+    {
+        if (cert_matched_sni)
+            *cert_matched_sni = false;
+        if (sni_certificates_.empty() || hostname.empty())
+            return &default_certificate_;
+        auto it = matchServerName(sni_certificates_, hostname);
+        if (it == sni_certificates_.end())
+            return &default_certificate_;
+        if (cert_matched_sni)
+            *cert_matched_sni = true;
+        return &it->second;
+    }
+
+    void Http3ProofSource::GetProof(const QuicSocketAddress &server_address,
+                                    const QuicSocketAddress &client_address, const std::string &hostname,
+                                    const std::string &server_config, QuicTransportVersion transport_version,
+                                    absl::string_view chlo_hash, std::unique_ptr<Callback> callback)
+    {
+        // only for google quic crypto, which our versions do not use, so sign right away
+        QuicCryptoProof proof;
+        const Certificate *certificate = certificateFor(hostname, &proof.cert_matched_sni);
+        absl::optional<std::string> payload = CryptoUtils::GenerateProofPayloadToBeSigned(chlo_hash, server_config);
+        if (!payload.has_value())
+        {
+            callback->Run(/*ok=*/false, nullptr, proof, nullptr);
+            return;
+        }
+        proof.signature = certificate->key->Sign(*payload, SSL_SIGN_RSA_PSS_RSAE_SHA256);
+        callback->Run(/*ok=*/!proof.signature.empty(), certificate->chain, proof, nullptr);
+    }
+
+    quiche::QuicheReferenceCountedPointer<ProofSource::Chain> Http3ProofSource::GetCertChain(
+        const QuicSocketAddress &server_address, const QuicSocketAddress &client_address,
+        const std::string &hostname, bool *cert_matched_sni)
+    {
+        return certificateFor(hostname, cert_matched_sni)->chain;
+    }
+
+    void Http3ProofSource::ComputeTlsSignature(const QuicSocketAddress &server_address,
+                                               const QuicSocketAddress &client_address,
+                                               const std::string &hostname, uint16_t signature_algorithm,
+                                               absl::string_view in, std::unique_ptr<SignatureCallback> callback)
+    {
+        std::shared_ptr<CertificatePrivateKey> key = certificateFor(hostname, nullptr)->key;
+        int64_t start = steadyNowUs();
+        // the connection, whose handshake needs the signature
+        std::shared_ptr<Http3HandshakeTimeline> timeline = Http3HandshakeTimeline::current();
+        if (timeline)
+            timeline->mark(kTimelineSignStart, eventloop_->NowInUsec());
+        if (!pool_)
+        {
+            std::string signature = key->Sign(in, signature_algorithm);
+            recordLatency(start);
+            if (timeline)
+                timeline->mark(kTimelineSignDone, eventloop_->NowInUsec());
+            callback->Run(/*ok=*/!signature.empty(), signature, nullptr);
+            return;
+        }
+        // the handshaker waits for the callback, it cancels it, if it goes away before
+        std::shared_ptr<SignatureCallback> cb(callback.release());
+        std::string input(in);
+        Http3EventLoop *eventloop = eventloop_;
+        pool_->post([this, eventloop, key, input, signature_algorithm, cb, start, timeline]()
+                    {
+                        std::string signature = key->Sign(input, signature_algorithm);
+                        recordLatency(start);
+                        std::function<void()> task = [cb, signature, eventloop, timeline]()
+                        {
+                            if (timeline)
+                                timeline->mark(kTimelineSignDone, eventloop->NowInUsec());
+                            cb->Run(/*ok=*/!signature.empty(), signature, nullptr);
+                        };
+                        eventloop->Schedule(task); });
+    }
+
+    void Http3ProofSource::OnNewSslCtx(SSL_CTX *ssl_ctx)
+    {
+        if (cert_compression_)
+            Http3EnableCertCompression(ssl_ctx);
+        // quiche puts the transport parameters and the http/3 settings (with
+        // webtransport and datagrams) into the ticket and rejects early data,
+        // if they changed
+        SSL_CTX_set_early_data_enabled(ssl_ctx, early_data_ ? 1 : 0);
+        if (ticket_crypter_)
+            ticket_crypter_->setSslCtx(ssl_ctx);
+    }
+
+    QuicSignatureAlgorithmVector Http3ProofSource::SupportedTlsSignatureAlgorithms() const
+    {
+        return SupportedSignatureAlgorithmsForQuic();
+    }
+
+    void Http3ProofSource::recordLatency(int64_t start_us)
+    {
+        uint64_t latency = static_cast<uint64_t>(steadyNowUs() - start_us);
+        signatures_++;
+        latency_total_us_ += latency;
+        uint64_t max = latency_max_us_.load();
+        while (latency > max && !latency_max_us_.compare_exchange_weak(max, latency))
+        {
+        }
+    }
+
+}
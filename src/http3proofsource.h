@@ -0,0 +1,147 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_PROOF_SOURCE_H_
+#define HTTP3_PROOF_SOURCE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "quiche/quic/core/crypto/certificate_view.h"
+#include "quiche/quic/core/crypto/proof_source.h"
+#include "quiche/common/platform/api/quiche_reference_counted.h"
+#include "src/http3ticketcrypter.h"
+
+namespace quic
+{
+    class Http3EventLoop;
+
+    constexpr size_t kDefaultSigningThreads = 2;
+    constexpr size_t kMaxSigningThreads = 64;
+
+    // a few threads for private key operations, so that a storm of
+    // handshakes does not take loop time from established sessions
+    class Http3SigningPool
+    {
+    public:
+        explicit Http3SigningPool(size_t threads);
+        ~Http3SigningPool();
+
+        // runs job on a worker, jobs not started at destruction are dropped
+        void post(std::function<void()> job);
+
+        size_t threads() const { return workers_.size(); }
+        size_t queued() const { return queued_.load(); }
+
+    protected:
+        void run();
+
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::deque<std::function<void()>> jobs_;
+        std::atomic<size_t> queued_{0};
+        bool stop_ = false;
+    };
+
+    // serves the certificate and signs the handshakes on the signing pool,
+    // the handshake continues on the loop thread
+    class Http3ProofSource : public ProofSource
+    {
+    public:
+        // parsed once, when it is set, handshakes only take references
+        struct Certificate
+        {
+            quiche::QuicheReferenceCountedPointer<Chain> chain;
+            std::shared_ptr<CertificatePrivateKey> key; // shared with running signatures
+            std::shared_ptr<CertificateView> leaf;
+        };
+
+        // parses the pem chain and key and checks, that they belong together,
+        // returns an error message or an empty string
+        static std::string loadCertificate(const std::string &cert_pem, const std::string &key_pem,
+                                           Certificate *certificate);
+
+        Http3ProofSource(Http3EventLoop *eventloop, Certificate certificate, size_t signing_threads);
+
+        // ProofSource
+        void GetProof(const QuicSocketAddress &server_address, const QuicSocketAddress &client_address,
+                      const std::string &hostname, const std::string &server_config,
+                      QuicTransportVersion transport_version, absl::string_view chlo_hash,
+                      std::unique_ptr<Callback> callback) override;
+
+        quiche::QuicheReferenceCountedPointer<Chain> GetCertChain(const QuicSocketAddress &server_address,
+                                                                  const QuicSocketAddress &client_address,
+                                                                  const std::string &hostname,
+                                                                  bool *cert_matched_sni) override;
+
+        void ComputeTlsSignature(const QuicSocketAddress &server_address, const QuicSocketAddress &client_address,
+                                 const std::string &hostname, uint16_t signature_algorithm, absl::string_view in,
+                                 std::unique_ptr<SignatureCallback> callback) override;
+
+        QuicSignatureAlgorithmVector SupportedTlsSignatureAlgorithms() const override;
+
+        TicketCrypter *GetTicketCrypter() override { return ticket_crypter_.get(); }
+
+        void OnNewSslCtx(SSL_CTX *ssl_ctx) override;
+
+        // before the server creates its ssl context
+        void setCertCompression(bool enable) { cert_compression_ = enable; }
+        void setEarlyData(bool enable) { early_data_ = enable; }
+        void setTicketCrypter(std::unique_ptr<Http3TicketCrypter> crypter) { ticket_crypter_ = std::move(crypter); }
+
+        Http3TicketCrypter *ticketCrypter() { return ticket_crypter_.get(); }
+
+        // loop thread, replaces the certificate for the server names, the
+        // default one for no names; names may start with a wildcard "*."
+        // a handshake selects and signs within one task, so a swap never
+        // pairs the chain of one certificate with the key of another
+        void setCertificate(const std::vector<std::string> &server_names, Certificate certificate);
+        void removeCertificate(const std::string &server_name);
+
+        // the certificate for hostname, an exact name before a wildcard, end() if none
+        static std::map<std::string, Certificate>::const_iterator matchServerName(
+            const std::map<std::string, Certificate> &certificates, const std::string &hostname);
+
+        // js thread
+        size_t signingThreads() const { return pool_ ? pool_->threads() : 0; }
+        size_t signingQueue() const { return pool_ ? pool_->queued() : 0; }
+        uint64_t signatures() const { return signatures_.load(); }
+        uint64_t signingLatencyTotalUs() const { return latency_total_us_.load(); }
+        uint64_t signingLatencyMaxUs() const { return latency_max_us_.load(); }
+        size_t certificates() const { return certificates_.load(); }
+        uint64_t certificateUpdates() const { return certificate_updates_.load(); }
+
+    protected:
+        // loop thread only
+        const Certificate *certificateFor(const std::string &hostname, bool *cert_matched_sni);
+        void recordLatency(int64_t start_us);
+
+        Http3EventLoop *eventloop_;
+        Certificate default_certificate_;
+        std::map<std::string, Certificate> sni_certificates_; // by lower case server name
+        bool cert_compression_ = true;
+        bool early_data_ = false;
+        std::unique_ptr<Http3TicketCrypter> ticket_crypter_;
+
+        std::atomic<uint64_t> signatures_{0};
+        std::atomic<uint64_t> latency_total_us_{0}; // queueing and signing
+        std::atomic<uint64_t> latency_max_us_{0};
+        std::atomic<size_t> certificates_{1}; // with the default one
+        std::atomic<uint64_t> certificate_updates_{0};
+        // last, so that running signatures finish before the rest goes away
+        std::unique_ptr<Http3SigningPool> pool_; // none runs the signatures on the loop
+    };
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3ratelimit.h"
+
+#include <algorithm>
+
+namespace quic
+{
+
+    Http3SourceLimiter::Http3SourceLimiter(double rate, double burst, size_t max_sources)
+        : rate_(rate), burst_(std::max(burst, 1.)), max_sources_(std::max<size_t>(max_sources, 1))
+    {
+        buckets_.reserve(max_sources_);
+    }
+
+    std::string Http3SourceLimiter::prefixOf(const QuicIpAddress &peer)
+    {
+        // mapped ipv4 addresses belong to the ipv4 host
+        std::string packed = peer.Normalized().ToPackedString();
+        if (packed.size() > 8)
+            packed.resize(8);
+        return packed;
+    }
+
+    bool Http3SourceLimiter::allow(const QuicIpAddress &peer, int64_t now_us)
+    {
+        if (!enabled())
+            return true;
+        std::string prefix = prefixOf(peer);
+        auto it = buckets_.find(prefix);
+        if (it == buckets_.end())
+        {
+            if (buckets_.size() >= max_sources_)
+            {
+                buckets_.erase(lru_.back().prefix);
+                lru_.pop_back();
+                evictions_++;
+            }
+            lru_.push_front(Bucket{prefix, burst_, now_us, false});
+            it = buckets_.emplace(std::move(prefix), lru_.begin()).first;
+            sources_ = buckets_.size();
+        }
+        else
+        {
+            lru_.splice(lru_.begin(), lru_, it->second);
+        }
+
+        Bucket &bucket = *it->second;
+        if (now_us > bucket.last_us)
+        {
+            bucket.tokens = std::min(burst_, bucket.tokens + (now_us - bucket.last_us) * rate_ / 1e6);
+            bucket.last_us = now_us;
+        }
+        if (bucket.tokens >= 1.)
+        {
+            bucket.tokens -= 1.;
+            return true;
+        }
+        throttled_++;
+        if (!bucket.throttled)
+        {
+            bucket.throttled = true;
+            throttled_sources_++;
+        }
+        return false;
+    }
+
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_RATE_LIMIT_H_
+#define HTTP3_RATE_LIMIT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "quiche/quic/platform/api/quic_ip_address.h"
+
+namespace quic
+{
+    // off by default, many users behind one carrier nat share an address
+    constexpr double kDefaultHandshakeRate = 0.;  // per s and source, e.g. 20
+    constexpr double kDefaultHandshakeBurst = 40.;
+    constexpr size_t kDefaultRateLimitSources = 16384;
+
+    // a token bucket for the handshakes of each source, an ipv4 address or
+    // an ipv6 /64, as one host usually gets a whole /64; the least recently
+    // seen sources are forgotten, so memory stays below max_sources entries
+    // loop thread only, except for the counters
+    class Http3SourceLimiter
+    {
+    public:
+        // rate 0 lets all handshakes in
+        Http3SourceLimiter(double rate, double burst, size_t max_sources);
+
+        // takes a token, false, if the source has to wait
+        bool allow(const QuicIpAddress &peer, int64_t now_us);
+
+        bool enabled() const { return rate_ > 0.; }
+
+        // js thread
+        size_t sources() const { return sources_.load(); }
+        uint64_t throttled() const { return throttled_.load(); }
+        uint64_t throttledSources() const { return throttled_sources_.load(); }
+        uint64_t evictions() const { return evictions_.load(); }
+
+    protected:
+        struct Bucket
+        {
+            std::string prefix;
+            double tokens;
+            int64_t last_us;
+            bool throttled; // counted once in throttled_sources_
+        };
+
+        static std::string prefixOf(const QuicIpAddress &peer);
+
+        double rate_;
+        double burst_;
+        size_t max_sources_;
+
+        std::list<Bucket> lru_; // most recently seen first
+        std::unordered_map<std::string, std::list<Bucket>::iterator> buckets_;
+
+        std::atomic<size_t> sources_{0};
+        std::atomic<uint64_t> throttled_{0};         // handshakes refused
+        std::atomic<uint64_t> throttled_sources_{0}; // sources refused at least once
+        std::atomic<uint64_t> evictions_{0};
+    };
+
+}
+
+#endif
@@ -11,12 +11,14 @@
 #include "src/http3dispatcher.h"
 #include "src/http3wtsessionvisitor.h"
 #include "src/http3eventloop.h"
+#include "src/http3lossywriter.h"
+#include "src/http3proofsource.h"
+#include "src/http3certcompression.h"
 #include "quiche/quic/core/quic_default_packet_writer.h"
 #include "quiche/quic/core/quic_epoll_alarm_factory.h"
 #include "quiche/quic/core/quic_epoll_connection_helper.h"
 #include "quiche/quic/tools/quic_simple_crypto_server_stream_helper.h"
 #include "quiche/quic/core/quic_epoll_clock.h"
-#include "quiche/quic/core/crypto/proof_source_x509.h"
 #include "quiche/common/platform/api/quiche_reference_counted.h"
 
 using namespace Nan;
@@ -24,14 +26,15 @@ using namespace Nan;
 namespace quic
 {
 
-  const size_t kNumSessionsToCreatePerSocketEvent = 16;
-
-  Http3Server::Http3Server(Http3EventLoop *eventloop, std::string host, int port, std::unique_ptr<ProofSource> proof_source,
-                           const char *secret, QuicConfig config)
+  Http3Server::Http3Server(Http3EventLoop *eventloop, std::string host, int port,
+                           std::unique_ptr<Http3ProofSource> proof_source, const char *secret, QuicConfig config,
+                           int64_t retry_threshold)
       : port_(port), host_(host), fd_(-1), overflow_supported_(false),
         config_(config),
+        proof_source_(proof_source.get()),
         eventloop_(eventloop),
         http3_server_backend_(eventloop),
+        admission_(retry_threshold),
         packet_reader_(new QuicPacketReader()),
         packets_dropped_(0),
         version_manager_({ParsedQuicVersion::RFCv1()}),
@@ -89,7 +92,10 @@ namespace quic
 
     eventloop_->getEpollServer()->RegisterFD(fd_, this, kEpollFlags);
     dispatcher_.reset(CreateQuicDispatcher());
-    dispatcher_->InitializeWithWriter(new QuicDefaultPacketWriter(fd_));
+    QuicPacketWriter *writer = new QuicDefaultPacketWriter(fd_);
+    if (packet_loss_ > 0.)
+      writer = new Http3LossyPacketWriter(writer, packet_loss_);
+    dispatcher_->InitializeWithWriter(writer);
 
     return true;
   }
@@ -122,7 +128,7 @@ namespace quic
             new QuicSimpleCryptoServerStreamHelper()),
         std::unique_ptr<QuicEpollAlarmFactory>(
             new QuicEpollAlarmFactory(eventloop_->getEpollServer())),
-        &http3_server_backend_, expected_server_connection_id_length_);
+        &http3_server_backend_, &admission_, source_limiter_.get(), expected_server_connection_id_length_);
   }
 
   NAN_METHOD(Http3Server::New)
@@ -135,6 +141,14 @@ namespace quic
       std::string cert;
       std::string privkey;
       std::string host("localhost");
+      uint32_t signingthreads = kDefaultSigningThreads;
+      bool certcompression = true;
+      bool earlydata = false;
+      double earlydatawindow = kDefaultEarlyDataWindowS;
+      double retrythreshold = kDefaultRetryThreshold;
+      double handshakerate = kDefaultHandshakeRate;
+      double handshakeburst = kDefaultHandshakeBurst;
+      uint32_t ratelimitsources = kDefaultRateLimitSources;
 
       v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
 
@@ -149,6 +163,14 @@ namespace quic
         v8::Local<v8::String> hostProp = Nan::New("host").ToLocalChecked();
         v8::Local<v8::String> keyProp = Nan::New("privKey").ToLocalChecked();
         v8::Local<v8::String> maxconnProp = Nan::New("maxConnections").ToLocalChecked();
+        v8::Local<v8::String> signingProp = Nan::New("signingThreads").ToLocalChecked();
+        v8::Local<v8::String> compressionProp = Nan::New("certCompression").ToLocalChecked();
+        v8::Local<v8::String> earlyDataProp = Nan::New("earlyData").ToLocalChecked();
+        v8::Local<v8::String> earlyWindowProp = Nan::New("earlyDataWindow").ToLocalChecked();
+        v8::Local<v8::String> retryProp = Nan::New("retryThreshold").ToLocalChecked();
+        v8::Local<v8::String> rateProp = Nan::New("handshakeRate").ToLocalChecked();
+        v8::Local<v8::String> burstProp = Nan::New("handshakeBurst").ToLocalChecked();
+        v8::Local<v8::String> sourcesProp = Nan::New("rateLimitSources").ToLocalChecked();
         if (!obj.IsEmpty())
         {
           v8::Local<v8::Object> lobj = obj.ToLocalChecked();
@@ -196,22 +218,75 @@ namespace quic
             sconfig.SetMaxBidirectionalStreamsToSend(maxconn);
             sconfig.SetMaxUnidirectionalStreamsToSend(maxconn); 
           }
+          // 0 signs on the loop thread
+          if (Nan::HasOwnProperty(lobj, signingProp).FromJust() && !Nan::Get(lobj, signingProp).IsEmpty())
+          {
+            v8::Local<v8::Value> signingValue = Nan::Get(lobj, signingProp).ToLocalChecked();
+            double threads = Nan::To<double>(signingValue).FromJust();
+            if (!(threads >= 0. && threads <= kMaxSigningThreads))
+              return Nan::ThrowRangeError("signingThreads must be between 0 and 64");
+            signingthreads = static_cast<uint32_t>(threads);
+          }
+          if (Nan::HasOwnProperty(lobj, compressionProp).FromJust() && !Nan::Get(lobj, compressionProp).IsEmpty())
+          {
+            v8::Local<v8::Value> compressionValue = Nan::Get(lobj, compressionProp).ToLocalChecked();
+            certcompression = Nan::To<bool>(compressionValue).FromJust();
+          }
+          // 0-rtt, the paths still have to opt in, costs 512 kB for the
+          // replay filter, and a ticket, that is replayed or older than
+          // earlyDataWindow, resumes without early data
+          if (Nan::HasOwnProperty(lobj, earlyDataProp).FromJust() && !Nan::Get(lobj, earlyDataProp).IsEmpty())
+          {
+            v8::Local<v8::Value> earlyDataValue = Nan::Get(lobj, earlyDataProp).ToLocalChecked();
+            earlydata = Nan::To<bool>(earlyDataValue).FromJust();
+          }
+          // in s, tickets are good for early data once within the window
+          if (Nan::HasOwnProperty(lobj, earlyWindowProp).FromJust() && !Nan::Get(lobj, earlyWindowProp).IsEmpty())
+          {
+            v8::Local<v8::Value> earlyWindowValue = Nan::Get(lobj, earlyWindowProp).ToLocalChecked();
+            earlydatawindow = Nan::To<double>(earlyWindowValue).FromJust();
+            if (!(earlydatawindow >= 1.))
+              return Nan::ThrowRangeError("earlyDataWindow must be at least 1");
+          }
+          // chlos waiting for a session, before new clients get a retry, -1 never
+          if (Nan::HasOwnProperty(lobj, retryProp).FromJust() && !Nan::Get(lobj, retryProp).IsEmpty())
+          {
+            v8::Local<v8::Value> retryValue = Nan::Get(lobj, retryProp).ToLocalChecked();
+            retrythreshold = Nan::To<double>(retryValue).FromJust();
+            if (!(retrythreshold >= -1.))
+              return Nan::ThrowRangeError("retryThreshold must be at least -1");
+          }
+          // new handshakes per s from one ipv4 address or ipv6 /64, 0 (default) does not limit
+          if (Nan::HasOwnProperty(lobj, rateProp).FromJust() && !Nan::Get(lobj, rateProp).IsEmpty())
+          {
+            v8::Local<v8::Value> rateValue = Nan::Get(lobj, rateProp).ToLocalChecked();
+            handshakerate = Nan::To<double>(rateValue).FromJust();
+            if (!(handshakerate >= 0.))
+              return Nan::ThrowRangeError("handshakeRate must be at least 0");
+          }
+          if (Nan::HasOwnProperty(lobj, burstProp).FromJust() && !Nan::Get(lobj, burstProp).IsEmpty())
+          {
+            v8::Local<v8::Value> burstValue = Nan::Get(lobj, burstProp).ToLocalChecked();
+            handshakeburst = Nan::To<double>(burstValue).FromJust();
+            if (!(handshakeburst >= 1.))
+              return Nan::ThrowRangeError("handshakeBurst must be at least 1");
+          }
+          // sources remembered, bounds the memory of the limiter
+          if (Nan::HasOwnProperty(lobj, sourcesProp).FromJust() && !Nan::Get(lobj, sourcesProp).IsEmpty())
+          {
+            v8::Local<v8::Value> sourcesValue = Nan::Get(lobj, sourcesProp).ToLocalChecked();
+            ratelimitsources = Nan::To<uint32_t>(sourcesValue).FromJust();
+            if (ratelimitsources < 1)
+              return Nan::ThrowRangeError("rateLimitSources must be at least 1");
+          }
           
         }
         // Callback *callback, int port, std::unique_ptr<ProofSource> proof_source,  const char *secret
 
-        std::stringstream certstream(cert, std::ios_base::in);
-        quiche::QuicheReferenceCountedPointer<ProofSource::Chain> chain(new ProofSource::Chain(CertificateView::LoadPemFromStream(&certstream)));
-
-        std::stringstream privkeystream(privkey, std::ios_base::in);
-
-        auto certprivkey = CertificatePrivateKey::LoadPemFromStream(&privkeystream);
-        if (certprivkey == nullptr)
-          return Nan::ThrowError("LoadPemFromStream privKey  failed for Http3Server");
-
-        std::unique_ptr<ProofSourceX509> proofsource = ProofSourceX509::Create(chain, std::move(*certprivkey));
-        if (proofsource == nullptr)
-          return Nan::ThrowError("LoadPemFromStream cert failed for Http3Server");
+        Http3ProofSource::Certificate certificate;
+        std::string certerror = Http3ProofSource::loadCertificate(cert, privkey, &certificate);
+        if (!certerror.empty())
+          return Nan::ThrowError((certerror + " for Http3Server").c_str());
         Http3EventLoop *eventloop = nullptr;
         if (!info[1]->IsUndefined())
         {
@@ -224,7 +299,17 @@ namespace quic
           return Nan::ThrowError("No eventloop arguments passed to Http3Server");
         }
 
-        Http3Server *object = new Http3Server(eventloop, host, port, std::move(proofsource), secret.c_str(), sconfig);
+        std::unique_ptr<Http3ProofSource> proofsource =
+            std::make_unique<Http3ProofSource>(eventloop, std::move(certificate), signingthreads);
+        proofsource->setCertCompression(certcompression);
+        // the secret is the first ticket key, until js sets a rotating key set
+        proofsource->setTicketCrypter(std::make_unique<Http3TicketCrypter>(std::vector<std::string>{secret}));
+        proofsource->setEarlyData(earlydata);
+        if (earlydata)
+          proofsource->ticketCrypter()->setAntiReplay(static_cast<int64_t>(earlydatawindow));
+        Http3Server *object = new Http3Server(eventloop, host, port, std::move(proofsource), secret.c_str(), sconfig,
+                                               static_cast<int64_t>(retrythreshold));
+        object->source_limiter_ = std::make_unique<Http3SourceLimiter>(handshakerate, handshakeburst, ratelimitsources);
         object->Wrap(info.This());
         info.GetReturnValue().Set(info.This());
       }
@@ -301,7 +386,10 @@ namespace quic
     {
       QUIC_DVLOG(1) << "UV_READABLE";
 
-      dispatcher_->ProcessBufferedChlos(kNumSessionsToCreatePerSocketEvent);
+      // fewer new sessions per event, while the loop is busy
+      QuicEpollServer *epollserver = eventloop_->getEpollServer();
+      admission_.sampleLoop(epollserver->NowInUsec(), epollserver->IdleTimeInNsec());
+      dispatcher_->ProcessBufferedChlos(admission_.budget());
 
       bool more_to_read = true;
       while (more_to_read)
@@ -352,6 +440,185 @@ namespace quic
     obj->eventloop_->Schedule(task);
   }
 
+  // signing queue and latency, the proof source keeps them in atomics, so
+  // do the ticket and chlo admission counters
+  NAN_METHOD(Http3Server::getHandshakeStats)
+  {
+    Http3Server *obj = Nan::ObjectWrap::Unwrap<Http3Server>(info.Holder());
+    Http3ProofSource *proofsource = obj->proof_source_;
+    uint64_t signatures = proofsource->signatures();
+    v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+    Nan::Set(retObj, Nan::New("signingThreads").ToLocalChecked(),
+             Nan::New(static_cast<uint32_t>(proofsource->signingThreads())));
+    Nan::Set(retObj, Nan::New("signingQueue").ToLocalChecked(),
+             Nan::New(static_cast<uint32_t>(proofsource->signingQueue())));
+    Nan::Set(retObj, Nan::New("signatures").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(signatures)));
+    // in ms like everywhere in js
+    Nan::Set(retObj, Nan::New("signingLatencyAvg").ToLocalChecked(),
+             Nan::New<v8::Number>(signatures > 0 ? proofsource->signingLatencyTotalUs() / 1000. / signatures : 0.));
+    Nan::Set(retObj, Nan::New("signingLatencyMax").ToLocalChecked(),
+             Nan::New<v8::Number>(proofsource->signingLatencyMaxUs() / 1000.));
+    // certificate compression counts for the whole process
+    Http3CertCompressionStats &certstats = Http3GetCertCompressionStats();
+    Nan::Set(retObj, Nan::New("certCompressions").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(certstats.compressions.load())));
+    Nan::Set(retObj, Nan::New("certCompressionCacheHits").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(certstats.cache_hits.load())));
+    Nan::Set(retObj, Nan::New("certBytesUncompressed").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(certstats.bytes_in.load())));
+    Nan::Set(retObj, Nan::New("certBytesCompressed").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(certstats.bytes_out.load())));
+    Nan::Set(retObj, Nan::New("certificates").ToLocalChecked(),
+             Nan::New(static_cast<uint32_t>(proofsource->certificates())));
+    Nan::Set(retObj, Nan::New("certificateUpdates").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(proofsource->certificateUpdates())));
+    Http3TicketCrypter *crypter = proofsource->ticketCrypter();
+    Nan::Set(retObj, Nan::New("ticketsIssued").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(crypter->issued())));
+    Nan::Set(retObj, Nan::New("ticketHits").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(crypter->hits())));
+    Nan::Set(retObj, Nan::New("ticketMisses").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(crypter->misses())));
+    Nan::Set(retObj, Nan::New("ticketReplays").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(crypter->replays())));
+    Nan::Set(retObj, Nan::New("ticketsExpired").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(crypter->expired())));
+    Nan::Set(retObj, Nan::New("ticketsForeign").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(crypter->foreign())));
+    Nan::Set(retObj, Nan::New("earlyDataSessions").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(obj->http3_server_backend_.earlyDataSessions())));
+    Nan::Set(retObj, Nan::New("earlyDataTooEarly").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(obj->http3_server_backend_.earlyDataTooEarly())));
+    Http3ChloAdmission &admission = obj->admission_;
+    Nan::Set(retObj, Nan::New("chlosPending").ToLocalChecked(),
+             Nan::New(static_cast<uint32_t>(admission.pending())));
+    Nan::Set(retObj, Nan::New("chlosAccepted").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(admission.accepted())));
+    Nan::Set(retObj, Nan::New("chlosRetried").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(admission.retried())));
+    Nan::Set(retObj, Nan::New("chlosDropped").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(admission.dropped())));
+    Nan::Set(retObj, Nan::New("loopUtilization").ToLocalChecked(),
+             Nan::New<v8::Number>(admission.utilization()));
+    Nan::Set(retObj, Nan::New("chloBudget").ToLocalChecked(),
+             Nan::New(static_cast<uint32_t>(admission.currentBudget())));
+    Http3SourceLimiter *limiter = obj->source_limiter_.get();
+    Nan::Set(retObj, Nan::New("sourcesTracked").ToLocalChecked(),
+             Nan::New(static_cast<uint32_t>(limiter->sources())));
+    Nan::Set(retObj, Nan::New("handshakesThrottled").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(limiter->throttled())));
+    Nan::Set(retObj, Nan::New("sourcesThrottled").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(limiter->throttledSources())));
+    Nan::Set(retObj, Nan::New("rateLimitEvictions").ToLocalChecked(),
+             Nan::New<v8::Number>(static_cast<double>(limiter->evictions())));
+    info.GetReturnValue().Set(retObj);
+  }
+
+  // histograms of the setup phases, written by the loop, read without it
+  NAN_METHOD(Http3Server::getHandshakeTimings)
+  {
+    Http3Server *obj = Nan::ObjectWrap::Unwrap<Http3Server>(info.Holder());
+    info.GetReturnValue().Set(obj->http3_server_backend_.timings().toObject());
+  }
+
+  // session ticket keys shared by all processes of a cluster, the first one
+  // encrypts new tickets, the others only decrypt, e.g. [current, previous]
+  NAN_METHOD(Http3Server::setTicketKeys)
+  {
+    Http3Server *obj = Nan::ObjectWrap::Unwrap<Http3Server>(info.Holder());
+    if (!info[0]->IsArray())
+      return Nan::ThrowTypeError("setTicketKeys needs an array");
+    v8::Local<v8::Array> keys = info[0].As<v8::Array>();
+    v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+    std::vector<std::string> secrets;
+    for (uint32_t i = 0; i < keys->Length(); i++)
+    {
+      v8::Local<v8::Value> cur = keys->Get(context, i).ToLocalChecked();
+      if (!cur->IsArrayBufferView())
+        return Nan::ThrowTypeError("setTicketKeys needs Uint8Arrays");
+      size_t len = node::Buffer::Length(cur);
+      if (len < 16)
+        return Nan::ThrowRangeError("setTicketKeys needs keys of at least 16 bytes");
+      secrets.push_back(std::string(node::Buffer::Data(cur), len));
+    }
+    if (secrets.empty())
+      return Nan::ThrowRangeError("setTicketKeys needs at least one key");
+    std::function<void()> task = [obj, secrets]()
+    { obj->proof_source_->ticketCrypter()->setKeys(secrets); };
+    obj->eventloop_->Schedule(task);
+  }
+
+  // { cert, privKey, serverNames }, parsed here on the js thread and swapped
+  // in on the loop, without serverNames it replaces the default certificate
+  NAN_METHOD(Http3Server::setCertificate)
+  {
+    Http3Server *obj = Nan::ObjectWrap::Unwrap<Http3Server>(info.Holder());
+    v8::Isolate *isolate = info.GetIsolate();
+    v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+    if (!info[0]->IsObject())
+      return Nan::ThrowTypeError("setCertificate needs an object");
+    v8::Local<v8::Object> lobj = info[0]->ToObject(context).ToLocalChecked();
+    v8::Local<v8::String> certProp = Nan::New("cert").ToLocalChecked();
+    v8::Local<v8::String> keyProp = Nan::New("privKey").ToLocalChecked();
+    v8::Local<v8::String> namesProp = Nan::New("serverNames").ToLocalChecked();
+    if (!Nan::HasOwnProperty(lobj, certProp).FromJust() || !Nan::HasOwnProperty(lobj, keyProp).FromJust())
+      return Nan::ThrowTypeError("setCertificate needs cert and privKey");
+    std::string cert = *v8::String::Utf8Value(
+        isolate, Nan::Get(lobj, certProp).ToLocalChecked()->ToString(context).ToLocalChecked());
+    std::string privkey = *v8::String::Utf8Value(
+        isolate, Nan::Get(lobj, keyProp).ToLocalChecked()->ToString(context).ToLocalChecked());
+    std::vector<std::string> servernames;
+    if (Nan::HasOwnProperty(lobj, namesProp).FromJust())
+    {
+      v8::Local<v8::Value> namesValue = Nan::Get(lobj, namesProp).ToLocalChecked();
+      if (!namesValue->IsArray())
+        return Nan::ThrowTypeError("serverNames must be an array");
+      v8::Local<v8::Array> names = namesValue.As<v8::Array>();
+      for (uint32_t i = 0; i < names->Length(); i++)
+      {
+        v8::Local<v8::Value> cur = names->Get(context, i).ToLocalChecked();
+        servernames.push_back(*v8::String::Utf8Value(isolate, cur->ToString(context).ToLocalChecked()));
+      }
+      if (servernames.empty())
+        return Nan::ThrowRangeError("serverNames must not be empty");
+    }
+
+    Http3ProofSource::Certificate certificate;
+    std::string certerror = Http3ProofSource::loadCertificate(cert, privkey, &certificate);
+    if (!certerror.empty())
+      return Nan::ThrowError((certerror + " for setCertificate").c_str());
+    std::function<void()> task = [obj, servernames, certificate]()
+    { obj->proof_source_->setCertificate(servernames, certificate); };
+    obj->eventloop_->Schedule(task);
+  }
+
+  NAN_METHOD(Http3Server::removeCertificate)
+  {
+    Http3Server *obj = Nan::ObjectWrap::Unwrap<Http3Server>(info.Holder());
+    v8::Isolate *isolate = info.GetIsolate();
+    v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+    if (info[0]->IsUndefined())
+      return Nan::ThrowTypeError("removeCertificate needs a server name");
+    std::string servername(*v8::String::Utf8Value(isolate, info[0]->ToString(context).ToLocalChecked()));
+    std::function<void()> task = [obj, servername]()
+    { obj->proof_source_->removeCertificate(servername); };
+    obj->eventloop_->Schedule(task);
+  }
+
+  NAN_METHOD(Http3Server::setPacketLossForTesting)
+  {
+    Http3Server *obj = Nan::ObjectWrap::Unwrap<Http3Server>(info.Holder());
+    Nan::Maybe<double> loss = Nan::To<double>(info[0]);
+    if (loss.IsNothing() || !(loss.FromJust() >= 0. && loss.FromJust() < 1.))
+      return Nan::ThrowRangeError("packet loss must be at least 0 and below 1");
+    double packetloss = loss.FromJust();
+    // the writer is created, when the server starts
+    std::function<void()> task = [obj, packetloss]()
+    { obj->packet_loss_ = packetloss; };
+    obj->eventloop_->Schedule(task);
+  }
+
   NAN_METHOD(Http3Server::addPath)
   {
     Http3Server *obj = Nan::ObjectWrap::Unwrap<Http3Server>(info.Holder());
@@ -362,9 +629,10 @@ namespace quic
     {
 
       std::string lpath(*v8::String::Utf8Value(isolate, info[0]->ToString(context).ToLocalChecked()));
-      std::function<void()> task = [obj, lpath]()
+      bool earlydata = !info[1]->IsUndefined() && Nan::To<bool>(info[1]).FromJust();
+      std::function<void()> task = [obj, lpath, earlydata]()
       {
-        obj->http3_server_backend_.addPath(lpath);
+        obj->http3_server_backend_.addPath(lpath, earlydata);
       };
       obj->eventloop_->Schedule(task);
     }
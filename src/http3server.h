@@ -14,6 +14,8 @@
 
 #include <nan.h>
 
+#include "src/http3admission.h"
+#include "src/http3ratelimit.h"
 #include "src/http3serverbackend.h"
 #include "src/http3eventloop.h"
 #include "quiche/quic/core/crypto/quic_crypto_server_config.h"
@@ -29,14 +31,16 @@ namespace quic
 {
 
     class Http3EventLoop;
+    class Http3ProofSource;
 
     class Http3Server : public QuicEpollCallbackInterface, public Nan::ObjectWrap, public LifetimeHelper
     {
     public:
         Http3Server(Http3EventLoop *eventloop, std::string host, int port,
-                    std::unique_ptr<ProofSource> proof_source,
+                    std::unique_ptr<Http3ProofSource> proof_source,
                     const char *secret,
-                    QuicConfig config);
+                    QuicConfig config,
+                    int64_t retry_threshold);
 
         Http3Server(const Http3Server &) = delete;
         Http3Server &operator=(const Http3Server &) = delete;
@@ -65,6 +69,20 @@ namespace quic
 
         static NAN_METHOD(addPath);
 
+        static NAN_METHOD(getHandshakeStats);
+
+        static NAN_METHOD(getHandshakeTimings);
+
+        static NAN_METHOD(setTicketKeys);
+
+        static NAN_METHOD(setCertificate);
+
+        static NAN_METHOD(removeCertificate);
+
+        // drops a share of the outgoing packets, benchmarks and tests only,
+        // call before startServer
+        static NAN_METHOD(setPacketLossForTesting);
+
         static inline Nan::Persistent<v8::Function> &constructor()
         {
             static Nan::Persistent<v8::Function> my_constructor;
@@ -90,6 +108,7 @@ namespace quic
         // config_ contains non-crypto parameters that are negotiated in the crypto
         // handshake.
         QuicConfig config_;
+        Http3ProofSource *proof_source_; // owned by crypto_config_
         // crypto_config_ contains crypto parameters for the handshake.
         QuicCryptoServerConfig crypto_config_;
         // crypto_config_options_ contains crypto parameters for the handshake.
@@ -100,12 +119,17 @@ namespace quic
 
         Http3ServerBackend http3_server_backend_; // unowned.
 
+        Http3ChloAdmission admission_;
+        std::unique_ptr<Http3SourceLimiter> source_limiter_; // set before the start
+
         // Connection ID length expected to be read on incoming IETF short headers.
         uint8_t expected_server_connection_id_length_;
 
         QuicDispatcher *CreateQuicDispatcher();
 
         Http3EventLoop *eventloop_;
+
+        double packet_loss_ = 0.; // share of outgoing packets the writer drops
     };
 
 }
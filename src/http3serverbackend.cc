@@ -9,6 +9,7 @@
 // found in the LICENSE file.
 
 #include "src/http3serverbackend.h"
+#include "src/http3serversession.h"
 #include "src/http3wtsessionvisitor.h"
 #include "src/http3server.h"
 #include "src/http3eventloop.h"
@@ -20,6 +21,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "quiche/quic/core/http/spdy_utils.h"
+#include "quiche/quic/core/quic_crypto_stream.h"
 #include "quiche/quic/platform/api/quic_bug_tracker.h"
 #include "quiche/quic/platform/api/quic_logging.h"
 //#include "quic/tools/web_transport_test_visitors.h"
@@ -48,7 +50,29 @@ namespace quic
   Http3ServerBackend::WebTransportResponse
   Http3ServerBackend::ProcessWebTransportRequest(
       const spdy::Http2HeaderBlock &request_headers,
-      WebTransportSession *session)
+      WebTransportSession *session,
+      QuicSpdySession *spdy_session,
+      Http3DatagramHooks *datagram_hooks)
+  {
+    Http3HandshakeTimeline *timeline = static_cast<Http3ServerSession *>(spdy_session)->timeline().get();
+    int64_t connect = eventloop_->NowInUsec();
+    timeline->mark(kTimelineConnect, connect);
+    WebTransportResponse response =
+        decideWebTransportRequest(request_headers, session, spdy_session, datagram_hooks, *timeline, connect);
+    int64_t now = eventloop_->NowInUsec();
+    timeline->mark(kTimelineResponse, now);
+    timings_.recordRequest(*timeline, connect, now);
+    return response;
+  }
+
+  Http3ServerBackend::WebTransportResponse
+  Http3ServerBackend::decideWebTransportRequest(
+      const spdy::Http2HeaderBlock &request_headers,
+      WebTransportSession *session,
+      QuicSpdySession *spdy_session,
+      Http3DatagramHooks *datagram_hooks,
+      const Http3HandshakeTimeline &timeline,
+      int64_t connect_us)
   {
     if (!SupportsWebTransport())
     {
@@ -68,8 +92,26 @@ namespace quic
 
     if (paths_.find(path) != paths_.end())
     { // to do handle our web transport paths
+      // only a request in 0-rtt arrives before the handshake completes
+      const QuicCryptoStream *crypto_stream = spdy_session->GetCryptoStream();
+      if (crypto_stream->EarlyDataAccepted() && crypto_stream->GetHandshakeState() < HANDSHAKE_COMPLETE)
+      {
+        if (early_data_paths_.find(path) == early_data_paths_.end())
+        {
+          early_data_too_early_++;
+          WebTransportResponse response;
+          response.response_headers[":status"] = "425";
+          return response;
+        }
+        early_data_sessions_++;
+      }
       WebTransportResponse response;
-      Http3WTSession * wtsession = new Http3WTSession(session, eventloop_);
+      Http3WTSession * wtsession = new Http3WTSession(session, spdy_session, datagram_hooks, eventloop_);
+      // the session's own request, not the first one of the connection
+      Http3HandshakeTimeline sessiontimeline = timeline;
+      sessiontimeline.at[kTimelineConnect] = connect_us;
+      sessiontimeline.at[kTimelineResponse] = eventloop_->NowInUsec();
+      wtsession->setTimeline(sessiontimeline);
       response.response_headers[":status"] = "200";
       response.visitor =
           std::make_unique<Http3WTSession::Visitor>(wtsession); 
@@ -11,11 +11,17 @@
 #ifndef QUICHE_QUIC_TOOLS_QUIC_SIMPLE_SERVER_BACKEND_H_
 #define QUICHE_QUIC_TOOLS_QUIC_SIMPLE_SERVER_BACKEND_H_
 
+#include <atomic>
 #include <memory>
+#include <set>
+#include <string>
 
 #include "quiche/quic/core/quic_types.h"
 #include "quiche/quic/core/web_transport_interface.h"
+#include "quiche/quic/core/http/quic_spdy_session.h"
 #include "quiche/spdy/core/spdy_header_block.h"
+#include "src/http3datagramhooks.h"
+#include "src/http3timing.h"
 
 namespace quic
 {
@@ -45,17 +51,47 @@ namespace quic
 
     WebTransportResponse ProcessWebTransportRequest(
         const spdy::Http2HeaderBlock & /*request_headers*/,
-        WebTransportSession * /*session*/);
+        WebTransportSession * /*session*/,
+        QuicSpdySession * /*spdy_session*/,
+        Http3DatagramHooks * /*datagram_hooks*/);
     bool SupportsWebTransport() { return true; }
     bool UsesDatagramContexts() { return true; }
     bool SupportsExtendedConnect() { return true; }
 
-    void addPath(std::string path) { paths_.insert(path); }
+    // early data may be replayed by an attacker, so a path only takes
+    // sessions opened in 0-rtt, if it opted in, others get 425 and the
+    // client retries after the handshake
+    void addPath(std::string path, bool early_data)
+    {
+      paths_.insert(path);
+      if (early_data)
+        early_data_paths_.insert(path);
+      else
+        early_data_paths_.erase(path);
+    }
+
+    // js thread
+    uint64_t earlyDataSessions() const { return early_data_sessions_.load(); }
+    uint64_t earlyDataTooEarly() const { return early_data_too_early_.load(); }
+
+    Http3ServerTimings &timings() { return timings_; }
 
   protected:
+    WebTransportResponse decideWebTransportRequest(
+        const spdy::Http2HeaderBlock &request_headers,
+        WebTransportSession *session,
+        QuicSpdySession *spdy_session,
+        Http3DatagramHooks *datagram_hooks,
+        const Http3HandshakeTimeline &timeline,
+        int64_t connect_us);
+
     Http3Server *server_; // unowned
     Http3EventLoop *eventloop_; // unowned
     std::set<std::string> paths_;
+    std::set<std::string> early_data_paths_;
+    std::atomic<uint64_t> early_data_sessions_{0};
+    std::atomic<uint64_t> early_data_too_early_{0};
+    Http3ServerTimings timings_;
   };
 
 } // namespace quic
@@ -36,13 +36,32 @@ namespace quic
                               helper, crypto_config, compressed_certs_cache),
         highest_promised_stream_id_(
             QuicUtils::GetInvalidStreamId(connection->transport_version())),
-        http3_server_backend_(http3_server_backend)
+        http3_server_backend_(http3_server_backend),
+        timeline_(std::make_shared<Http3HandshakeTimeline>())
   {
     QUICHE_DCHECK(http3_server_backend_);
+    keepDatagramQueue();
   }
 
   Http3ServerSession::~Http3ServerSession() { DeleteConnection(); }
 
+  void Http3ServerSession::ProcessUdpPacket(const QuicSocketAddress &self_address,
+                                            const QuicSocketAddress &peer_address,
+                                            const QuicReceivedPacket &packet)
+  {
+    // the proof source learns, whose signature it computes
+    Http3TimelineScope scope(timeline_);
+    QuicServerSessionBase::ProcessUdpPacket(self_address, peer_address, packet);
+  }
+
+  void Http3ServerSession::OnTlsHandshakeComplete()
+  {
+    QuicServerSessionBase::OnTlsHandshakeComplete();
+    timeline_->mark(kTimelineHandshakeComplete,
+                    (connection()->clock()->ApproximateNow() - QuicTime::Zero()).ToMicroseconds());
+    http3_server_backend_->timings().recordHandshake(*timeline_);
+  }
+
   std::unique_ptr<QuicCryptoServerStreamBase>
   Http3ServerSession::CreateQuicCryptoServerStream(
       const QuicCryptoServerConfig *crypto_config,
@@ -245,6 +264,24 @@ namespace quic
     }
   }
 
+  void Http3ServerSession::OnCanWrite()
+  {
+    QuicServerSessionBase::OnCanWrite();
+    notifyDatagramSources();
+  }
+
+  void Http3ServerSession::OnMessageAcked(QuicMessageId message_id, QuicTime receive_timestamp)
+  {
+    QuicServerSessionBase::OnMessageAcked(message_id, receive_timestamp);
+    onMessageAcked(message_id);
+  }
+
+  void Http3ServerSession::OnMessageLost(QuicMessageId message_id)
+  {
+    QuicServerSessionBase::OnMessageLost(message_id);
+    onMessageLost(message_id);
+  }
+
   void Http3ServerSession::MaybeInitializeHttp3UnidirectionalStreams()
   {
     size_t previous_static_stream_count = num_static_streams();
@@ -29,11 +29,13 @@
 //#include "quic/tools/quic_backend_response.h"
 #include "src/http3serverbackend.h"
 #include "src/http3serverstream.h" // todo
+#include "src/http3datagramhooks.h"
+#include "src/http3timing.h"
 
 namespace quic
 {
 
-  class Http3ServerSession : public QuicServerSessionBase
+  class Http3ServerSession : public Http3DatagramHooks, public QuicServerSessionBase
   {
   public:
     // A PromisedStreamInfo is an element of the queue to store promised
@@ -74,6 +76,27 @@ namespace quic
 
     void OnCanCreateNewOutgoingStream(bool unidirectional) override;
 
+    void OnCanWrite() override;
+
+    // Http3DatagramHooks
+    size_t QueuedDatagrams() override { return datagram_queue()->queue_size(); }
+    void SetDatagramQueueMaxAge(int64_t max_time) override
+    {
+      datagram_queue()->SetMaxTimeInQueue(max_time < 0 ? QuicTime::Delta::Infinite()
+                                                       : QuicTime::Delta::FromMicroseconds(max_time));
+    }
+
+    void OnMessageAcked(QuicMessageId message_id, QuicTime receive_timestamp) override;
+    void OnMessageLost(QuicMessageId message_id) override;
+
+    // the setup of the connection, shared with running signatures
+    const std::shared_ptr<Http3HandshakeTimeline> &timeline() { return timeline_; }
+
+    void ProcessUdpPacket(const QuicSocketAddress &self_address,
+                          const QuicSocketAddress &peer_address,
+                          const QuicReceivedPacket &packet) override;
+    void OnTlsHandshakeComplete() override;
+
 
   protected:
     // QuicSession methods:
@@ -158,6 +181,8 @@ namespace quic
     quiche::QuicheCircularDeque<PromisedStreamInfo> promised_streams_;
 
     Http3ServerBackend *http3_server_backend_; // Not owned.
+
+    std::shared_ptr<Http3HandshakeTimeline> timeline_;
   };
 
 } // namespace quic
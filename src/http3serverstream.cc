@@ -213,7 +213,8 @@ namespace quic
     {
       Http3ServerBackend::WebTransportResponse response =
           http3_server_backend_->ProcessWebTransportRequest(
-              request_headers_, web_transport());
+              request_headers_, web_transport(), spdy_session(),
+              static_cast<Http3ServerSession *>(spdy_session()));
       if (response.response_headers[":status"] == "200")
       {
         WriteHeaders(std::move(response.response_headers), false, nullptr);
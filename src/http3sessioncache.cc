@@ -10,63 +10,134 @@
 
 #include "src/http3sessioncache.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "quiche/quic/core/crypto/quic_crypto_client_config.h"
 
 namespace quic {
 
+bool Http3SessionCache::IsValid(const SSL_SESSION* session, uint64_t now) {
+  uint64_t issued = SSL_SESSION_get_time(session);
+  // a clock that steps back makes the ticket look as if it came from the future
+  return now >= issued && now < issued + SSL_SESSION_get_timeout(session);
+}
+
+void Http3SessionCache::Touch(Entry& entry) {
+  lru_.splice(lru_.begin(), lru_, entry.lru);
+}
+
+void Http3SessionCache::RemoveExpiredTickets(Entry& entry, uint64_t now) {
+  auto& tickets = entry.tickets;
+  for (auto it = tickets.begin(); it != tickets.end();) {
+    if (IsValid(it->session.get(), now)) {
+      ++it;
+      continue;
+    }
+    it = tickets.erase(it);
+    expired_++;
+  }
+}
+
+void Http3SessionCache::Erase(std::map<QuicServerId, Entry>::iterator it) {
+  lru_.erase(it->second.lru);
+  cache_entries_.erase(it);
+  servers_ = cache_entries_.size();
+}
+
+void Http3SessionCache::Shrink() {
+  while (cache_entries_.size() > max_servers_) {
+    Erase(cache_entries_.find(lru_.back()));
+    evictions_++;
+  }
+  for (auto& entry : cache_entries_) {
+    while (entry.second.tickets.size() > tickets_per_server_)
+      entry.second.tickets.pop_front();
+  }
+}
+
+void Http3SessionCache::setLimits(size_t max_servers,
+                                  size_t tickets_per_server) {
+  max_servers_ = std::max<size_t>(max_servers, 1);
+  tickets_per_server_ = std::max<size_t>(tickets_per_server, 1);
+  Shrink();
+}
 
 void Http3SessionCache::Insert(const QuicServerId& server_id,
-                                bssl::UniquePtr<SSL_SESSION> session,
-                                const TransportParameters& params,
-                                const ApplicationState* application_state) {
+                               bssl::UniquePtr<SSL_SESSION> session,
+                               const TransportParameters& params,
+                               const ApplicationState* application_state) {
+  if (session == nullptr)
+    return;
   auto it = cache_entries_.find(server_id);
   if (it == cache_entries_.end()) {
     it = cache_entries_.insert(std::make_pair(server_id, Entry())).first;
+    lru_.push_front(server_id);
+    it->second.lru = lru_.begin();
+    servers_ = cache_entries_.size();
+  } else {
+    Touch(it->second);
   }
-  if (session != nullptr) {
-    it->second.session = std::move(session);
-  }
+  Ticket ticket;
+  ticket.session = std::move(session);
+  ticket.params = std::make_unique<TransportParameters>(params);
   if (application_state != nullptr) {
-    it->second.application_state =
+    ticket.application_state =
         std::make_unique<ApplicationState>(*application_state);
   }
-  it->second.params = std::make_unique<TransportParameters>(params);
+  auto& tickets = it->second.tickets;
+  tickets.push_back(std::move(ticket));
+  if (tickets.size() > tickets_per_server_)
+    tickets.pop_front();
+  if (cache_entries_.size() > max_servers_) {
+    Erase(cache_entries_.find(lru_.back()));
+    evictions_++;
+  }
 }
 
 std::unique_ptr<QuicResumptionState> Http3SessionCache::Lookup(
-    const QuicServerId& server_id, QuicWallTime /*now*/,
+    const QuicServerId& server_id, QuicWallTime now,
     const SSL_CTX* /*ctx*/) {
   auto it = cache_entries_.find(server_id);
   if (it == cache_entries_.end()) {
+    misses_++;
     return nullptr;
   }
-
-  if (!it->second.session) {
-    cache_entries_.erase(it);
+  Entry& entry = it->second;
+  RemoveExpiredTickets(entry, now.ToUNIXSeconds());
+  if (entry.tickets.empty()) {
+    misses_++;
+    if (entry.token.empty())
+      Erase(it);
     return nullptr;
   }
+  Touch(entry);
 
+  // tls 1.3 tickets are for a single use, so the newest one is taken out
+  Ticket ticket = std::move(entry.tickets.back());
+  entry.tickets.pop_back();
   auto state = std::make_unique<QuicResumptionState>();
-  state->tls_session = std::move(it->second.session);
-  if (it->second.application_state != nullptr) {
-    state->application_state =
-        std::make_unique<ApplicationState>(*it->second.application_state);
-  }
-  state->transport_params =
-      std::make_unique<TransportParameters>(*it->second.params);
-  state->token = it->second.token;
+  state->tls_session = std::move(ticket.session);
+  state->application_state = std::move(ticket.application_state);
+  state->transport_params = std::move(ticket.params);
+  state->token = entry.token;
+  hits_++;
   return state;
 }
 
-void Http3SessionCache::ClearEarlyData(const QuicServerId& /*server_id*/) {
-  // The simple session cache only stores 1 SSL ticket per entry, so no need to
-  // do anything here.
+void Http3SessionCache::ClearEarlyData(const QuicServerId& server_id) {
+  // the server refused early data, so no ticket may offer it again
+  auto it = cache_entries_.find(server_id);
+  if (it == cache_entries_.end()) {
+    return;
+  }
+  for (auto& ticket : it->second.tickets) {
+    ticket.session.reset(SSL_SESSION_copy_without_early_data(ticket.session.get()));
+  }
 }
 
 void Http3SessionCache::OnNewTokenReceived(const QuicServerId& server_id,
-                                            absl::string_view token) {
+                                           absl::string_view token) {
   auto it = cache_entries_.find(server_id);
   if (it == cache_entries_.end()) {
     return;
@@ -74,12 +145,22 @@ void Http3SessionCache::OnNewTokenReceived(const QuicServerId& server_id,
   it->second.token = std::string(token);
 }
 
-void Http3SessionCache::RemoveExpiredEntries(QuicWallTime /*now*/) {
-  // The simple session cache does not support removing expired entries.
+void Http3SessionCache::RemoveExpiredEntries(QuicWallTime now) {
+  uint64_t seconds = now.ToUNIXSeconds();
+  for (auto it = cache_entries_.begin(); it != cache_entries_.end();) {
+    auto cur = it++;
+    RemoveExpiredTickets(cur->second, seconds);
+    // like Lookup, a NEW_TOKEN keeps the entry
+    if (cur->second.tickets.empty() && cur->second.token.empty())
+      Erase(cur);
+  }
 }
 
-void Http3SessionCache::Clear() { cache_entries_.clear(); }
+void Http3SessionCache::Clear() {
+  cache_entries_.clear();
+  lru_.clear();
+  servers_ = 0;
+}
 
 
 }  // namespace quic
-
@@ -12,6 +12,10 @@
 #ifndef HTTP3_SESSION_CACHE_H
 #define HTTP3_SESSION_CACHE_H
 
+#include <atomic>
+#include <deque>
+#include <list>
+#include <map>
 #include <memory>
 
 #include "quiche/quic/core/crypto/quic_crypto_client_config.h"
@@ -19,12 +23,15 @@
 
 namespace quic {
 
-// Http3SessionCache provides a simple implementation of SessionCache that
-// stores only one QuicResumptionState per QuicServerId. No limit is placed on
-// the total number of entries in the cache. When Lookup is called, if a cache
-// entry exists for the provided QuicServerId, the entry will be removed from
-// the cached when it is returned.
-// TODO(fayang): Remove Http3SessionCache by using QuicClientSessionCache.
+constexpr size_t kDefaultSessionCacheServers = 1024;
+constexpr size_t kDefaultSessionCacheTickets = 4;
+
+// Http3SessionCache keeps the tls 1.3 tickets of up to max_servers servers,
+// the least recently used server goes first. Each server has up to
+// tickets_per_server tickets, a ticket is used only once, Lookup returns
+// the newest one, that has not expired. One cache serves all clients on a
+// loop, each client gets an Http3SharedSessionCache for it.
+// Loop thread only, except for the counters.
 class Http3SessionCache : public SessionCache {
  public:
   Http3SessionCache() = default;
@@ -43,17 +50,81 @@ class Http3SessionCache : public SessionCache {
   void RemoveExpiredEntries(QuicWallTime now) override;
   void Clear() override;
 
+  void setLimits(size_t max_servers, size_t tickets_per_server);
+
+  // js thread
+  size_t servers() const { return servers_.load(); }
+  uint64_t hits() const { return hits_.load(); }
+  uint64_t misses() const { return misses_.load(); }
+  uint64_t expired() const { return expired_.load(); }
+  uint64_t evictions() const { return evictions_.load(); }
+
  private:
-  struct Entry {
+  struct Ticket {
     bssl::UniquePtr<SSL_SESSION> session;
     std::unique_ptr<TransportParameters> params;
     std::unique_ptr<ApplicationState> application_state;
+  };
+  struct Entry {
+    std::deque<Ticket> tickets;  // oldest first
     std::string token;
+    std::list<QuicServerId>::iterator lru;
   };
+
+  static bool IsValid(const SSL_SESSION* session, uint64_t now);
+  void Touch(Entry& entry);
+  void RemoveExpiredTickets(Entry& entry, uint64_t now);
+  void Erase(std::map<QuicServerId, Entry>::iterator it);
+  void Shrink();
+
   std::map<QuicServerId, Entry> cache_entries_;
+  std::list<QuicServerId> lru_;  // most recently used first
+  size_t max_servers_ = kDefaultSessionCacheServers;
+  size_t tickets_per_server_ = kDefaultSessionCacheTickets;
+
+  std::atomic<size_t> servers_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> expired_{0};    // tickets dropped after their lifetime
+  std::atomic<uint64_t> evictions_{0};  // servers dropped for the limit
+};
+
+// a client's handle to the cache of its loop, the crypto config owns its
+// session cache, but the tickets should be shared by all clients
+class Http3SharedSessionCache : public SessionCache {
+ public:
+  explicit Http3SharedSessionCache(std::shared_ptr<Http3SessionCache> cache)
+      : cache_(std::move(cache)) {}
+
+  void Insert(const QuicServerId& server_id,
+              bssl::UniquePtr<SSL_SESSION> session,
+              const TransportParameters& params,
+              const ApplicationState* application_state) override {
+    cache_->Insert(server_id, std::move(session), params, application_state);
+  }
+  std::unique_ptr<QuicResumptionState> Lookup(const QuicServerId& server_id,
+                                              QuicWallTime now,
+                                              const SSL_CTX* ctx) override {
+    return cache_->Lookup(server_id, now, ctx);
+  }
+  void ClearEarlyData(const QuicServerId& server_id) override {
+    cache_->ClearEarlyData(server_id);
+  }
+  void OnNewTokenReceived(const QuicServerId& server_id,
+                          absl::string_view token) override {
+    cache_->OnNewTokenReceived(server_id, token);
+  }
+  void RemoveExpiredEntries(QuicWallTime now) override {
+    cache_->RemoveExpiredEntries(now);
+  }
+  // one client must not wipe the tickets of the others
+  void Clear() override {}
+
+ private:
+  std::shared_ptr<Http3SessionCache> cache_;
 };
 
 
 }  // namespace quic
 
-#endif  // QUICHE_QUIC_TEST_TOOLS_SIMPLE_SESSION_CACHE_H_
\ No newline at end of file
+#endif  // HTTP3_SESSION_CACHE_H
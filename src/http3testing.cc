@@ -0,0 +1,572 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3testing.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "openssl/ssl.h"
+#include "quiche/quic/core/quic_server_id.h"
+#include "src/http3admission.h"
+#include "src/http3antireplay.h"
+#include "src/http3datagramhooks.h"
+#include "src/http3fec.h"
+#include "src/http3fragment.h"
+#include "src/http3proofsource.h"
+#include "src/http3ratelimit.h"
+#include "src/http3sessioncache.h"
+#include "src/http3ticketcrypter.h"
+
+namespace quic
+{
+
+    namespace
+    {
+        // a clock, that the steps set
+        class Http3TestTicketCrypter : public Http3TicketCrypter
+        {
+        public:
+            using Http3TicketCrypter::Http3TicketCrypter;
+
+            int64_t now_s = 0;
+
+        protected:
+            int64_t nowS() override { return now_s; }
+        };
+
+        // our crypter answers right away
+        class Http3TestDecryptCallback : public ProofSource::DecryptCallback
+        {
+        public:
+            explicit Http3TestDecryptCallback(std::vector<uint8_t> *plain) : plain_(plain) {}
+
+            void Run(std::vector<uint8_t> plaintext) override { *plain_ = std::move(plaintext); }
+
+        protected:
+            std::vector<uint8_t> *plain_;
+        };
+
+        // quiche's datagram queue and message ids, as the hooks see them,
+        // and the only source; a fixed age stands in for quiche's default
+        class Http3TestDatagramHooks : public Http3DatagramHooks, public Http3DatagramSource
+        {
+        public:
+            Http3TestDatagramHooks() { keepDatagramQueue(); }
+
+            // like SendOrQueueDatagram, returns the message id or 0 for queued
+            uint64_t send(uint64_t tag, int64_t now, bool blocked)
+            {
+                uint64_t id = 0;
+                if (queue_.empty() && !blocked)
+                    id = ++message_id_;
+                else
+                    queue_.push_back(now);
+                noteDatagramHandedOver(this, tag, now, id > 0);
+                return id;
+            }
+
+            // the connection can write, quiche drops, what is too old, and sends the rest
+            size_t canWrite(int64_t now)
+            {
+                while (!queue_.empty() && max_age_ >= 0 && now - queue_.front() > max_age_)
+                {
+                    queue_.pop_front();
+                    expired_++;
+                }
+                size_t sent = queue_.size();
+                message_id_ += sent;
+                queue_.clear();
+                notifyDatagramSources();
+                return sent;
+            }
+
+            // the tag reported for the message id, 0 for none
+            uint64_t ack(uint64_t id, bool lost)
+            {
+                reported_ = 0;
+                if (lost)
+                    onMessageLost(id);
+                else
+                    onMessageAcked(id);
+                return reported_;
+            }
+
+            uint64_t expired() { return expired_; }
+
+            size_t QueuedDatagrams() override { return queue_.size(); }
+            void SetDatagramQueueMaxAge(int64_t max_time) override { max_age_ = max_time; }
+
+            void OnDatagramsCanWrite() override {}
+            void OnDatagramAcked(uint64_t tag, int64_t sendtime) override { reported_ = tag; }
+            void OnDatagramLost(uint64_t tag, int64_t sendtime) override { reported_ = tag; }
+
+        protected:
+            std::deque<int64_t> queue_; // the time, each one was queued
+            int64_t max_age_ = 1000;
+            uint64_t expired_ = 0;
+            uint64_t message_id_ = 0;
+            uint64_t reported_ = 0;
+        };
+
+        v8::Local<v8::Value> prop(v8::Local<v8::Object> obj, const char *name)
+        {
+            return Nan::Get(obj, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+        }
+
+        // buffers as they are, anything else as utf8
+        std::string bytesOf(v8::Local<v8::Value> value)
+        {
+            if (value->IsArrayBufferView())
+                return std::string(node::Buffer::Data(value), node::Buffer::Length(value));
+            Nan::Utf8String str(value);
+            return std::string(*str, str.length());
+        }
+
+        std::string bytesProp(v8::Local<v8::Object> obj, const char *name) { return bytesOf(prop(obj, name)); }
+
+        double numberProp(v8::Local<v8::Object> obj, const char *name, double def)
+        {
+            v8::Local<v8::Value> value = prop(obj, name);
+            if (value->IsUndefined())
+                return def;
+            return Nan::To<double>(value).FromMaybe(def);
+        }
+
+        void setNumber(v8::Local<v8::Object> obj, const char *name, double value)
+        {
+            Nan::Set(obj, Nan::New(name).ToLocalChecked(), Nan::New<v8::Number>(value));
+        }
+
+        v8::Local<v8::Object> bufferOf(absl::string_view data)
+        {
+            return Nan::CopyBuffer(data.data(), data.size()).ToLocalChecked();
+        }
+
+        v8::Local<v8::Array> buffersOf(const std::vector<std::string> &list)
+        {
+            v8::Local<v8::Array> array = Nan::New<v8::Array>(list.size());
+            for (size_t i = 0; i < list.size(); i++)
+                Nan::Set(array, static_cast<uint32_t>(i), bufferOf(list[i]));
+            return array;
+        }
+
+        // an array argument, false after throwing
+        bool arrayArg(const Nan::FunctionCallbackInfo<v8::Value> &info, int i, std::vector<v8::Local<v8::Value>> &out)
+        {
+            if (!info[i]->IsArray())
+            {
+                Nan::ThrowTypeError("array expected");
+                return false;
+            }
+            v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(info[i]);
+            for (uint32_t j = 0; j < array->Length(); j++)
+                out.push_back(Nan::Get(array, j).ToLocalChecked());
+            return true;
+        }
+
+        bool stepsArg(const Nan::FunctionCallbackInfo<v8::Value> &info, int i, std::vector<v8::Local<v8::Object>> &out)
+        {
+            std::vector<v8::Local<v8::Value>> values;
+            if (!arrayArg(info, i, values))
+                return false;
+            for (auto &value : values)
+            {
+                if (!value->IsObject())
+                {
+                    Nan::ThrowTypeError("steps must be objects");
+                    return false;
+                }
+                out.push_back(Nan::To<v8::Object>(value).ToLocalChecked());
+            }
+            return true;
+        }
+
+        QuicIpAddress peerProp(v8::Local<v8::Object> obj)
+        {
+            QuicIpAddress peer;
+            peer.FromString(bytesProp(obj, "peer"));
+            return peer;
+        }
+
+        QuicConnectionId connectionIdProp(v8::Local<v8::Object> obj, const char *name)
+        {
+            std::string id = bytesProp(obj, name);
+            if (id.size() > kQuicMaxConnectionIdWithLengthPrefixLength)
+                id.resize(kQuicMaxConnectionIdWithLengthPrefixLength);
+            return QuicConnectionId(id.data(), static_cast<uint8_t>(id.size()));
+        }
+    }
+
+    void Http3Testing::Init(v8::Local<v8::Object> target)
+    {
+        Nan::SetMethod(target, "fecEncode", fecEncode);
+        Nan::SetMethod(target, "fecDecode", fecDecode);
+        Nan::SetMethod(target, "fragmentSplit", fragmentSplit);
+        Nan::SetMethod(target, "fragmentReassemble", fragmentReassemble);
+        Nan::SetMethod(target, "ticketCrypter", ticketCrypter);
+        Nan::SetMethod(target, "replayFilter", replayFilter);
+        Nan::SetMethod(target, "sessionCache", sessionCache);
+        Nan::SetMethod(target, "retryTokens", retryTokens);
+        Nan::SetMethod(target, "sourceLimiter", sourceLimiter);
+        Nan::SetMethod(target, "matchServerName", matchServerName);
+        Nan::SetMethod(target, "datagramIds", datagramIds);
+    }
+
+    NAN_METHOD(Http3Testing::fecEncode)
+    {
+        size_t sources = static_cast<size_t>(Nan::To<uint32_t>(info[0]).FromMaybe(0));
+        size_t repairs = static_cast<size_t>(Nan::To<uint32_t>(info[1]).FromMaybe(0));
+        if (sources == 0 || sources > kFecMaxSources || repairs == 0 || repairs > kFecMaxRepairs)
+            return Nan::ThrowRangeError("unsupported sources or repairs");
+        std::vector<v8::Local<v8::Value>> payloads;
+        if (!arrayArg(info, 2, payloads))
+            return;
+        Http3FecEncoder encoder(sources, repairs);
+        std::vector<std::string> out;
+        for (auto &payload : payloads)
+        {
+            out.push_back(encoder.addSource(bytesOf(payload)));
+            if (encoder.groupFull())
+                encoder.finishGroup(out);
+        }
+        if (encoder.groupOpen())
+            encoder.finishGroup(out);
+        info.GetReturnValue().Set(buffersOf(out));
+    }
+
+    NAN_METHOD(Http3Testing::fecDecode)
+    {
+        std::vector<v8::Local<v8::Value>> datagrams;
+        if (!arrayArg(info, 0, datagrams))
+            return;
+        Http3FecDecoder decoder;
+        std::vector<std::string> delivered;
+        std::vector<std::string> recovered;
+        for (auto &datagram : datagrams)
+        {
+            std::string data = bytesOf(datagram);
+            absl::string_view payload;
+            if (decoder.receive(data, payload, recovered))
+                delivered.push_back(std::string(payload));
+        }
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("delivered").ToLocalChecked(), buffersOf(delivered));
+        Nan::Set(retObj, Nan::New("recovered").ToLocalChecked(), buffersOf(recovered));
+        setNumber(retObj, "repairs", decoder.repairsReceived());
+        setNumber(retObj, "recoveredCount", decoder.recovered());
+        setNumber(retObj, "lost", decoder.lost());
+        setNumber(retObj, "malformed", decoder.malformed());
+        info.GetReturnValue().Set(retObj);
+    }
+
+    NAN_METHOD(Http3Testing::fragmentSplit)
+    {
+        std::vector<v8::Local<v8::Value>> messages;
+        if (!arrayArg(info, 0, messages))
+            return;
+        size_t max_datagram = static_cast<size_t>(Nan::To<uint32_t>(info[1]).FromMaybe(0));
+        Http3DatagramFragmenter fragmenter;
+        if (!info[2]->IsUndefined())
+            fragmenter.max_message_size = static_cast<size_t>(Nan::To<uint32_t>(info[2]).FromMaybe(0));
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(messages.size());
+        for (size_t i = 0; i < messages.size(); i++)
+        {
+            std::vector<std::string> out;
+            if (fragmenter.split(bytesOf(messages[i]), max_datagram, out))
+                Nan::Set(results, static_cast<uint32_t>(i), buffersOf(out));
+            else
+                Nan::Set(results, static_cast<uint32_t>(i), Nan::Null());
+        }
+        info.GetReturnValue().Set(results);
+    }
+
+    NAN_METHOD(Http3Testing::fragmentReassemble)
+    {
+        std::vector<v8::Local<v8::Object>> steps;
+        if (!stepsArg(info, 0, steps))
+            return;
+        Http3DatagramReassembler reassembler;
+        if (info[1]->IsObject())
+        {
+            v8::Local<v8::Object> options = Nan::To<v8::Object>(info[1]).ToLocalChecked();
+            reassembler.max_message_size =
+                static_cast<size_t>(numberProp(options, "maxMessageSize", reassembler.max_message_size));
+            reassembler.timeout_us = static_cast<int64_t>(numberProp(options, "timeoutUs", reassembler.timeout_us));
+            reassembler.max_bytes = static_cast<size_t>(numberProp(options, "maxBytes", reassembler.max_bytes));
+        }
+        std::vector<std::string> messages;
+        for (auto &step : steps)
+        {
+            std::string datagram = bytesProp(step, "datagram");
+            absl::string_view view;
+            std::string message;
+            if (reassembler.receive(datagram, static_cast<int64_t>(numberProp(step, "now", 0)), view, message))
+                messages.push_back(std::string(view));
+        }
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("messages").ToLocalChecked(), buffersOf(messages));
+        setNumber(retObj, "reassembled", reassembler.reassembled());
+        setNumber(retObj, "dropped", reassembler.dropped());
+        setNumber(retObj, "malformed", reassembler.malformed());
+        info.GetReturnValue().Set(retObj);
+    }
+
+    NAN_METHOD(Http3Testing::ticketCrypter)
+    {
+        std::vector<v8::Local<v8::Value>> secretValues;
+        if (!arrayArg(info, 0, secretValues))
+            return;
+        std::vector<std::string> secrets;
+        for (auto &secret : secretValues)
+            secrets.push_back(bytesOf(secret));
+        int64_t window = static_cast<int64_t>(Nan::To<double>(info[1]).FromMaybe(0));
+        std::vector<v8::Local<v8::Object>> steps;
+        if (!stepsArg(info, 2, steps))
+            return;
+
+        Http3TestTicketCrypter crypter(secrets);
+        if (window > 0)
+            crypter.setAntiReplay(window);
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            v8::Local<v8::Object> step = steps[i];
+            std::string op = bytesProp(step, "op");
+            crypter.now_s = static_cast<int64_t>(numberProp(step, "now", 0));
+            if (op == "keys")
+            {
+                v8::Local<v8::Value> keys = prop(step, "secrets");
+                std::vector<std::string> newSecrets;
+                if (keys->IsArray())
+                {
+                    v8::Local<v8::Array> array = v8::Local<v8::Array>::Cast(keys);
+                    for (uint32_t j = 0; j < array->Length(); j++)
+                        newSecrets.push_back(bytesOf(Nan::Get(array, j).ToLocalChecked()));
+                }
+                crypter.setKeys(newSecrets);
+                Nan::Set(results, static_cast<uint32_t>(i), Nan::Null());
+                continue;
+            }
+            std::vector<uint8_t> out;
+            if (op == "seal")
+                out = crypter.Encrypt(bytesProp(step, "session"), absl::string_view());
+            else if (op == "open")
+            {
+                // ticketOf: the ticket sealed by an earlier step of the same crypter
+                std::string ticket = bytesProp(step, "ticket");
+                v8::Local<v8::Value> of = prop(step, "ticketOf");
+                if (!of->IsUndefined())
+                    ticket = bytesOf(Nan::Get(results, Nan::To<uint32_t>(of).FromMaybe(0)).ToLocalChecked());
+                crypter.Decrypt(ticket, std::make_unique<Http3TestDecryptCallback>(&out));
+            }
+            else
+                return Nan::ThrowTypeError("unknown step");
+            if (out.empty())
+                Nan::Set(results, static_cast<uint32_t>(i), Nan::Null());
+            else
+                Nan::Set(results, static_cast<uint32_t>(i),
+                         bufferOf(absl::string_view(reinterpret_cast<const char *>(out.data()), out.size())));
+        }
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("results").ToLocalChecked(), results);
+        setNumber(retObj, "issued", crypter.issued());
+        setNumber(retObj, "hits", crypter.hits());
+        setNumber(retObj, "misses", crypter.misses());
+        setNumber(retObj, "replays", crypter.replays());
+        setNumber(retObj, "expired", crypter.expired());
+        setNumber(retObj, "foreign", crypter.foreign());
+        info.GetReturnValue().Set(retObj);
+    }
+
+    NAN_METHOD(Http3Testing::replayFilter)
+    {
+        int64_t window = static_cast<int64_t>(Nan::To<double>(info[0]).FromMaybe(kDefaultEarlyDataWindowS));
+        std::vector<v8::Local<v8::Object>> steps;
+        if (!stepsArg(info, 1, steps))
+            return;
+        Http3ReplayFilter filter(window);
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            bool seen = filter.checkAndInsert(bytesProp(steps[i], "ticket"),
+                                              static_cast<int64_t>(numberProp(steps[i], "now", 0)));
+            Nan::Set(results, static_cast<uint32_t>(i), Nan::New<v8::Boolean>(seen));
+        }
+        info.GetReturnValue().Set(results);
+    }
+
+    NAN_METHOD(Http3Testing::sessionCache)
+    {
+        size_t max_servers = static_cast<size_t>(Nan::To<uint32_t>(info[0]).FromMaybe(kDefaultSessionCacheServers));
+        size_t tickets = static_cast<size_t>(Nan::To<uint32_t>(info[1]).FromMaybe(kDefaultSessionCacheTickets));
+        std::vector<v8::Local<v8::Object>> steps;
+        if (!stepsArg(info, 2, steps))
+            return;
+        bssl::UniquePtr<SSL_CTX> ctx(SSL_CTX_new(TLS_method()));
+        Http3SessionCache cache;
+        cache.setLimits(max_servers, tickets);
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            v8::Local<v8::Object> step = steps[i];
+            std::string op = bytesProp(step, "op");
+            QuicServerId server_id(bytesProp(step, "host"), static_cast<uint16_t>(numberProp(step, "port", 443)));
+            uint64_t now = static_cast<uint64_t>(numberProp(step, "now", 0));
+            Nan::Set(results, static_cast<uint32_t>(i), Nan::Null());
+            if (op == "insert")
+            {
+                bssl::UniquePtr<SSL_SESSION> session(SSL_SESSION_new(ctx.get()));
+                SSL_SESSION_set_time(session.get(), static_cast<uint64_t>(numberProp(step, "time", 0)));
+                SSL_SESSION_set_timeout(session.get(), static_cast<uint32_t>(numberProp(step, "timeout", 7200)));
+                cache.Insert(server_id, std::move(session), TransportParameters(), nullptr);
+            }
+            else if (op == "lookup")
+            {
+                std::unique_ptr<QuicResumptionState> state =
+                    cache.Lookup(server_id, QuicWallTime::FromUNIXSeconds(now), ctx.get());
+                if (state)
+                    Nan::Set(results, static_cast<uint32_t>(i),
+                             Nan::New<v8::Number>(static_cast<double>(SSL_SESSION_get_time(state->tls_session.get()))));
+            }
+            else if (op == "token")
+                cache.OnNewTokenReceived(server_id, "token");
+            else if (op == "expire")
+                cache.RemoveExpiredEntries(QuicWallTime::FromUNIXSeconds(now));
+            else
+                return Nan::ThrowTypeError("unknown step");
+        }
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("results").ToLocalChecked(), results);
+        setNumber(retObj, "servers", cache.servers());
+        setNumber(retObj, "hits", cache.hits());
+        setNumber(retObj, "misses", cache.misses());
+        setNumber(retObj, "expired", cache.expired());
+        setNumber(retObj, "evictions", cache.evictions());
+        info.GetReturnValue().Set(retObj);
+    }
+
+    NAN_METHOD(Http3Testing::retryTokens)
+    {
+        std::vector<v8::Local<v8::Object>> steps;
+        if (!stepsArg(info, 0, steps))
+            return;
+        Http3ChloAdmission admission(-1);
+        std::vector<std::string> tokens(steps.size());
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            v8::Local<v8::Object> step = steps[i];
+            std::string op = bytesProp(step, "op");
+            int64_t now = static_cast<int64_t>(numberProp(step, "now", 0));
+            if (op == "make")
+            {
+                tokens[i] = admission.makeToken(peerProp(step), connectionIdProp(step, "originalId"),
+                                                connectionIdProp(step, "retryId"), now);
+                Nan::Set(results, static_cast<uint32_t>(i), bufferOf(tokens[i]));
+            }
+            else if (op == "check")
+            {
+                // the token of an earlier make step, optionally broken, or one passed in
+                std::string token;
+                size_t from = static_cast<size_t>(numberProp(step, "tokenOf", steps.size()));
+                if (from < i)
+                    token = tokens[from];
+                else
+                    token = bytesProp(step, "token");
+                size_t flip = static_cast<size_t>(numberProp(step, "flip", token.size()));
+                if (flip < token.size())
+                    token[flip] ^= 1;
+                token.resize(std::min(token.size(), static_cast<size_t>(numberProp(step, "length", token.size()))));
+                QuicConnectionId original_id;
+                if (admission.checkToken(token, peerProp(step), connectionIdProp(step, "retryId"), now, &original_id))
+                    Nan::Set(results, static_cast<uint32_t>(i), bufferOf(absl::string_view(original_id.data(), original_id.length())));
+                else
+                    Nan::Set(results, static_cast<uint32_t>(i), Nan::Null());
+            }
+            else
+                return Nan::ThrowTypeError("unknown step");
+        }
+        info.GetReturnValue().Set(results);
+    }
+
+    NAN_METHOD(Http3Testing::sourceLimiter)
+    {
+        double rate = Nan::To<double>(info[0]).FromMaybe(kDefaultHandshakeRate);
+        double burst = Nan::To<double>(info[1]).FromMaybe(kDefaultHandshakeBurst);
+        size_t max_sources = static_cast<size_t>(Nan::To<uint32_t>(info[2]).FromMaybe(kDefaultRateLimitSources));
+        std::vector<v8::Local<v8::Object>> steps;
+        if (!stepsArg(info, 3, steps))
+            return;
+        Http3SourceLimiter limiter(rate, burst, max_sources);
+        v8::Local<v8::Array> allowed = Nan::New<v8::Array>(steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            bool allow = limiter.allow(peerProp(steps[i]), static_cast<int64_t>(numberProp(steps[i], "now", 0)));
+            Nan::Set(allowed, static_cast<uint32_t>(i), Nan::New<v8::Boolean>(allow));
+        }
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("allowed").ToLocalChecked(), allowed);
+        setNumber(retObj, "sources", limiter.sources());
+        setNumber(retObj, "throttled", limiter.throttled());
+        setNumber(retObj, "throttledSources", limiter.throttledSources());
+        setNumber(retObj, "evictions", limiter.evictions());
+        info.GetReturnValue().Set(retObj);
+    }
+
+    NAN_METHOD(Http3Testing::matchServerName)
+    {
+        std::vector<v8::Local<v8::Value>> names;
+        if (!arrayArg(info, 0, names))
+            return;
+        // stored like setCertificate does, the certificates themselves do not matter
+        std::map<std::string, Http3ProofSource::Certificate> certificates;
+        for (auto &name : names)
+            certificates[absl::AsciiStrToLower(bytesOf(name))] = Http3ProofSource::Certificate();
+        auto it = Http3ProofSource::matchServerName(certificates, bytesOf(info[1]));
+        if (it == certificates.end())
+            info.GetReturnValue().Set(Nan::Null());
+        else
+            info.GetReturnValue().Set(Nan::New(it->first).ToLocalChecked());
+    }
+
+    NAN_METHOD(Http3Testing::datagramIds)
+    {
+        std::vector<v8::Local<v8::Object>> steps;
+        if (!stepsArg(info, 0, steps))
+            return;
+        Http3TestDatagramHooks hooks;
+        v8::Local<v8::Array> results = Nan::New<v8::Array>(steps.size());
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            std::string op = bytesProp(steps[i], "op");
+            int64_t now = static_cast<int64_t>(numberProp(steps[i], "now", 0));
+            uint64_t value = 0;
+            if (op == "send")
+            {
+                bool blocked = Nan::To<bool>(prop(steps[i], "blocked")).FromMaybe(false);
+                value = hooks.send(static_cast<uint64_t>(numberProp(steps[i], "tag", 0)), now, blocked);
+            }
+            else if (op == "write")
+                value = hooks.canWrite(now);
+            else if (op == "ack" || op == "lost")
+                value = hooks.ack(static_cast<uint64_t>(numberProp(steps[i], "id", 0)), op == "lost");
+            else
+                return Nan::ThrowTypeError("unknown op");
+            if (value > 0)
+                Nan::Set(results, static_cast<uint32_t>(i), Nan::New<v8::Number>(static_cast<double>(value)));
+            else
+                Nan::Set(results, static_cast<uint32_t>(i), Nan::Null());
+        }
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("results").ToLocalChecked(), results);
+        setNumber(retObj, "expired", static_cast<double>(hooks.expired()));
+        info.GetReturnValue().Set(retObj);
+    }
+
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_TESTING_H_
+#define HTTP3_TESTING_H_
+
+#include <nan.h>
+
+namespace quic
+{
+    // the building blocks without a connection, for the test suite only
+    // each call works on fresh objects, stateful ones take a list of steps
+    // and return the result of each step, times are passed in, so that
+    // expiry can be tested without waiting
+    class Http3Testing
+    {
+    public:
+        static void Init(v8::Local<v8::Object> target);
+
+        // fecEncode(sources, repairs, payloads) returns the datagrams,
+        // a partial group at the end gets its repairs
+        static NAN_METHOD(fecEncode);
+        // fecDecode(datagrams) returns { delivered, recovered, repairs, recoveredCount, lost, malformed }
+        static NAN_METHOD(fecDecode);
+
+        // fragmentSplit(messages, maxDatagram, maxMessageSize) returns the datagrams
+        // of each message or null, one fragmenter numbers them all
+        static NAN_METHOD(fragmentSplit);
+        // fragmentReassemble([{ datagram, now }], { maxMessageSize, timeoutUs, maxBytes })
+        // returns { messages, reassembled, dropped, malformed }
+        static NAN_METHOD(fragmentReassemble);
+
+        // ticketCrypter(secrets, window, steps), steps are { op: 'seal', session, now },
+        // { op: 'open', ticket or ticketOf, now } and { op: 'keys', secrets }, ticketOf is
+        // the index of a seal step, window 0 is no anti replay
+        // returns { results, issued, hits, misses, replays, expired, foreign }
+        static NAN_METHOD(ticketCrypter);
+
+        // replayFilter(window, [{ ticket, now }]) returns, whether each ticket was seen before
+        static NAN_METHOD(replayFilter);
+
+        // sessionCache(maxServers, ticketsPerServer, steps), steps are
+        // { op: 'insert', host, port, time, timeout }, { op: 'lookup', host, port, now },
+        // a lookup results in the time of the ticket or null, { op: 'token', host, port }
+        // for a NEW_TOKEN and { op: 'expire', now }
+        // returns { results, servers, hits, misses, expired, evictions }
+        static NAN_METHOD(sessionCache);
+
+        // retryTokens(steps), steps are { op: 'make', peer, originalId, retryId, now }
+        // and { op: 'check', token or tokenOf, peer, retryId, now }, tokenOf is the
+        // index of a make step, flip (a byte index) and length break the token,
+        // a check results in the original id or null, all on one admission, times in us
+        static NAN_METHOD(retryTokens);
+
+        // sourceLimiter(rate, burst, maxSources, [{ peer, now }])
+        // returns { allowed, sources, throttled, throttledSources, evictions }
+        static NAN_METHOD(sourceLimiter);
+
+        // matchServerName(names, hostname) returns the name, that covers hostname, or null
+        static NAN_METHOD(matchServerName);
+
+        // datagramIds(steps), steps are { op: 'send', tag, blocked, now }, resulting
+        // in quiche's message id or null for queued, { op: 'write', now }, resulting
+        // in the number sent from quiche's queue or null, and { op: 'ack' or 'lost', id },
+        // resulting in the tag reported or null; returns { results, expired }
+        static NAN_METHOD(datagramIds);
+    };
+}
+
+#endif
@@ -0,0 +1,184 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3ticketcrypter.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "openssl/aead.h"
+#include "openssl/rand.h"
+#include "openssl/sha.h"
+
+namespace quic
+{
+
+    namespace
+    {
+        constexpr size_t kTicketKeyIdSize = 4;
+        constexpr size_t kTicketNonceSize = 12;
+        constexpr size_t kTicketTagSize = 16;
+        constexpr size_t kTicketIssuedSize = 8;
+        constexpr size_t kTicketIssuerSize = 8;
+        constexpr size_t kTicketPrefixSize = kTicketIssuedSize + kTicketIssuerSize; // in the plaintext
+        constexpr size_t kTicketOverhead = kTicketKeyIdSize + kTicketNonceSize + kTicketPrefixSize + kTicketTagSize;
+        const char kTicketKeyLabel[] = "webtransport ticket key";
+        constexpr int64_t kTicketClockSkewS = 60; // between the processes sharing the keys
+    }
+
+    Http3TicketCrypter::Http3TicketCrypter(const std::vector<std::string> &secrets)
+    {
+        RAND_bytes(reinterpret_cast<uint8_t *>(&issuer_), sizeof(issuer_));
+        setKeys(secrets);
+    }
+
+    Http3TicketCrypter::Key Http3TicketCrypter::deriveKey(const std::string &secret)
+    {
+        Key key;
+        SHA256_CTX ctx;
+        SHA256_Init(&ctx);
+        SHA256_Update(&ctx, kTicketKeyLabel, sizeof(kTicketKeyLabel));
+        SHA256_Update(&ctx, secret.data(), secret.size());
+        SHA256_Final(key.key, &ctx);
+        // the id is public, so it is a hash of the key and not a part of it
+        uint8_t digest[SHA256_DIGEST_LENGTH];
+        SHA256(key.key, sizeof(key.key), digest);
+        memcpy(key.id, digest, sizeof(key.id));
+        return key;
+    }
+
+    int64_t Http3TicketCrypter::nowS()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void Http3TicketCrypter::setKeys(const std::vector<std::string> &secrets)
+    {
+        keys_.clear();
+        for (auto &secret : secrets)
+            keys_.push_back(deriveKey(secret));
+    }
+
+    std::vector<uint8_t> Http3TicketCrypter::withoutEarlyData(const std::vector<uint8_t> &session)
+    {
+        if (!ssl_ctx_)
+            return std::vector<uint8_t>();
+        bssl::UniquePtr<SSL_SESSION> parsed(SSL_SESSION_from_bytes(session.data(), session.size(), ssl_ctx_));
+        if (!parsed)
+            return std::vector<uint8_t>();
+        bssl::UniquePtr<SSL_SESSION> stripped(SSL_SESSION_copy_without_early_data(parsed.get()));
+        uint8_t *out = nullptr;
+        size_t len = 0;
+        if (!stripped || !SSL_SESSION_to_bytes_for_ticket(stripped.get(), &out, &len))
+            return std::vector<uint8_t>();
+        std::vector<uint8_t> result(out, out + len);
+        OPENSSL_free(out);
+        return result;
+    }
+
+    size_t Http3TicketCrypter::MaxOverhead() { return kTicketOverhead; }
+
+    std::vector<uint8_t> Http3TicketCrypter::Encrypt(absl::string_view in, absl::string_view encryption_key)
+    {
+        if (keys_.empty())
+            return std::vector<uint8_t>();
+        const Key &key = keys_.front();
+        bssl::ScopedEVP_AEAD_CTX ctx;
+        if (!EVP_AEAD_CTX_init(ctx.get(), EVP_aead_aes_256_gcm(), key.key, sizeof(key.key), kTicketTagSize, nullptr))
+            return std::vector<uint8_t>();
+
+        std::vector<uint8_t> plain(kTicketPrefixSize + in.size());
+        uint64_t issued = static_cast<uint64_t>(nowS());
+        for (size_t i = 0; i < kTicketIssuedSize; i++)
+            plain[i] = static_cast<uint8_t>(issued >> (8 * (kTicketIssuedSize - 1 - i)));
+        memcpy(plain.data() + kTicketIssuedSize, &issuer_, kTicketIssuerSize);
+        memcpy(plain.data() + kTicketPrefixSize, in.data(), in.size());
+
+        std::vector<uint8_t> out(kTicketOverhead + in.size());
+        memcpy(out.data(), key.id, kTicketKeyIdSize);
+        uint8_t *nonce = out.data() + kTicketKeyIdSize;
+        RAND_bytes(nonce, kTicketNonceSize);
+        size_t len = 0;
+        // the key id is authenticated, but not encrypted
+        if (!EVP_AEAD_CTX_seal(ctx.get(), nonce + kTicketNonceSize, &len, out.size() - kTicketKeyIdSize - kTicketNonceSize,
+                               nonce, kTicketNonceSize, plain.data(), plain.size(), out.data(), kTicketKeyIdSize))
+            return std::vector<uint8_t>();
+        out.resize(kTicketKeyIdSize + kTicketNonceSize + len);
+        issued_++;
+        return out;
+    }
+
+    void Http3TicketCrypter::Decrypt(absl::string_view in, std::unique_ptr<ProofSource::DecryptCallback> callback)
+    {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(in.data());
+        const Key *key = nullptr;
+        if (in.size() >= kTicketOverhead)
+        {
+            for (auto &cur : keys_)
+            {
+                if (memcmp(cur.id, data, kTicketKeyIdSize) == 0)
+                {
+                    key = &cur;
+                    break;
+                }
+            }
+        }
+        std::vector<uint8_t> plain;
+        bssl::ScopedEVP_AEAD_CTX ctx;
+        if (key && EVP_AEAD_CTX_init(ctx.get(), EVP_aead_aes_256_gcm(), key->key, sizeof(key->key), kTicketTagSize,
+                                     nullptr))
+        {
+            const uint8_t *nonce = data + kTicketKeyIdSize;
+            size_t cipherlen = in.size() - kTicketKeyIdSize - kTicketNonceSize;
+            plain.resize(cipherlen);
+            size_t len = 0;
+            if (EVP_AEAD_CTX_open(ctx.get(), plain.data(), &len, plain.size(), nonce, kTicketNonceSize,
+                                  nonce + kTicketNonceSize, cipherlen, data, kTicketKeyIdSize) &&
+                len > kTicketPrefixSize)
+                plain.resize(len);
+            else
+                plain.clear();
+        }
+        // an empty result makes tls fall back to a full handshake
+        if (plain.empty())
+        {
+            misses_++;
+            callback->Run(std::move(plain));
+            return;
+        }
+        uint64_t issued = 0;
+        for (size_t i = 0; i < kTicketIssuedSize; i++)
+            issued = (issued << 8) | plain[i];
+        uint64_t issuer = 0;
+        memcpy(&issuer, plain.data() + kTicketIssuedSize, kTicketIssuerSize);
+        plain.erase(plain.begin(), plain.begin() + kTicketPrefixSize);
+        if (replay_filter_)
+        {
+            int64_t now = nowS();
+            int64_t age = now - static_cast<int64_t>(issued);
+            // 1-rtt resumption is safe to replay, only the early data is not
+            if (issuer != issuer_)
+            {
+                // the shared keys open it, but our filter never saw its other uses
+                foreign_++;
+                plain = withoutEarlyData(plain);
+            }
+            else if (age > replay_filter_->window() || age < -kTicketClockSkewS)
+            {
+                expired_++;
+                plain = withoutEarlyData(plain);
+            }
+            else if (replay_filter_->checkAndInsert(in, now))
+            {
+                replays_++;
+                plain = withoutEarlyData(plain);
+            }
+        }
+        if (!plain.empty())
+            hits_++;
+        callback->Run(std::move(plain));
+    }
+
+}
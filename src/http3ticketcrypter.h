@@ -0,0 +1,83 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_TICKET_CRYPTER_H_
+#define HTTP3_TICKET_CRYPTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "openssl/ssl.h"
+#include "quiche/quic/core/crypto/proof_source.h"
+#include "src/http3antireplay.h"
+
+namespace quic
+{
+    // encrypts tls session tickets with aes-256-gcm under a key set, that
+    // js can rotate: the first key encrypts, all of them decrypt, so every
+    // process with the same keys resumes the sessions of the others
+    // ticket: key id (4 bytes), nonce (12 bytes), ciphertext and tag (16 bytes),
+    // the plaintext starts with the time of issue (64 bit, s) and the id of
+    // the issuing crypter (64 bit, random)
+    class Http3TicketCrypter : public ProofSource::TicketCrypter
+    {
+    public:
+        // the keys are derived from secrets of any length, e.g. the server's secret
+        explicit Http3TicketCrypter(const std::vector<std::string> &secrets);
+
+        // loop thread, current key first
+        void setKeys(const std::vector<std::string> &secrets);
+
+        // before the server starts, with early data a ticket is only good
+        // for it once and only within the window, a replayed or old ticket
+        // still resumes, but tls rejects its early data, so the early data
+        // is never processed twice; the filter is ours alone, so a ticket
+        // of another process resumes without early data as well
+        void setAntiReplay(int64_t window_s) { replay_filter_ = std::make_unique<Http3ReplayFilter>(window_s); }
+        // the context, the sessions in the tickets belong to
+        void setSslCtx(SSL_CTX *ssl_ctx) { ssl_ctx_ = ssl_ctx; }
+
+        // TicketCrypter
+        size_t MaxOverhead() override;
+        std::vector<uint8_t> Encrypt(absl::string_view in, absl::string_view encryption_key) override;
+        void Decrypt(absl::string_view in, std::unique_ptr<ProofSource::DecryptCallback> callback) override;
+
+        // js thread
+        uint64_t issued() const { return issued_.load(); }
+        uint64_t hits() const { return hits_.load(); }
+        uint64_t misses() const { return misses_.load(); }
+        uint64_t replays() const { return replays_.load(); }
+        uint64_t expired() const { return expired_.load(); }
+        uint64_t foreign() const { return foreign_.load(); }
+
+    protected:
+        struct Key
+        {
+            uint8_t id[4];
+            uint8_t key[32];
+        };
+
+        static Key deriveKey(const std::string &secret);
+        // tickets travel between processes, so it is the wall clock, in s
+        virtual int64_t nowS();
+        // the session of the ticket without early data, empty on failure
+        std::vector<uint8_t> withoutEarlyData(const std::vector<uint8_t> &session);
+
+        std::vector<Key> keys_; // loop thread only
+        uint64_t issuer_;       // in our tickets, the replay filter knows only them
+        std::unique_ptr<Http3ReplayFilter> replay_filter_; // loop thread only, none without early data
+        SSL_CTX *ssl_ctx_ = nullptr;
+        std::atomic<uint64_t> issued_{0};
+        std::atomic<uint64_t> hits_{0};   // decrypted, the session may be resumed
+        std::atomic<uint64_t> misses_{0}; // unknown key or broken ticket
+        std::atomic<uint64_t> replays_{0}; // seen before within the window, resumed without early data
+        std::atomic<uint64_t> expired_{0}; // older than the window, resumed without early data
+        std::atomic<uint64_t> foreign_{0}; // issued by another process, resumed without early data
+    };
+}
+
+#endif
@@ -0,0 +1,142 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "src/http3timing.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace quic
+{
+
+    std::shared_ptr<Http3HandshakeTimeline> &Http3HandshakeTimeline::current()
+    {
+        // each loop has its own thread
+        static thread_local std::shared_ptr<Http3HandshakeTimeline> timeline;
+        return timeline;
+    }
+
+    size_t Http3LatencyHistogram::bucketOf(int64_t us)
+    {
+        if (us < 1)
+            return 0;
+        size_t bucket = static_cast<size_t>(std::log2(static_cast<double>(us)) * 4.);
+        return std::min(bucket, kBuckets - 1);
+    }
+
+    double Http3LatencyHistogram::upperBoundUs(size_t bucket)
+    {
+        return std::exp2((bucket + 1) / 4.);
+    }
+
+    void Http3LatencyHistogram::record(int64_t us)
+    {
+        uint64_t value = static_cast<uint64_t>(std::max<int64_t>(us, 0));
+        buckets_[bucketOf(us)]++;
+        count_++;
+        sum_us_ += value;
+        // a single writer, so no compare and swap
+        if (value > max_us_.load())
+            max_us_ = value;
+    }
+
+    double Http3LatencyHistogram::quantileMs(double q) const
+    {
+        uint64_t count = count_.load();
+        if (count == 0)
+            return 0.;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(q * count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++)
+        {
+            seen += buckets_[i].load();
+            if (seen >= rank && seen > 0)
+                return std::min(upperBoundUs(i), static_cast<double>(max_us_.load())) / 1000.;
+        }
+        return maxMs();
+    }
+
+    double Http3LatencyHistogram::averageMs() const
+    {
+        uint64_t count = count_.load();
+        return count > 0 ? sum_us_.load() / 1000. / count : 0.;
+    }
+
+    v8::Local<v8::Object> Http3LatencyHistogram::toObject() const
+    {
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("count").ToLocalChecked(), Nan::New<v8::Number>(static_cast<double>(count())));
+        Nan::Set(retObj, Nan::New("avg").ToLocalChecked(), Nan::New<v8::Number>(averageMs()));
+        Nan::Set(retObj, Nan::New("p50").ToLocalChecked(), Nan::New<v8::Number>(quantileMs(0.5)));
+        Nan::Set(retObj, Nan::New("p90").ToLocalChecked(), Nan::New<v8::Number>(quantileMs(0.9)));
+        Nan::Set(retObj, Nan::New("p99").ToLocalChecked(), Nan::New<v8::Number>(quantileMs(0.99)));
+        Nan::Set(retObj, Nan::New("max").ToLocalChecked(), Nan::New<v8::Number>(maxMs()));
+        return retObj;
+    }
+
+    void Http3ServerTimings::recordHandshake(const Http3HandshakeTimeline &timeline)
+    {
+        if (timeline.reached(kTimelineStart))
+        {
+            queue.record(timeline.between(kTimelineStart, kTimelineSessionCreated));
+            total.record(timeline.between(kTimelineStart, kTimelineHandshakeComplete));
+        }
+        // resumed sessions are not signed
+        if (timeline.reached(kTimelineSignDone))
+            signing.record(timeline.between(kTimelineSignStart, kTimelineSignDone));
+        handshake.record(timeline.between(kTimelineSessionCreated, kTimelineHandshakeComplete));
+    }
+
+    void Http3ServerTimings::recordRequest(const Http3HandshakeTimeline &timeline, int64_t connect_us,
+                                           int64_t response_us)
+    {
+        // later sessions on the connection would only show its age
+        if (timeline.at[kTimelineConnect] == connect_us)
+            connect.record(timeline.reached(kTimelineHandshakeComplete)
+                               ? connect_us - timeline.at[kTimelineHandshakeComplete]
+                               : 0);
+        decision.record(response_us - connect_us);
+    }
+
+    v8::Local<v8::Object> Http3ServerTimings::toObject() const
+    {
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("queue").ToLocalChecked(), queue.toObject());
+        Nan::Set(retObj, Nan::New("signing").ToLocalChecked(), signing.toObject());
+        Nan::Set(retObj, Nan::New("handshake").ToLocalChecked(), handshake.toObject());
+        Nan::Set(retObj, Nan::New("total").ToLocalChecked(), total.toObject());
+        Nan::Set(retObj, Nan::New("connect").ToLocalChecked(), connect.toObject());
+        Nan::Set(retObj, Nan::New("decision").ToLocalChecked(), decision.toObject());
+        return retObj;
+    }
+
+    v8::Local<v8::Object> Http3ClientTimings::toObject() const
+    {
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        Nan::Set(retObj, Nan::New("encryption").ToLocalChecked(), encryption.toObject());
+        Nan::Set(retObj, Nan::New("handshake").ToLocalChecked(), handshake.toObject());
+        Nan::Set(retObj, Nan::New("settings").ToLocalChecked(), settings.toObject());
+        Nan::Set(retObj, Nan::New("session").ToLocalChecked(), session.toObject());
+        Nan::Set(retObj, Nan::New("total").ToLocalChecked(), total.toObject());
+        return retObj;
+    }
+
+    v8::Local<v8::Object> Http3TimelineObject(const Http3HandshakeTimeline &timeline)
+    {
+        static const char *const kNames[kTimelinePoints] = {
+            "start", "sessionCreated", "signStart", "signDone", "encrypted",
+            "handshakeComplete", "settings", "connect", "response"};
+        v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+        int64_t start = timeline.at[kTimelineStart];
+        for (size_t i = 0; i < kTimelinePoints; i++)
+        {
+            if (timeline.at[i] == 0 || (start == 0 && i != kTimelineStart))
+                continue;
+            Nan::Set(retObj, Nan::New(kNames[i]).ToLocalChecked(),
+                     Nan::New<v8::Number>((timeline.at[i] - start) / 1000.));
+        }
+        return retObj;
+    }
+
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HTTP3_TIMING_H_
+#define HTTP3_TIMING_H_
+
+#include <nan.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace quic
+{
+    // points of the connection setup, all on the loop clock in us
+    // server: first chlo packet, session created, signature, handshake
+    // complete, CONNECT received and answered
+    // client: StartConnect, encryption up, handshake complete, webtransport
+    // support of the server known, CONNECT sent and answered
+    enum Http3TimelinePoint
+    {
+        kTimelineStart,
+        kTimelineSessionCreated,
+        kTimelineSignStart,
+        kTimelineSignDone,
+        kTimelineEncrypted,
+        kTimelineHandshakeComplete,
+        kTimelineSettings,
+        kTimelineConnect,
+        kTimelineResponse,
+        kTimelinePoints
+    };
+
+    struct Http3HandshakeTimeline
+    {
+        int64_t at[kTimelinePoints] = {}; // 0 not reached
+
+        // only the first time counts
+        void mark(Http3TimelinePoint point, int64_t now_us)
+        {
+            if (at[point] == 0)
+                at[point] = now_us;
+        }
+        bool reached(Http3TimelinePoint point) const { return at[point] != 0; }
+        int64_t between(Http3TimelinePoint from, Http3TimelinePoint to) const
+        {
+            return at[to] > at[from] ? at[to] - at[from] : 0;
+        }
+
+        // the timeline of the connection, whose packet the loop handles,
+        // so that the proof source can stamp the signature
+        static std::shared_ptr<Http3HandshakeTimeline> &current();
+    };
+
+    // marks the current timeline for the handling of one packet
+    class Http3TimelineScope
+    {
+    public:
+        explicit Http3TimelineScope(std::shared_ptr<Http3HandshakeTimeline> timeline)
+            : previous_(std::move(Http3HandshakeTimeline::current()))
+        {
+            Http3HandshakeTimeline::current() = std::move(timeline);
+        }
+        ~Http3TimelineScope() { Http3HandshakeTimeline::current() = std::move(previous_); }
+
+    private:
+        std::shared_ptr<Http3HandshakeTimeline> previous_;
+    };
+
+    // latencies in log buckets, 4 per power of two, from 1 us to minutes
+    // written by the loop thread, read by js without locks
+    class Http3LatencyHistogram
+    {
+    public:
+        static constexpr size_t kBuckets = 112;
+
+        void record(int64_t us);
+
+        uint64_t count() const { return count_.load(); }
+        // in ms, the upper bound of the bucket of the quantile
+        double quantileMs(double q) const;
+        double averageMs() const;
+        double maxMs() const { return max_us_.load() / 1000.; }
+
+        // { count, avg, p50, p90, p99, max } in ms
+        v8::Local<v8::Object> toObject() const;
+
+    protected:
+        static size_t bucketOf(int64_t us);
+        static double upperBoundUs(size_t bucket);
+
+        std::atomic<uint64_t> buckets_[kBuckets] = {};
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> sum_us_{0};
+        std::atomic<uint64_t> max_us_{0};
+    };
+
+    // the phases of the server side setup
+    struct Http3ServerTimings
+    {
+        Http3LatencyHistogram queue;     // first chlo to session
+        Http3LatencyHistogram signing;   // signature started to done
+        Http3LatencyHistogram handshake; // session to handshake complete
+        Http3LatencyHistogram total;     // first chlo to handshake complete
+        Http3LatencyHistogram connect;   // handshake complete to CONNECT, 0 in 0-rtt
+        Http3LatencyHistogram decision;  // CONNECT to answer
+
+        // when the handshake completes
+        void recordHandshake(const Http3HandshakeTimeline &timeline);
+        // when a CONNECT was answered
+        void recordRequest(const Http3HandshakeTimeline &timeline, int64_t connect_us, int64_t response_us);
+
+        v8::Local<v8::Object> toObject() const;
+    };
+
+    // the phases of the client side setup
+    struct Http3ClientTimings
+    {
+        Http3LatencyHistogram encryption; // StartConnect to encryption up
+        Http3LatencyHistogram handshake;  // StartConnect to handshake complete
+        Http3LatencyHistogram settings;   // StartConnect to webtransport support
+        Http3LatencyHistogram session;    // CONNECT sent to answer
+        Http3LatencyHistogram total;      // StartConnect to the first answer
+
+        v8::Local<v8::Object> toObject() const;
+    };
+
+    // the timeline for js, in ms since the start, unreached points are missing
+    v8::Local<v8::Object> Http3TimelineObject(const Http3HandshakeTimeline &timeline);
+
+}
+
+#endif
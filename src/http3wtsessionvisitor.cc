@@ -4,6 +4,7 @@
 
 #include "src/http3wtsessionvisitor.h"
 #include "src/http3eventloop.h"
+#include "src/http3datagramgroup.h"
 
 namespace quic
 {
@@ -12,9 +13,23 @@ namespace quic
                                                 const std::string &error_message)
     {
         session_->session_ = nullptr;
+        session_->spdy_session_ = nullptr;
+        // datagrams that arrived before the close are still delivered
+        session_->flushDatagramBatch();
+        session_->eventloop_->removeDatagramBatch(session_);
+        session_->detachDatagramHooks();
         session_->eventloop_->informSessionClosed(session_, error_code, error_message);
     }
 
+    void Http3WTSession::leaveDatagramGroups()
+    {
+        for (auto group : groups_)
+        {
+            group->removeMemberInt(this);
+        }
+        groups_.clear();
+    }
+
     void Http3WTSession::Visitor::OnSessionReady(const spdy::SpdyHeaderBlock &)
     {
         session_->eventloop_->informSessionReady(session_);
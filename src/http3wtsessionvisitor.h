@@ -13,13 +13,24 @@
 
 #include <nan.h>
 
+#include <algorithm>
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include <string>
 
 #include "src/http3wtstreamvisitor.h"
+#include "src/http3datagramhooks.h"
+#include "src/http3fec.h"
+#include "src/http3fragment.h"
+#include "src/http3timing.h"
 
 #include "quiche/quic/core/web_transport_interface.h"
+#include "quiche/quic/core/http/quic_spdy_session.h"
 #include "quiche/quic/platform/api/quic_logging.h"
 #include "quiche/common/quiche_circular_deque.h"
 #include "quiche/common/platform/api/quiche_mem_slice.h"
@@ -29,18 +40,35 @@
 namespace quic
 {
     // class Http3Server;
+    class Http3DatagramGroup;
 
-    class Http3WTSession : public Nan::ObjectWrap,  public LifetimeHelper
+    constexpr uint64_t kDatagramArenaSize = 256 * 1024; // per session
+    constexpr size_t kDefaultDatagramHighWaterMark = 64;  // outgoing datagrams per session
+    constexpr size_t kDefaultIncomingDatagramCount = 1024; // waiting for js per session
+    constexpr size_t kDefaultIncomingDatagramBytes = 1024 * 1024;
+    constexpr int64_t kDefaultFecDelayUs = 10000; // a partial fec group waits this long for its repairs
+
+    class Http3WTSession : public Nan::ObjectWrap,  public LifetimeHelper, public Http3DatagramSource,
+                           public Http3DatagramFence
     {
     public:
-        Http3WTSession(WebTransportSession *session, Http3EventLoop *eventloop)
-            : session_(session), eventloop_(eventloop), ordBidiStreams(0), ordUnidiStreams(0), allocator_(eventloop)
+        Http3WTSession(WebTransportSession *session, QuicSpdySession *spdy_session,
+                       Http3DatagramHooks *datagram_hooks, Http3EventLoop *eventloop)
+            : session_(session), spdy_session_(spdy_session), datagram_hooks_(datagram_hooks),
+              eventloop_(eventloop),
+              fec_alarm_([this]()
+                         { finishFecGroup(); })
         {
+            if (datagram_hooks_)
+                datagram_hooks_->addDatagramSource(this);
         }
 
         ~Http3WTSession()
         {
             // printf("session destruct %x\n", this);
+            delete recv_batch_;
+            delete feedback_;
+            arena_->release();
         }
 
         class Visitor : public WebTransportVisitor
@@ -51,6 +79,10 @@ namespace quic
             ~Visitor()
             {
                 Http3WTSession *sessobj = session_;
+                // the batch must reach js before the object may go away
+                sessobj->flushDatagramBatch();
+                sessobj->eventloop_->removeDatagramBatch(sessobj);
+                sessobj->detachDatagramHooks();
                 session_->eventloop_->informUnref(sessobj);
             }
 
@@ -70,12 +102,10 @@ namespace quic
                     {
                         return;
                     }
-                    Http3WTStream *wtstream = new Http3WTStream(stream, session_->eventloop_);
                     QUIC_DVLOG(1)
                         << "Http3WTSession received a bidirectional stream "
                         << stream->GetStreamId();
-                    stream->SetVisitor(
-                        std::make_unique<Http3WTStream::Visitor>(wtstream));
+                    Http3WTStream *wtstream = session_->createStreamObj(stream);
                     session_->eventloop_->informAboutStream(true, true, session_, static_cast<Http3WTStream *>(wtstream));
                     stream->visitor()->OnCanRead();
                 }
@@ -92,11 +122,9 @@ namespace quic
                     {
                         return;
                     }
-                    Http3WTStream *wtstream = new Http3WTStream(stream, session_->eventloop_);
                     QUIC_DVLOG(1)
                         << "Http3WTSession received a unidirectional stream";
-                    stream->SetVisitor(
-                        std::make_unique<Http3WTStream::Visitor>(wtstream));
+                    Http3WTStream *wtstream = session_->createStreamObj(stream);
                     session_->eventloop_->informAboutStream(true, false, session_, static_cast<Http3WTStream *>(wtstream));
                     stream->visitor()->OnCanRead();
                 }
@@ -104,7 +132,7 @@ namespace quic
 
             void OnDatagramReceived(absl::string_view datagram) override
             {
-                session_->eventloop_->informDatagramReceived(session_, datagram);
+                session_->receiveDatagram(datagram);
                 /*auto buffer = MakeUniqueBuffer(&allocator_, datagram.size());
                 memcpy(buffer.get(), datagram.data(), datagram.size());
                 quiche::QuicheMemSlice slice(std::move(buffer), datagram.size());
@@ -126,34 +154,362 @@ namespace quic
             Http3WTSession *session_;
         };
 
-        void
-        tryOpenBidiStream()
+        // wraps a quiche stream, before any data can be read from it
+        Http3WTStream *createStreamObj(WebTransportStream *stream)
+        {
+            Http3WTStream *wtstream = new Http3WTStream(stream, spdy_session_, eventloop_);
+            wtstream->setReadConfig(stream_read_config_);
+            wtstream->setDatagramFence(this);
+            stream->SetVisitor(
+                std::make_unique<Http3WTStream::Visitor>(wtstream));
+            return wtstream;
+        }
+
+        void receiveDatagram(absl::string_view datagram)
+        {
+            if (!fec_decoder_)
+                return receiveFragment(datagram);
+            absl::string_view payload;
+            std::vector<std::string> recovered;
+            if (fec_decoder_->receive(datagram, payload, recovered))
+                receiveFragment(payload);
+            for (auto &cur : recovered)
+                receiveFragment(cur);
+            fec_repairs_received_ = fec_decoder_->repairsReceived();
+            fec_recovered_ = fec_decoder_->recovered();
+            fec_lost_ = fec_decoder_->lost();
+        }
+
+        // only whole messages go on to js
+        void receiveFragment(absl::string_view datagram)
+        {
+            if (!reassembler_)
+                return receivePayload(datagram);
+            absl::string_view view;
+            std::string message;
+            bool complete = reassembler_->receive(datagram, eventloop_->NowInUsec(), view, message);
+            messages_reassembled_ = reassembler_->reassembled();
+            messages_dropped_incoming_ = reassembler_->dropped();
+            if (complete)
+                receivePayload(view);
+        }
+
+        // incoming datagrams wait here, until js asked for them
+        void receivePayload(absl::string_view datagram)
+        {
+            if (in_credit_ > 0 && in_datagrams_.empty())
+            {
+                in_credit_--;
+                addToDatagramBatch(datagram);
+                return;
+            }
+            if (in_drop_newest_ && (in_datagrams_.size() >= in_max_count_ ||
+                                    in_bytes_ + datagram.size() > in_max_bytes_))
+            {
+                datagrams_dropped_incoming_++;
+                return;
+            }
+            InDatagram cur;
+            cur.data = std::string(datagram);
+            cur.received = eventloop_->NowInUsec();
+            in_bytes_ += cur.data.size();
+            in_datagrams_.push_back(std::move(cur));
+            while (!in_datagrams_.empty() &&
+                   (in_datagrams_.size() > in_max_count_ || in_bytes_ > in_max_bytes_))
+            {
+                in_bytes_ -= in_datagrams_.front().data.size();
+                in_datagrams_.pop_front();
+                datagrams_dropped_incoming_++;
+            }
+        }
+
+        // js can take count more datagrams
+        void pullDatagramsInt(uint32_t count)
+        {
+            in_credit_ += count;
+            int64_t now = eventloop_->NowInUsec();
+            while (in_credit_ > 0 && !in_datagrams_.empty())
+            {
+                InDatagram &cur = in_datagrams_.front();
+                if (in_max_age_us_ == 0 || now - cur.received <= in_max_age_us_)
+                {
+                    addToDatagramBatch(cur.data);
+                    in_credit_--;
+                }
+                else
+                {
+                    datagrams_expired_incoming_++;
+                }
+                in_bytes_ -= cur.data.size();
+                in_datagrams_.pop_front();
+            }
+        }
+
+        void addToDatagramBatch(absl::string_view datagram)
+        {
+            if (!recv_batch_)
+                recv_batch_ = new Http3DatagramBatch();
+            registerFlush();
+            recv_batch_->data.append(datagram.data(), datagram.size());
+            recv_batch_->lengths.push_back(static_cast<uint32_t>(datagram.size()));
+        }
+
+        // hands all datagrams of this loop iteration to js in one report
+        void flushDatagramBatch()
+        {
+            flush_registered_ = false;
+            if (recv_batch_)
+            {
+                eventloop_->informDatagramsReceived(this, recv_batch_);
+                recv_batch_ = nullptr;
+            }
+            if (feedback_)
+            {
+                eventloop_->informDatagramFeedback(this, feedback_);
+                feedback_ = nullptr;
+            }
+        }
+
+        // flushDatagramBatch is called after this loop iteration
+        void registerFlush()
+        {
+            if (flush_registered_)
+                return;
+            flush_registered_ = true;
+            eventloop_->addDatagramBatch(this);
+        }
+
+        void OnDatagramAcked(uint64_t tag, int64_t sendtime) override
+        {
+            addFeedback(tag, sendtime, false);
+        }
+
+        void OnDatagramLost(uint64_t tag, int64_t sendtime) override
+        {
+            addFeedback(tag, sendtime, true);
+        }
+
+        void addFeedback(uint64_t tag, int64_t sendtime, bool lost)
+        {
+            if (!track_datagrams_)
+                return;
+            if (!feedback_)
+                feedback_ = new Http3DatagramFeedback();
+            Http3DatagramFeedback::Entry entry;
+            entry.id = tag;
+            entry.sendtime = sendtime;
+            entry.elapsed = eventloop_->NowInUsec() - sendtime;
+            (lost ? feedback_->lost : feedback_->acked).push_back(entry);
+            registerFlush();
+        }
+
+        void OnDatagramsCanWrite() override { pumpDatagrams(); }
+
+        // the quic session goes away or is done with us, drop what is queued
+        void detachDatagramHooks()
+        {
+            fec_alarm_.UnregisterIfRegistered();
+            leaveDatagramGroups();
+            if (datagram_hooks_)
+                datagram_hooks_->removeDatagramSource(this);
+            datagram_hooks_ = nullptr;
+            datagrams_dropped_ += out_datagrams_.size();
+            out_datagrams_.clear();
+            // nothing will be sent anymore, streams must not wait for it
+            releaseFenceWaiters();
+        }
+
+        bool canSendDatagrams() const { return session_ && datagram_hooks_; }
+
+        // adds to the outgoing queue, returns the number of dropped datagrams
+        // seq is the fence sequence number, 0 for datagrams from groups
+        size_t queueDatagram(quiche::QuicheMemSlice slice, int64_t now, uint64_t seq = 0)
         {
-            ordBidiStreams++;
+            if (!canSendDatagrams())
+            {
+                datagrams_dropped_++;
+                return 1; // the slice releases its buffer
+            }
+            if (!fragmenter_)
+                return queueFecDatagram(std::move(slice), now, seq);
+            std::vector<std::string> parts;
+            if (!fragmenter_->split(absl::string_view(slice.data(), slice.length()), maxFragmentedDatagram(), parts))
+            {
+                datagrams_dropped_++; // larger than maxMessageSize
+                markDatagramDone(seq);
+                return 1;
+            }
+            size_t dropped = 0;
+            for (size_t i = 0; i < parts.size(); i++)
+            {
+                // the fence and the feedback look at the last fragment
+                dropped += queueFecDatagram(quiche::QuicheMemSlice(quiche::QuicheBuffer::Copy(arena_, parts[i])),
+                                            now, i + 1 == parts.size() ? seq : 0);
+            }
+            return dropped;
+        }
+
+        // room for a fragment, after the fec header and repair overhead
+        size_t maxFragmentedDatagram()
+        {
+            size_t max = session_->GetMaxDatagramSize();
+            if (fec_encoder_)
+                max = max > kFecRepairOverhead ? max - kFecRepairOverhead : 0;
+            return max;
+        }
+
+        size_t queueFecDatagram(quiche::QuicheMemSlice slice, int64_t now, uint64_t seq)
+        {
+            if (!fec_encoder_)
+                return enqueueDatagram(std::move(slice), now, seq);
+            // the repairs of the group would not fit into a datagram
+            if (slice.length() + kFecRepairOverhead > session_->GetMaxDatagramSize())
+            {
+                datagrams_dropped_++;
+                markDatagramDone(seq);
+                return 1;
+            }
+            // the payload gets the fec header, the original slice is released here
+            std::string wire = fec_encoder_->addSource(absl::string_view(slice.data(), slice.length()));
+            size_t dropped = enqueueDatagram(
+                quiche::QuicheMemSlice(quiche::QuicheBuffer::Copy(arena_, wire)), now, seq);
+            if (fec_encoder_->groupFull())
+                dropped += queueFecRepairs(now);
+            else if (!fec_alarm_.registered())
+                fec_alarm_.Arm(eventloop_->getEpollServer(), now + fec_delay_us_);
+            return dropped;
+        }
+
+        size_t queueFecRepairs(int64_t now)
+        {
+            fec_alarm_.UnregisterIfRegistered();
+            std::vector<std::string> repairs;
+            fec_encoder_->finishGroup(repairs);
+            size_t dropped = 0;
+            for (auto &repair : repairs)
+            {
+                dropped += enqueueDatagram(
+                    quiche::QuicheMemSlice(quiche::QuicheBuffer::Copy(arena_, repair)), now, 0);
+                fec_repairs_sent_++;
+            }
+            return dropped;
+        }
+
+        // the group did not fill up in time, protect what we have
+        void finishFecGroup()
+        {
+            if (!fec_encoder_ || !fec_encoder_->groupOpen() || !canSendDatagrams())
+                return;
+            queueFecRepairs(eventloop_->NowInUsec());
+            pumpDatagrams();
+        }
+
+        void setDatagramFragmentationInt(size_t max_message_size, int64_t timeout, size_t max_bytes)
+        {
+            if (max_message_size == 0)
+            {
+                fragmenter_.reset();
+                reassembler_.reset();
+                return;
+            }
+            if (!fragmenter_)
+                fragmenter_ = std::make_unique<Http3DatagramFragmenter>();
+            if (!reassembler_)
+                reassembler_ = std::make_unique<Http3DatagramReassembler>();
+            fragmenter_->max_message_size = max_message_size;
+            reassembler_->max_message_size = max_message_size;
+            reassembler_->timeout_us = timeout;
+            reassembler_->max_bytes = max_bytes;
+            // the high water mark counts fragments, a whole message must fit,
+            // assuming fragments of at least 1000 bytes
+            out_high_water_mark_ = std::max(out_high_water_mark_, max_message_size / 1000 + 1);
+        }
+
+        void setDatagramFecInt(size_t sources, size_t repairs, int64_t delay)
+        {
+            if (fec_encoder_ && fec_encoder_->groupOpen() && canSendDatagrams())
+            {
+                queueFecRepairs(eventloop_->NowInUsec());
+                pumpDatagrams();
+            }
+            fec_alarm_.UnregisterIfRegistered();
+            if (sources == 0)
+            {
+                fec_encoder_.reset();
+                fec_decoder_.reset();
+                return;
+            }
+            fec_encoder_ = std::make_unique<Http3FecEncoder>(sources, repairs);
+            if (!fec_decoder_)
+                fec_decoder_ = std::make_unique<Http3FecDecoder>();
+            fec_delay_us_ = delay;
+        }
+
+        size_t enqueueDatagram(quiche::QuicheMemSlice slice, int64_t now, uint64_t seq)
+        {
+            OutDatagram cur;
+            cur.slice = std::move(slice);
+            cur.queued = now;
+            cur.seq = seq;
+            out_datagrams_.push_back(std::move(cur));
+            // real time data, the oldest is the least useful
+            if (out_datagrams_.size() > out_high_water_mark_)
+            {
+                popDatagram();
+                datagrams_dropped_++;
+                return 1;
+            }
+            return 0;
+        }
+
+        // Http3DatagramFence
+        uint64_t datagramsIssued() const override { return datagrams_issued_.load(); }
+
+        bool datagramsDone(uint64_t seq) const override
+        {
+            return !canSendDatagrams() || seq <= datagrams_done_;
+        }
+
+        void waitForDatagrams(Http3WTStream *stream) override { fence_waiters_.insert(stream); }
+
+        void cancelWaitForDatagrams(Http3WTStream *stream) override { fence_waiters_.erase(stream); }
+
+        void joinDatagramGroup(Http3DatagramGroup *group) { groups_.push_back(group); }
+
+        void leaveDatagramGroup(Http3DatagramGroup *group)
+        {
+            groups_.erase(std::remove(groups_.begin(), groups_.end(), group), groups_.end());
+        }
+
+        void leaveDatagramGroups();
+
+        // the urgency is set, before js can write
+        void tryOpenBidiStream(int urgency)
+        {
+            ordBidiStreams.push_back(urgency);
             TrySendingBidirectionalStreams();
         }
 
-        void tryOpenUnidiStream()
+        void tryOpenUnidiStream(int urgency)
         {
-            ordUnidiStreams++;
+            ordUnidiStreams.push_back(urgency);
             TrySendingUnidirectionalStreams();
         }
 
         void TrySendingBidirectionalStreams()
         {
             if (!session_) return;
-            while (ordBidiStreams > 0 &&
+            while (!ordBidiStreams.empty() &&
                    session_->CanOpenNextOutgoingBidirectionalStream())
             {
                 QUIC_DVLOG(1)
                     << "Http3WTSessionVisitor opens a bidirectional stream";
                 WebTransportStream *stream = session_->OpenOutgoingBidirectionalStream();
-                Http3WTStream *wtstream = new Http3WTStream(stream, eventloop_);
-                stream->SetVisitor(
-                    std::make_unique<Http3WTStream::Visitor>(wtstream));
+                Http3WTStream *wtstream = createStreamObj(stream);
+                wtstream->setPriorityInt(ordBidiStreams.front());
+                ordBidiStreams.pop_front();
                 eventloop_->informAboutStream(false, true, this, static_cast<Http3WTStream *>(wtstream));
                 stream->visitor()->OnCanWrite();
-                ordBidiStreams--;
             }
         }
 
@@ -161,19 +517,18 @@ namespace quic
         {
             if (!session_) return;
             // move to some where else?
-            while (ordUnidiStreams > 0 &&
+            while (!ordUnidiStreams.empty() &&
                    session_->CanOpenNextOutgoingUnidirectionalStream())
             {
                 QUIC_DVLOG(1)
                     << "Http3WTSessionVisitor opened a unidirectional stream";
                 WebTransportStream *stream = session_->OpenOutgoingUnidirectionalStream();
-                Http3WTStream *wtstream = new Http3WTStream(stream, eventloop_);
-                stream->SetVisitor(
-                    std::make_unique<Http3WTStream::Visitor>(wtstream));
+                Http3WTStream *wtstream = createStreamObj(stream);
+                wtstream->setPriorityInt(ordUnidiStreams.front());
+                ordUnidiStreams.pop_front();
 
                 eventloop_->informAboutStream(false, false, this, static_cast<Http3WTStream *>(wtstream));
                 stream->visitor()->OnCanWrite();
-                ordUnidiStreams--;
             }
         }
 
@@ -220,37 +575,352 @@ namespace quic
             return myconstr;
         }
 
+        // the optional argument is the urgency of the stream
         static NAN_METHOD(orderBidiStream)
         {
             Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
-            std::function<void()> task = [obj]()
-            { obj->tryOpenBidiStream(); };
+            int urgency;
+            if (!Http3WTStream::urgencyFromValue(info[0], &urgency))
+                return;
+            std::function<void()> task = [obj, urgency]()
+            { obj->tryOpenBidiStream(urgency); };
             obj->eventloop_->Schedule(task);
         }
 
         static NAN_METHOD(orderUnidiStream)
         {
             Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
-            std::function<void()> task = [obj]()
-            { obj->tryOpenUnidiStream(); };
+            int urgency;
+            if (!Http3WTStream::urgencyFromValue(info[0], &urgency))
+                return;
+            std::function<void()> task = [obj, urgency]()
+            { obj->tryOpenUnidiStream(urgency); };
+            obj->eventloop_->Schedule(task);
+        }
+
+        // copies a whole array of datagrams into the arena, so that no js
+        // objects are retained, and reports a single DatagramSend for all
+        static NAN_METHOD(writeDatagrams)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            if (!info[0]->IsArray())
+                return Nan::ThrowTypeError("writeDatagrams needs an array");
+            v8::Local<v8::Array> datagrams = info[0].As<v8::Array>();
+            v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+
+            // check all first, the arena is freed only by the loop thread
+            std::vector<v8::Local<v8::Value>> views;
+            views.reserve(datagrams->Length());
+            for (uint32_t i = 0; i < datagrams->Length(); i++)
+            {
+                v8::Local<v8::Value> cur = datagrams->Get(context, i).ToLocalChecked();
+                if (!cur->IsArrayBufferView())
+                    return Nan::ThrowTypeError("writeDatagrams needs Uint8Arrays");
+                views.push_back(cur);
+            }
+
+            auto batch = std::make_shared<std::vector<std::pair<char *, size_t>>>();
+            batch->reserve(views.size());
+            for (v8::Local<v8::Value> cur : views)
+            {
+                char *data = node::Buffer::Data(cur);
+                size_t len = node::Buffer::Length(cur);
+                char *buffer = obj->arena_->Reserve(len);
+                if (!buffer)
+                    buffer = obj->arena_->New(len); // arena full or too large, use the heap
+                memcpy(buffer, data, len);
+                batch->push_back(std::make_pair(buffer, len));
+            }
+
+            // sequence numbers for the fence, stream writes after this call wait for them
+            uint64_t first_seq = obj->datagrams_issued_.fetch_add(batch->size()) + 1;
+            std::function<void()> task = [obj, batch, first_seq]()
+            { obj->writeDatagramsInt(*batch, first_seq); };
+            obj->eventloop_->Schedule(task);
+            info.GetReturnValue().Set(Nan::New(static_cast<uint32_t>(batch->size())));
+        }
+
+        // outgoingMaxAge (ms, 0 is infinite) and outgoingHighWaterMark (datagrams)
+        static NAN_METHOD(setDatagramOptions)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            int64_t max_age = -1; // unchanged
+            int64_t high_water_mark = -1;
+            if (!info[0]->IsUndefined())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setDatagramOptions needs an object");
+                v8::Local<v8::Object> lobj = optobj.ToLocalChecked();
+                v8::Local<v8::String> maxAgeProp = Nan::New("outgoingMaxAge").ToLocalChecked();
+                v8::Local<v8::String> hwmProp = Nan::New("outgoingHighWaterMark").ToLocalChecked();
+                if (Nan::HasOwnProperty(lobj, maxAgeProp).FromJust() && !Nan::Get(lobj, maxAgeProp).IsEmpty())
+                {
+                    v8::Local<v8::Value> maxAgeValue = Nan::Get(lobj, maxAgeProp).ToLocalChecked();
+                    double ms = maxAgeValue->IsNull() ? 0. : Nan::To<double>(maxAgeValue).FromJust();
+                    max_age = ms > 0. ? static_cast<int64_t>(ms * 1000.) : 0;
+                }
+                if (Nan::HasOwnProperty(lobj, hwmProp).FromJust() && !Nan::Get(lobj, hwmProp).IsEmpty())
+                {
+                    v8::Local<v8::Value> hwmValue = Nan::Get(lobj, hwmProp).ToLocalChecked();
+                    high_water_mark = Nan::To<uint32_t>(hwmValue).FromJust();
+                    if (high_water_mark < 1)
+                        high_water_mark = 1;
+                }
+            }
+            std::function<void()> task = [obj, max_age, high_water_mark]()
+            { obj->setDatagramOptionsInt(max_age, high_water_mark); };
+            obj->eventloop_->Schedule(task);
+        }
+
+        // credit for incoming datagrams, nothing is delivered without it
+        static NAN_METHOD(pullDatagrams)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            uint32_t count = 1;
+            if (!info[0]->IsUndefined())
+                count = Nan::To<uint32_t>(info[0]).FromJust();
+            std::function<void()> task = [obj, count]()
+            { obj->pullDatagramsInt(count); };
             obj->eventloop_->Schedule(task);
         }
 
-        static NAN_METHOD(writeDatagram)
+        // limits of the native receive queue: maxCount, maxBytes,
+        // policy ('drop-oldest' or 'drop-newest') and maxAge in ms
+        static NAN_METHOD(setIncomingDatagramOptions)
         {
             Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            int64_t max_count = -1; // unchanged
+            int64_t max_bytes = -1;
+            int64_t max_age = -1;
+            int drop_newest = -1;
             if (!info[0]->IsUndefined())
             {
                 v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
-                v8::Local<v8::Object> bufferlocal = info[0]->ToObject(context).ToLocalChecked();
-                Nan::Persistent<v8::Object> *bufferHandle = new Nan::Persistent<v8::Object>(bufferlocal);
-                char *buffer = node::Buffer::Data(bufferlocal);
-                size_t len = node::Buffer::Length(bufferlocal);
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setIncomingDatagramOptions needs an object");
+                v8::Local<v8::Object> lobj = optobj.ToLocalChecked();
+                v8::Local<v8::String> countProp = Nan::New("maxCount").ToLocalChecked();
+                v8::Local<v8::String> bytesProp = Nan::New("maxBytes").ToLocalChecked();
+                v8::Local<v8::String> policyProp = Nan::New("policy").ToLocalChecked();
+                v8::Local<v8::String> maxAgeProp = Nan::New("maxAge").ToLocalChecked();
+                if (Nan::HasOwnProperty(lobj, countProp).FromJust() && !Nan::Get(lobj, countProp).IsEmpty())
+                    max_count = Nan::To<uint32_t>(Nan::Get(lobj, countProp).ToLocalChecked()).FromJust();
+                if (Nan::HasOwnProperty(lobj, bytesProp).FromJust() && !Nan::Get(lobj, bytesProp).IsEmpty())
+                    max_bytes = Nan::To<uint32_t>(Nan::Get(lobj, bytesProp).ToLocalChecked()).FromJust();
+                if (Nan::HasOwnProperty(lobj, policyProp).FromJust() && !Nan::Get(lobj, policyProp).IsEmpty())
+                {
+                    Nan::Utf8String policy(Nan::Get(lobj, policyProp).ToLocalChecked());
+                    std::string policystr(*policy, policy.length());
+                    if (policystr == "drop-oldest")
+                        drop_newest = 0;
+                    else if (policystr == "drop-newest")
+                        drop_newest = 1;
+                    else
+                        return Nan::ThrowError("setIncomingDatagramOptions unknown policy");
+                }
+                if (Nan::HasOwnProperty(lobj, maxAgeProp).FromJust() && !Nan::Get(lobj, maxAgeProp).IsEmpty())
+                {
+                    v8::Local<v8::Value> maxAgeValue = Nan::Get(lobj, maxAgeProp).ToLocalChecked();
+                    double ms = maxAgeValue->IsNull() ? 0. : Nan::To<double>(maxAgeValue).FromJust();
+                    max_age = ms > 0. ? static_cast<int64_t>(ms * 1000.) : 0;
+                }
+            }
+            std::function<void()> task = [obj, max_count, max_bytes, max_age, drop_newest]()
+            {
+                if (max_count >= 0)
+                    obj->in_max_count_ = max_count;
+                if (max_bytes >= 0)
+                    obj->in_max_bytes_ = max_bytes;
+                if (max_age >= 0)
+                    obj->in_max_age_us_ = max_age;
+                if (drop_newest >= 0)
+                    obj->in_drop_newest_ = drop_newest == 1;
+            };
+            obj->eventloop_->Schedule(task);
+        }
+
+        // opt in to acked and lost reports for the datagrams of this session
+        static NAN_METHOD(setDatagramFeedback)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            bool track = info[0]->IsUndefined() ? true : Nan::To<bool>(info[0]).FromJust();
+            std::function<void()> task = [obj, track]()
+            {
+                obj->track_datagrams_ = track;
+            };
+            obj->eventloop_->Schedule(task);
+        }
+
+        // forward error correction for datagrams, both peers must enable it
+        // with the same settings: sources (K), repairs (M) and delay in ms,
+        // after which a group, that is not full, gets its repairs anyway
+        // null or sources 0 disables it
+        static NAN_METHOD(setDatagramFec)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            uint32_t sources = 0;
+            uint32_t repairs = 2;
+            int64_t delay = kDefaultFecDelayUs;
+            if (!info[0]->IsUndefined() && !info[0]->IsNull())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setDatagramFec needs an object");
+                v8::Local<v8::Object> lobj = optobj.ToLocalChecked();
+                v8::Local<v8::String> sourcesProp = Nan::New("sources").ToLocalChecked();
+                v8::Local<v8::String> repairsProp = Nan::New("repairs").ToLocalChecked();
+                v8::Local<v8::String> delayProp = Nan::New("delay").ToLocalChecked();
+                sources = 8;
+                if (Nan::HasOwnProperty(lobj, sourcesProp).FromJust() && !Nan::Get(lobj, sourcesProp).IsEmpty())
+                    sources = Nan::To<uint32_t>(Nan::Get(lobj, sourcesProp).ToLocalChecked()).FromJust();
+                if (Nan::HasOwnProperty(lobj, repairsProp).FromJust() && !Nan::Get(lobj, repairsProp).IsEmpty())
+                    repairs = Nan::To<uint32_t>(Nan::Get(lobj, repairsProp).ToLocalChecked()).FromJust();
+                if (Nan::HasOwnProperty(lobj, delayProp).FromJust() && !Nan::Get(lobj, delayProp).IsEmpty())
+                    delay = static_cast<int64_t>(Nan::To<double>(Nan::Get(lobj, delayProp).ToLocalChecked()).FromJust() * 1000.);
+                if (sources > kFecMaxSources || repairs < 1 || repairs > kFecMaxRepairs)
+                    return Nan::ThrowRangeError("setDatagramFec sources must be at most 64 and repairs 1 to 16");
+                if (delay < 0)
+                    delay = 0;
+            }
+            std::function<void()> task = [obj, sources, repairs, delay]()
+            { obj->setDatagramFecInt(sources, repairs, delay); };
+            obj->eventloop_->Schedule(task);
+        }
 
-                std::function<void()> task = [obj, bufferHandle, buffer, len]()
-                { obj->writeDatagramInt(buffer, len, bufferHandle); };
-                obj->eventloop_->Schedule(task);
+        // messages larger than a datagram are split and reassembled, both
+        // peers must enable it: maxMessageSize (bytes), timeout (ms) for an
+        // incomplete message and maxBytes for all incomplete messages,
+        // null disables it
+        static NAN_METHOD(setDatagramFragmentation)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            uint32_t max_message_size = 0;
+            int64_t timeout = kDefaultReassemblyTimeoutUs;
+            uint32_t max_bytes = kDefaultReassemblyBytes;
+            if (!info[0]->IsUndefined() && !info[0]->IsNull())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setDatagramFragmentation needs an object");
+                v8::Local<v8::Object> lobj = optobj.ToLocalChecked();
+                v8::Local<v8::String> sizeProp = Nan::New("maxMessageSize").ToLocalChecked();
+                v8::Local<v8::String> timeoutProp = Nan::New("timeout").ToLocalChecked();
+                v8::Local<v8::String> bytesProp = Nan::New("maxBytes").ToLocalChecked();
+                // as doubles, so that negative values do not wrap
+                double size = kDefaultMaxFragmentedMessageSize;
+                double timeout_ms = kDefaultReassemblyTimeoutUs / 1000.;
+                double bytes = kDefaultReassemblyBytes;
+                if (Nan::HasOwnProperty(lobj, sizeProp).FromJust() && !Nan::Get(lobj, sizeProp).IsEmpty() &&
+                    !Nan::To<double>(Nan::Get(lobj, sizeProp).ToLocalChecked()).To(&size))
+                    return;
+                if (Nan::HasOwnProperty(lobj, timeoutProp).FromJust() && !Nan::Get(lobj, timeoutProp).IsEmpty() &&
+                    !Nan::To<double>(Nan::Get(lobj, timeoutProp).ToLocalChecked()).To(&timeout_ms))
+                    return;
+                if (Nan::HasOwnProperty(lobj, bytesProp).FromJust() && !Nan::Get(lobj, bytesProp).IsEmpty() &&
+                    !Nan::To<double>(Nan::Get(lobj, bytesProp).ToLocalChecked()).To(&bytes))
+                    return;
+                if (!(size >= 1. && bytes >= size && bytes <= UINT32_MAX && timeout_ms >= 0.001 && timeout_ms <= 1e12))
+                    return Nan::ThrowRangeError("setDatagramFragmentation needs a timeout and maxBytes of at least maxMessageSize");
+                max_message_size = static_cast<uint32_t>(size);
+                timeout = static_cast<int64_t>(timeout_ms * 1000.);
+                max_bytes = static_cast<uint32_t>(bytes);
             }
+            std::function<void()> task = [obj, max_message_size, timeout, max_bytes]()
+            { obj->setDatagramFragmentationInt(max_message_size, timeout, max_bytes); };
+            obj->eventloop_->Schedule(task);
+        }
+
+        // loop thread, the setup of the connection and of this session
+        void setTimeline(const Http3HandshakeTimeline &timeline)
+        {
+            for (size_t i = 0; i < kTimelinePoints; i++)
+                timeline_[i] = timeline.at[i];
+        }
+        void markTimeline(Http3TimelinePoint point, int64_t now_us)
+        {
+            int64_t unset = 0;
+            timeline_[point].compare_exchange_strong(unset, now_us);
+        }
+
+        // the points in ms since the connection started, as far as reached
+        static NAN_METHOD(getHandshakeTiming)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            Http3HandshakeTimeline timeline;
+            for (size_t i = 0; i < kTimelinePoints; i++)
+                timeline.at[i] = obj->timeline_[i].load();
+            info.GetReturnValue().Set(Http3TimelineObject(timeline));
+        }
+
+        static NAN_METHOD(getDatagramStats)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            v8::Local<v8::Object> retObj = Nan::New<v8::Object>();
+            Nan::Set(retObj, Nan::New("sent").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->datagrams_sent_.load())));
+            Nan::Set(retObj, Nan::New("expiredOutgoing").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->datagrams_expired_.load())));
+            Nan::Set(retObj, Nan::New("droppedOutgoing").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->datagrams_dropped_.load())));
+            Nan::Set(retObj, Nan::New("droppedIncoming").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->datagrams_dropped_incoming_.load())));
+            Nan::Set(retObj, Nan::New("expiredIncoming").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->datagrams_expired_incoming_.load())));
+            Nan::Set(retObj, Nan::New("fecRepairsSent").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->fec_repairs_sent_.load())));
+            Nan::Set(retObj, Nan::New("fecRepairsReceived").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->fec_repairs_received_.load())));
+            Nan::Set(retObj, Nan::New("fecRecovered").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->fec_recovered_.load())));
+            Nan::Set(retObj, Nan::New("fecLost").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->fec_lost_.load())));
+            Nan::Set(retObj, Nan::New("messagesReassembled").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->messages_reassembled_.load())));
+            Nan::Set(retObj, Nan::New("messagesDroppedIncoming").ToLocalChecked(),
+                     Nan::New<v8::Number>(static_cast<double>(obj->messages_dropped_incoming_.load())));
+            info.GetReturnValue().Set(retObj);
+        }
+
+        // defaults for streams created afterwards, they must be in place
+        // natively, since incoming streams are read before js sees them
+        static NAN_METHOD(setStreamReadOptions)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            Http3ReadConfig config;
+            if (!info[0]->IsUndefined())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setStreamReadOptions needs an object");
+                Http3ReadConfig::parseOptions(optobj.ToLocalChecked(), config);
+            }
+            std::function<void()> task = [obj, config]()
+            { obj->stream_read_config_.applyOptions(config); };
+            obj->eventloop_->Schedule(task);
+        }
+
+        static NAN_METHOD(setStreamReadFraming)
+        {
+            Http3WTSession *obj = Nan::ObjectWrap::Unwrap<Http3WTSession>(info.Holder());
+            Http3ReadConfig config;
+            if (!info[0]->IsUndefined())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setStreamReadFraming needs an object");
+                if (!Http3ReadConfig::parseFraming(optobj.ToLocalChecked(), config, "setStreamReadFraming"))
+                    return;
+            }
+            std::function<void()> task = [obj, config]()
+            { obj->stream_read_config_.applyFraming(config); };
+            obj->eventloop_->Schedule(task);
         }
 
         static NAN_METHOD(close)
@@ -289,52 +959,252 @@ namespace quic
 
 
     private:
-        class DatagramAllocator : public quiche::QuicheBufferAllocator
+        // ring of datagram copies, js reserves at the head, quiche releases
+        // on the loop thread and the tail follows the released records
+        // the session and every buffer not yet released hold a reference, as
+        // quiche's queue belongs to the connection, which may outlive the session
+        class DatagramArena : public quiche::QuicheBufferAllocator
         {
         public:
-            DatagramAllocator(Http3EventLoop *eventloop) : eventloop_(eventloop)
+            DatagramArena() : buffer_(new char[kDatagramArenaSize]) {}
+
+            // fallback for datagrams, that do not fit into the arena
+            char *New(size_t size) override
             {
+                refs_++;
+                return new char[size];
             }
+            char *New(size_t size, bool flag_enable) override { return New(size); }
 
-            char *New(size_t size) { return nullptr; }                   // fake it comes from javascript
-            char *New(size_t size, bool flag_enable) { return nullptr; } // fake it comes from javascript
+            void Delete(char *buffer) override
+            {
+                if (buffer < buffer_ || buffer >= buffer_ + kDatagramArenaSize)
+                {
+                    delete[] buffer;
+                    release();
+                    return;
+                }
+                Record *rec = reinterpret_cast<Record *>(buffer - sizeof(Record));
+                rec->freed = 1;
+                // quiche mostly releases in order, anything else waits for its predecessors
+                uint64_t tail = tail_.load(std::memory_order_relaxed);
+                uint64_t head = head_.load(std::memory_order_acquire);
+                while (tail != head)
+                {
+                    Record *cur = reinterpret_cast<Record *>(buffer_ + tail % kDatagramArenaSize);
+                    if (!cur->freed)
+                        break;
+                    tail += cur->size;
+                }
+                tail_.store(tail, std::memory_order_release);
+                release();
+            }
 
-            void Delete(char *buffer)
+            // the last reference frees the arena
+            void release()
             {
-                eventloop_->informDatagramBufferFree(buffers_[buffer]);
-                buffers_.erase(buffer);
+                if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    delete this;
             }
 
-            void registerBuffer(char *buffer, Nan::Persistent<v8::Object> *bufferhandle)
+            // js thread, returns nullptr if there is no room
+            char *Reserve(size_t size)
             {
-                buffers_[buffer] = bufferhandle;
+                uint64_t total = (sizeof(Record) + size + 7) & ~static_cast<uint64_t>(7);
+                if (total > kDatagramArenaSize / 4)
+                    return nullptr;
+                uint64_t head = head_.load(std::memory_order_relaxed);
+                uint64_t tail = tail_.load(std::memory_order_acquire);
+                uint64_t offset = head % kDatagramArenaSize;
+                uint64_t toend = kDatagramArenaSize - offset;
+                uint64_t needed = toend < total ? toend + total : total;
+                if (head + needed - tail > kDatagramArenaSize)
+                    return nullptr;
+                if (toend < total)
+                {
+                    // records are contiguous, so skip the rest of the ring
+                    Record *pad = reinterpret_cast<Record *>(buffer_ + offset);
+                    pad->size = static_cast<uint32_t>(toend);
+                    pad->freed = 1;
+                    head += toend;
+                    offset = 0;
+                }
+                Record *rec = reinterpret_cast<Record *>(buffer_ + offset);
+                rec->size = static_cast<uint32_t>(total);
+                rec->freed = 0;
+                refs_++;
+                head_.store(head + total, std::memory_order_release);
+                return buffer_ + offset + sizeof(Record);
             }
 
         protected:
-            Http3EventLoop *eventloop_;
-            std::map<char *, Nan::Persistent<v8::Object> *> buffers_;
+            ~DatagramArena() { delete[] buffer_; }
+
+            struct Record
+            {
+                uint32_t size; // including this header
+                uint32_t freed;
+            };
+            static_assert(sizeof(Record) == 8, "records must keep 8 byte alignment");
+
+            char *buffer_;
+            // running byte counters, the offset is taken modulo the arena size
+            std::atomic<uint64_t> head_{0}; // written by js
+            std::atomic<uint64_t> tail_{0}; // written by the loop
+            std::atomic<uint64_t> refs_{1};
         };
 
-        void writeDatagramInt(char *buffer, size_t len, Nan::Persistent<v8::Object> *bufferhandle)
+        void writeDatagramsInt(const std::vector<std::pair<char *, size_t>> &batch, uint64_t first_seq)
         {
-            if (!session_) {
-                eventloop_->informDatagramSend(this);
+            int64_t now = eventloop_->NowInUsec();
+            uint64_t seq = first_seq;
+            for (auto &dgram : batch)
+            {
+                auto ubuffer = quiche::QuicheUniqueBufferPtr(dgram.first,
+                                                             quiche::QuicheBufferDeleter(arena_));
+                queueDatagram(quiche::QuicheMemSlice(quiche::QuicheBuffer(std::move(ubuffer), dgram.second)),
+                              now, seq++);
+            }
+            pumpDatagrams();
+            eventloop_->informDatagramSend(this);
+        }
+
+        // hands datagrams to quiche, as long as quiche's own queue is empty,
+        // so that everything waiting is subject to our age and drop policy
+        void pumpDatagrams()
+        {
+            if (!session_ || !datagram_hooks_)
                 return;
+            int64_t now = eventloop_->NowInUsec();
+            while (!out_datagrams_.empty())
+            {
+                OutDatagram &cur = out_datagrams_.front();
+                if (out_max_age_us_ > 0 && now - cur.queued > out_max_age_us_)
+                {
+                    popDatagram();
+                    datagrams_expired_++;
+                    continue;
+                }
+                if (datagram_hooks_->QueuedDatagrams() > 0)
+                    break;
+                uint64_t seq = cur.seq;
+                MessageStatus status = session_->SendOrQueueDatagram(std::move(cur.slice));
+                popDatagram();
+                if (status == MESSAGE_STATUS_SUCCESS || status == MESSAGE_STATUS_BLOCKED)
+                {
+                    datagrams_sent_++;
+                    datagram_hooks_->noteDatagramHandedOver(this, track_datagrams_ ? seq : 0, now,
+                                                            status == MESSAGE_STATUS_SUCCESS);
+                }
+                else
+                    datagrams_dropped_++; // e.g. too large
             }
-            allocator_.registerBuffer(buffer, bufferhandle);
-            auto ubuffer = quiche::QuicheUniqueBufferPtr(buffer,
-                                                         quiche::QuicheBufferDeleter(&allocator_));
+            releaseFenceWaiters();
+        }
 
-            quiche::QuicheMemSlice slice(quiche::QuicheBuffer(std::move(ubuffer), len));
-            session_->SendOrQueueDatagram(std::move(slice));
-            eventloop_->informDatagramSend(this);
+        // the queue is in fence order, so the front is the next to be done
+        void popDatagram()
+        {
+            markDatagramDone(out_datagrams_.front().seq);
+            out_datagrams_.pop_front();
+        }
+
+        void markDatagramDone(uint64_t seq)
+        {
+            if (seq > datagrams_done_)
+                datagrams_done_ = seq;
         }
+
+        void releaseFenceWaiters()
+        {
+            if (fence_waiters_.empty())
+                return;
+            // streams, that still have to wait, register again
+            std::set<Http3WTStream *> waiters;
+            waiters.swap(fence_waiters_);
+            for (auto stream : waiters)
+            {
+                stream->tryWrite();
+            }
+        }
+
+        void setDatagramOptionsInt(int64_t max_age, int64_t high_water_mark)
+        {
+            // only our own queue, quiche's queue never expires
+            if (max_age >= 0)
+                out_max_age_us_ = max_age;
+            if (high_water_mark > 0)
+            {
+                out_high_water_mark_ = high_water_mark;
+                while (out_datagrams_.size() > out_high_water_mark_)
+                {
+                    popDatagram();
+                    datagrams_dropped_++;
+                }
+            }
+            pumpDatagrams();
+        }
+
+        struct OutDatagram
+        {
+            quiche::QuicheMemSlice slice;
+            int64_t queued; // us
+            uint64_t seq;   // fence sequence number, 0 is none
+        };
         WebTransportSession *session_;
-        DatagramAllocator allocator_;
+        QuicSpdySession *spdy_session_; // unowned, the http3 connection carrying the session
+        Http3DatagramHooks *datagram_hooks_; // unowned, the same connection
+        std::vector<Http3DatagramGroup *> groups_; // loop thread only
+        std::atomic<uint64_t> datagrams_issued_{0}; // written by js
+        uint64_t datagrams_done_ = 0;               // handed to quiche or dropped, loop thread
+        std::set<Http3WTStream *> fence_waiters_;   // loop thread only
+        std::deque<OutDatagram> out_datagrams_;
+        int64_t out_max_age_us_ = 0; // 0 is infinite
+        size_t out_high_water_mark_ = kDefaultDatagramHighWaterMark;
+        std::atomic<uint64_t> datagrams_sent_{0};
+        std::atomic<uint64_t> datagrams_expired_{0};
+        std::atomic<uint64_t> datagrams_dropped_{0};
+        DatagramArena *arena_ = new DatagramArena();
         bool echo_stream_opened_ = false;
         Http3EventLoop *eventloop_;
-        uint32_t ordBidiStreams;
-        uint32_t ordUnidiStreams;
+        std::deque<int> ordBidiStreams; // urgencies of the ordered streams
+        std::deque<int> ordUnidiStreams;
+        Http3ReadConfig stream_read_config_;
+        Http3DatagramBatch *recv_batch_ = nullptr; // loop thread only, handed to js on flush
+        Http3DatagramFeedback *feedback_ = nullptr; // loop thread only, handed to js on flush
+        bool flush_registered_ = false;
+        bool track_datagrams_ = false;
+        struct InDatagram
+        {
+            std::string data;
+            int64_t received; // us
+        };
+        // received, but js has not asked for them yet, loop thread only
+        std::deque<InDatagram> in_datagrams_;
+        size_t in_bytes_ = 0;
+        uint32_t in_credit_ = 0;
+        size_t in_max_count_ = kDefaultIncomingDatagramCount;
+        size_t in_max_bytes_ = kDefaultIncomingDatagramBytes;
+        int64_t in_max_age_us_ = 0; // 0 is infinite
+        bool in_drop_newest_ = false;
+        std::atomic<uint64_t> datagrams_dropped_incoming_{0};
+        std::atomic<uint64_t> datagrams_expired_incoming_{0};
+        // forward error correction, loop thread only, except for the counters
+        std::unique_ptr<Http3FecEncoder> fec_encoder_;
+        std::unique_ptr<Http3FecDecoder> fec_decoder_;
+        int64_t fec_delay_us_ = kDefaultFecDelayUs;
+        std::atomic<uint64_t> fec_repairs_sent_{0};
+        std::atomic<uint64_t> fec_repairs_received_{0};
+        std::atomic<uint64_t> fec_recovered_{0};
+        std::atomic<uint64_t> fec_lost_{0}; // neither received nor recovered
+        // fragmentation of large messages, loop thread only, except for the counters
+        std::unique_ptr<Http3DatagramFragmenter> fragmenter_;
+        std::unique_ptr<Http3DatagramReassembler> reassembler_;
+        std::atomic<uint64_t> messages_reassembled_{0};
+        std::atomic<uint64_t> messages_dropped_incoming_{0}; // incomplete, timed out or over the cap
+        Http3LoopAlarm fec_alarm_;
+
+        std::atomic<int64_t> timeline_[kTimelinePoints] = {}; // written by the loop
     };
 }
 #endif
\ No newline at end of file
@@ -15,12 +15,20 @@ namespace quic
             auto cur = stream_->chunks_.front();
 
             // now we have to inform the server TODO
-            stream_->eventloop_->informAboutStreamWrite(stream_, cur.bufferhandle, false);
+            stream_->eventloop_->informAboutStreamWrite(stream_, cur.bufferhandle, false,
+                                                        stream_->releaseBytes(cur.len));
 
             stream_->chunks_.pop_front();
         }
+        // hand out what we have coalesced, the alarms must go on this thread
+        stream_->finishRead();
+        stream_->deadline_alarm_.UnregisterIfRegistered();
+        stream_->inflight_.clear();
+        if (stream_->fence_)
+            stream_->fence_->cancelWaitForDatagrams(stream_);
         Http3WTStream *strobj = stream_;
         stream_->stream_ = nullptr;
+        stream_->quic_session_ = nullptr;
         strobj->eventloop_->informUnref(strobj);
     }
 
@@ -41,6 +49,7 @@ namespace quic
         stream_->send_fin_ = true;
         OnCanWrite();*/
         lasterror = error;
+        stream_->finishRead(); // data before the reset goes out first
         stream_->eventloop_->informStreamRecvSignal(stream_, error, NetworkTask::resetStream); // may be move below
     }
 
@@ -53,30 +62,310 @@ namespace quic
         OnCanWrite();
     }
 
-    void Http3WTStream::cancelWrite(Nan::Persistent<v8::Object> *handle)
+    void Http3WTStream::setPriorityInt(int urgency)
     {
-        eventloop_->informAboutStreamWrite(this, handle, false);
+        if (!stream_ || !quic_session_)
+            return;
+        // the webtransport adapter has no priority api, so we go to the quic stream
+        QuicStream *quicstream = quic_session_->GetActiveStream(stream_->GetStreamId());
+        if (quicstream)
+            quicstream->SetPriority(spdy::SpdyStreamPrecedence(static_cast<spdy::SpdyPriority>(urgency)));
+    }
+
+    void Http3WTStream::pruneInflight()
+    {
+        if (inflight_.empty())
+            return;
+        QuicStream *quicstream = quic_session_ ? quic_session_->GetActiveStream(stream_->GetStreamId()) : nullptr;
+        if (!quicstream)
+        {
+            inflight_.clear();
+            return;
+        }
+        // quiche does not tell us acks per offset, so a chunk counts as
+        // delivered once everything written after it covers the unsent bytes
+        uint64_t unsent = quicstream->BufferedDataBytes();
+        while (!inflight_.empty() && (!quicstream->IsWaitingForAcks() ||
+                                      bytes_written_ - inflight_.front().end >= unsent))
+        {
+            inflight_.pop_front();
+        }
+    }
+
+    void Http3WTStream::checkDeadlines()
+    {
+        if (!stream_ || deadline_reset_)
+            return;
+        pruneInflight();
+        int64_t now = eventloop_->NowInUsec();
+        int64_t next = 0;
+        std::vector<uint64_t> *expired = new std::vector<uint64_t>();
+        for (auto &cur : inflight_)
+        {
+            if (cur.deadline <= now)
+                expired->push_back(cur.seq);
+            else if (next == 0 || cur.deadline < next)
+                next = cur.deadline;
+        }
+        for (auto &cur : chunks_)
+        {
+            if (cur.deadline == 0)
+                continue;
+            if (cur.deadline <= now)
+                expired->push_back(cur.seq);
+            else if (next == 0 || cur.deadline < next)
+                next = cur.deadline;
+        }
+        if (expired->empty())
+        {
+            delete expired;
+            if (next > 0)
+                armDeadline(next);
+            return;
+        }
+        // stale data must not block fresh data, so the whole stream goes
+        deadline_reset_ = true;
+        inflight_.clear();
+        stream_->ResetWithUserCode(deadline_code_);
+        eventloop_->informAboutStreamDeadlineExpired(this, expired, deadline_code_);
+        while (chunks_.size() > 0)
+        {
+            auto cur = chunks_.front();
+            cancelWrite(cur.bufferhandle, cur.len);
+            chunks_.pop_front();
+        }
+    }
+
+    void Http3WTStream::cancelWrite(Nan::Persistent<v8::Object> *handle, size_t len)
+    {
+        eventloop_->informAboutStreamWrite(this, handle, false, releaseBytes(len));
+    }
+
+    void Http3ReadConfig::parseOptions(v8::Local<v8::Object> lobj, Http3ReadConfig &config)
+    {
+        v8::Local<v8::String> lwmProp = Nan::New("lowWaterMark").ToLocalChecked();
+        v8::Local<v8::String> delayProp = Nan::New("maxDelay").ToLocalChecked();
+
+        if (Nan::HasOwnProperty(lobj, lwmProp).FromJust() && !Nan::Get(lobj, lwmProp).IsEmpty())
+        {
+            v8::Local<v8::Value> lwmValue = Nan::Get(lobj, lwmProp).ToLocalChecked();
+            config.low_water_mark = Nan::To<uint32_t>(lwmValue).FromJust();
+        }
+        if (Nan::HasOwnProperty(lobj, delayProp).FromJust() && !Nan::Get(lobj, delayProp).IsEmpty())
+        {
+            // js passes milliseconds
+            v8::Local<v8::Value> delayValue = Nan::Get(lobj, delayProp).ToLocalChecked();
+            config.max_delay_us = static_cast<int64_t>(Nan::To<double>(delayValue).FromJust() * 1000.);
+            if (config.max_delay_us < 0)
+                config.max_delay_us = 0;
+        }
+    }
+
+    bool Http3ReadConfig::parseFraming(v8::Local<v8::Object> lobj, Http3ReadConfig &config,
+                                       const std::string &method)
+    {
+        v8::Local<v8::String> modeProp = Nan::New("mode").ToLocalChecked();
+        v8::Local<v8::String> prefixProp = Nan::New("prefix").ToLocalChecked();
+        v8::Local<v8::String> maxSizeProp = Nan::New("maxMessageSize").ToLocalChecked();
+
+        if (Nan::HasOwnProperty(lobj, modeProp).FromJust() && !Nan::Get(lobj, modeProp).IsEmpty())
+        {
+            Nan::Utf8String mode(Nan::Get(lobj, modeProp).ToLocalChecked());
+            std::string modestr(*mode, mode.length());
+            if (modestr == "none")
+                config.framing = Http3ReadConfig::none;
+            else if (modestr == "lengthPrefixed")
+                config.framing = Http3ReadConfig::lengthPrefixed;
+            else if (modestr == "wholeStream")
+                config.framing = Http3ReadConfig::wholeStream;
+            else
+            {
+                Nan::ThrowError((method + " unknown mode or prefix").c_str());
+                return false;
+            }
+        }
+        if (Nan::HasOwnProperty(lobj, prefixProp).FromJust() && !Nan::Get(lobj, prefixProp).IsEmpty())
+        {
+            Nan::Utf8String prefix(Nan::Get(lobj, prefixProp).ToLocalChecked());
+            std::string prefixstr(*prefix, prefix.length());
+            if (prefixstr == "varint")
+                config.u32_prefix = false;
+            else if (prefixstr == "u32")
+                config.u32_prefix = true;
+            else
+            {
+                Nan::ThrowError((method + " unknown mode or prefix").c_str());
+                return false;
+            }
+        }
+        if (Nan::HasOwnProperty(lobj, maxSizeProp).FromJust() && !Nan::Get(lobj, maxSizeProp).IsEmpty())
+        {
+            // as a double, so that -1 does not wrap to 4 GB
+            Nan::Maybe<double> maxSize = Nan::To<double>(Nan::Get(lobj, maxSizeProp).ToLocalChecked());
+            if (maxSize.IsNothing())
+                return false;
+            if (!(maxSize.FromJust() >= 1. && maxSize.FromJust() <= UINT32_MAX))
+            {
+                Nan::ThrowRangeError((method + " needs a maxMessageSize between 1 and 2^32 - 1").c_str());
+                return false;
+            }
+            config.max_message_size = static_cast<size_t>(maxSize.FromJust());
+        }
+        return true;
+    }
+
+    // reads a length prefix, returns false if it is not complete yet
+    static bool parseLengthPrefix(const char *data, size_t len, bool u32,
+                                  uint64_t *msglen, size_t *prefixlen)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+        if (len == 0)
+            return false;
+        size_t plen = u32 ? 4 : (size_t(1) << (bytes[0] >> 6)); // quic varint, 1, 2, 4 or 8 bytes
+        if (len < plen)
+            return false;
+        uint64_t value = u32 ? bytes[0] : (bytes[0] & 0x3f);
+        for (size_t i = 1; i < plen; i++)
+            value = (value << 8) | bytes[i];
+        *msglen = value;
+        *prefixlen = plen;
+        return true;
     }
 
     void Http3WTStream::doCanRead()
     {
-        if (pause_reading_)
+        if (pause_reading_ || framing_failed_)
             return; // back pressure folks!
         // first figure out if we have readable data
         size_t readable = stream_->ReadableBytes();
         if (readable > 0)
         {
-            // ok create a string obj to hold the data
-            std::string *data = new std::string();
-            data->resize(readable);
-            WebTransportStream::ReadResult result = stream_->Read(&(*data)[0], readable);
-            data->resize(result.bytes_read);
+            // ok create a string obj to hold the data, or append to the pending one
+            if (!pending_read_)
+                pending_read_ = new std::string();
+            size_t offset = pending_read_->size();
+            pending_read_->resize(offset + readable);
+            WebTransportStream::ReadResult result = stream_->Read(&(*pending_read_)[offset], readable);
+            pending_read_->resize(offset + result.bytes_read);
             QUIC_DVLOG(1) << "Attempted reading on WebTransport bidirectional stream "
                           << ", bytes read: " << result.bytes_read;
-            eventloop_->informAboutStreamRead(this, data, result.fin);
+            if (read_config_.framing != Http3ReadConfig::none)
+            {
+                deliverFrames(result.fin);
+                return;
+            }
+            if (result.fin || pending_read_->size() >= read_config_.low_water_mark)
+            {
+                flushRead(result.fin);
+            }
+            else if (read_config_.max_delay_us > 0 && !read_alarm_.registered())
+            {
+                // the first bytes waiting start the clock
+                read_alarm_.Arm(eventloop_->getEpollServer(),
+                                eventloop_->getEpollServer()->ApproximateNowInUsec() + read_config_.max_delay_us);
+            }
         }
     }
 
+    void Http3WTStream::flushRead(bool fin)
+    {
+        read_alarm_.UnregisterIfRegistered();
+        if (!pending_read_ && !fin)
+            return;
+        std::string *data = pending_read_ ? pending_read_ : new std::string();
+        pending_read_ = nullptr;
+        eventloop_->informAboutStreamRead(this, data, fin);
+    }
+
+    void Http3WTStream::finishRead()
+    {
+        if (read_config_.framing == Http3ReadConfig::none)
+        {
+            flushRead(false);
+            return;
+        }
+        if (pending_read_)
+        {
+            delete pending_read_;
+            pending_read_ = nullptr;
+        }
+    }
+
+    void Http3WTStream::deliverFrames(bool fin)
+    {
+        std::string *buf = pending_read_;
+        if (buf && read_config_.framing == Http3ReadConfig::lengthPrefixed)
+        {
+            size_t pos = 0;
+            uint64_t msglen;
+            size_t prefixlen;
+            while (parseLengthPrefix(buf->data() + pos, buf->size() - pos, read_config_.u32_prefix,
+                                     &msglen, &prefixlen))
+            {
+                if (msglen > read_config_.max_message_size)
+                {
+                    framingError(fin);
+                    return;
+                }
+                if (buf->size() - pos - prefixlen < msglen)
+                    break; // wait for the rest
+                if (pos == 0 && prefixlen + msglen == buf->size())
+                {
+                    // the buffer is exactly one message, hand it over without copy
+                    buf->erase(0, prefixlen);
+                    pending_read_ = nullptr;
+                    eventloop_->informAboutStreamRead(this, buf, false);
+                    buf = nullptr;
+                    break;
+                }
+                eventloop_->informAboutStreamRead(this, new std::string(buf->data() + pos + prefixlen, msglen), false);
+                pos += prefixlen + msglen;
+            }
+            if (buf && pos == buf->size())
+            {
+                delete buf;
+                pending_read_ = nullptr;
+            }
+            else if (buf && pos > 0)
+            {
+                buf->erase(0, pos);
+            }
+        }
+        else if (buf && read_config_.framing == Http3ReadConfig::wholeStream &&
+                 buf->size() > read_config_.max_message_size)
+        {
+            framingError(fin);
+            return;
+        }
+
+        if (fin)
+        {
+            if (read_config_.framing == Http3ReadConfig::lengthPrefixed && pending_read_ &&
+                !pending_read_->empty())
+            {
+                // the peer closed the stream in the middle of a message
+                framingError(fin);
+                return;
+            }
+            std::string *data = pending_read_ ? pending_read_ : new std::string();
+            pending_read_ = nullptr;
+            eventloop_->informAboutStreamRead(this, data, true);
+        }
+    }
+
+    void Http3WTStream::framingError(bool fin)
+    {
+        framing_failed_ = true;
+        if (pending_read_)
+        {
+            delete pending_read_;
+            pending_read_ = nullptr;
+        }
+        if (!fin && stream_)
+            stream_->SendStopSending(0);
+        eventloop_->informStreamRecvSignal(this, 0, NetworkTask::framingError);
+    }
+
     void Http3WTStream::doCanWrite()
     {
         /* if (/* stop_sending_received_ || * pause_reading_)
@@ -88,6 +377,12 @@ namespace quic
         while (chunks_.size() > 0)
         {
             auto cur = chunks_.front();
+            if (cur.fence > 0 && fence_ && !fence_->datagramsDone(cur.fence))
+            {
+                // the session calls tryWrite, once the datagrams are out
+                fence_->waitForDatagrams(this);
+                return;
+            }
             bool success = stream_->Write(absl::string_view(cur.buffer, cur.len));
             QUIC_DVLOG(1) << "Attempted writing on WebTransport bidirectional stream "
                           << ", success: " << (success ? "yes" : "no");
@@ -95,8 +390,18 @@ namespace quic
             {
                 return;
             }
-            // now we have to inform the server TODO
-            eventloop_->informAboutStreamWrite(this, cur.bufferhandle, true);
+            bytes_written_ += cur.len;
+            if (cur.deadline > 0)
+            {
+                // still not on the wire, keep an eye on it
+                InflightChunk inflight;
+                inflight.seq = cur.seq;
+                inflight.end = bytes_written_;
+                inflight.deadline = cur.deadline;
+                inflight_.push_back(inflight);
+            }
+            // quiche has taken the data, so the bytes leave our budget
+            eventloop_->informAboutStreamWrite(this, cur.bufferhandle, true, releaseBytes(cur.len));
 
             chunks_.pop_front();
         }
@@ -13,10 +13,15 @@
 
 #include <nan.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
 #include <string>
 
 #include "quiche/common/simple_buffer_allocator.h"
 #include "quiche/quic/core/web_transport_interface.h"
+#include "quiche/quic/core/quic_session.h"
 #include "quiche/quic/platform/api/quic_logging.h"
 #include "quiche/common/quiche_circular_deque.h"
 
@@ -26,13 +31,84 @@ namespace quic
 {
     class Http3EventLoop;
 
-    class Http3WTStream : public Nan::ObjectWrap, public LifetimeHelper
+    // bytes the native side accepts before a stream reports backpressure
+    const int64_t kStreamSendHighWaterMark = 64 * 1024;
+    // urgency quiche uses for http3 streams without priority information
+    const int kDefaultStreamUrgency = 3;
+    // largest message reassembled natively, if not configured otherwise
+    const size_t kDefaultMaxMessageSize = 16 * 1024 * 1024;
+
+    // how a stream hands received data to js, set per stream or as session default
+    struct Http3ReadConfig
+    {
+        enum Framing
+        {
+            none,           // chunks as they arrive, subject to coalescing
+            lengthPrefixed, // exactly one message per event
+            wholeStream     // the whole body in one event at FIN
+        };
+
+        // coalescing, 0 means deliver every read at once
+        size_t low_water_mark = 0;
+        int64_t max_delay_us = 0;
+
+        Framing framing = none;
+        bool u32_prefix = false; // otherwise a quic varint
+        size_t max_message_size = kDefaultMaxMessageSize;
+
+        void applyOptions(const Http3ReadConfig &other)
+        {
+            low_water_mark = other.low_water_mark;
+            max_delay_us = other.max_delay_us;
+        }
+
+        void applyFraming(const Http3ReadConfig &other)
+        {
+            framing = other.framing;
+            u32_prefix = other.u32_prefix;
+            max_message_size = other.max_message_size;
+        }
+
+        // parse the js option objects, run on the js thread
+        static void parseOptions(v8::Local<v8::Object> lobj, Http3ReadConfig &config);
+        // false after throwing, method names the js call in the message
+        static bool parseFraming(v8::Local<v8::Object> lobj, Http3ReadConfig &config, const std::string &method);
+    };
+
+    class Http3WTStream;
+
+    // keeps stream writes behind the datagrams, that js wrote before them
+    // implemented by the session, the sequence numbers count its datagrams
+    class Http3DatagramFence
     {
     public:
-        Http3WTStream(WebTransportStream *stream, Http3EventLoop *eventloop)
-            : stream_(stream), eventloop_(eventloop) {}
+        virtual ~Http3DatagramFence() {}
+
+        // js thread, datagrams written so far
+        virtual uint64_t datagramsIssued() const = 0;
+        // loop thread, true if datagram seq is handed to quiche or dropped
+        virtual bool datagramsDone(uint64_t seq) const = 0;
+        // loop thread, calls tryWrite on the stream, once the fence moves
+        virtual void waitForDatagrams(Http3WTStream *stream) = 0;
+        virtual void cancelWaitForDatagrams(Http3WTStream *stream) = 0;
+    };
 
-        ~Http3WTStream(){/*printf("stream destruct %x\n", this);*/};
+    class Http3WTStream : public Nan::ObjectWrap, public LifetimeHelper
+    {
+    public:
+        Http3WTStream(WebTransportStream *stream, QuicSession *quic_session, Http3EventLoop *eventloop)
+            : stream_(stream), quic_session_(quic_session), eventloop_(eventloop),
+              read_alarm_([this]()
+                          { flushRead(false); }),
+              deadline_alarm_([this]()
+                              { checkDeadlines(); }) {}
+
+        ~Http3WTStream()
+        {
+            /*printf("stream destruct %x\n", this);*/
+            if (pending_read_)
+                delete pending_read_;
+        };
 
         class Visitor : public WebTransportStreamVisitor
         {
@@ -69,6 +145,26 @@ namespace quic
 
         void doCanRead();
 
+        // hands the coalesced data to js
+        void flushRead(bool fin);
+
+        // hands out complete messages, if framing is active
+        void deliverFrames(bool fin);
+
+        // the stream is going away, a partial message is dropped
+        void finishRead();
+
+        void setReadConfig(const Http3ReadConfig &config)
+        {
+            read_config_ = config;
+        }
+
+        // set once on creation, before js sees the stream
+        void setDatagramFence(Http3DatagramFence *fence)
+        {
+            fence_ = fence;
+        }
+
         void doCanWrite();
 
         void doStopReading()
@@ -126,24 +222,163 @@ namespace quic
             }
         }
 
+        static NAN_METHOD(setReadOptions)
+        {
+            Http3WTStream *obj = Nan::ObjectWrap::Unwrap<Http3WTStream>(info.Holder());
+            Http3ReadConfig config;
+
+            if (!info[0]->IsUndefined())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setReadOptions needs an object");
+                Http3ReadConfig::parseOptions(optobj.ToLocalChecked(), config);
+            }
+
+            std::function<void()> task = [obj, config]()
+            {
+                obj->read_config_.applyOptions(config);
+                if (!obj->stream_ || obj->read_config_.framing != Http3ReadConfig::none)
+                    return;
+                // data pending may now fulfill the new thresholds
+                if (obj->pending_read_ && obj->pending_read_->size() >= config.low_water_mark)
+                    obj->flushRead(false);
+            };
+            obj->eventloop_->Schedule(task);
+        }
+
+        static NAN_METHOD(setReadFraming)
+        {
+            Http3WTStream *obj = Nan::ObjectWrap::Unwrap<Http3WTStream>(info.Holder());
+            Http3ReadConfig config;
+
+            if (!info[0]->IsUndefined())
+            {
+                v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
+                v8::MaybeLocal<v8::Object> optobj = info[0]->ToObject(context);
+                if (optobj.IsEmpty())
+                    return Nan::ThrowError("setReadFraming needs an object");
+                if (!Http3ReadConfig::parseFraming(optobj.ToLocalChecked(), config, "setReadFraming"))
+                    return;
+            }
+
+            std::function<void()> task = [obj, config]()
+            {
+                obj->read_config_.applyFraming(config);
+                if (!obj->stream_)
+                    return;
+                obj->read_alarm_.UnregisterIfRegistered();
+                // what is already pending counts as start of the first message
+                if (obj->read_config_.framing != Http3ReadConfig::none)
+                    obj->deliverFrames(false);
+            };
+            obj->eventloop_->Schedule(task);
+        }
+
+        // urgency as in rfc 9218, 0 is sent first, 7 last, others are
+        // clamped, undefined and NaN are the default, false if the
+        // conversion threw
+        static bool urgencyFromValue(v8::Local<v8::Value> value, int *urgency)
+        {
+            *urgency = kDefaultStreamUrgency;
+            if (value->IsUndefined())
+                return true;
+            Nan::Maybe<double> number = Nan::To<double>(value);
+            if (number.IsNothing())
+                return false;
+            if (!std::isnan(number.FromJust()))
+                *urgency = static_cast<int>(std::min(7., std::max(0., number.FromJust())));
+            return true;
+        }
+
+        // a deadline in ms as us, negative, NaN and too large ones are
+        // none (0), false if the conversion threw
+        static bool deadlineFromValue(v8::Local<v8::Value> value, int64_t *deadline)
+        {
+            *deadline = 0;
+            Nan::Maybe<double> number = Nan::To<double>(value);
+            if (number.IsNothing())
+                return false;
+            double us = number.FromJust() * 1000.;
+            if (us > 0. && us < static_cast<double>(std::numeric_limits<int64_t>::max()))
+                *deadline = static_cast<int64_t>(us);
+            return true;
+        }
+
+        static NAN_METHOD(setPriority)
+        {
+            Http3WTStream *obj = Nan::ObjectWrap::Unwrap<Http3WTStream>(info.Holder());
+            int urgency;
+            if (!urgencyFromValue(info[0], &urgency))
+                return; // the exception is pending
+
+            std::function<void()> task = [obj, urgency]()
+            { obj->setPriorityInt(urgency); };
+            obj->eventloop_->Schedule(task);
+        }
+
+        // stream wide deadline for writes, relative to the write, and the reset code
+        static NAN_METHOD(setWriteDeadline)
+        {
+            Http3WTStream *obj = Nan::ObjectWrap::Unwrap<Http3WTStream>(info.Holder());
+            int64_t deadline = 0; // in us, 0 is no deadline
+            WebTransportStreamError code = 0;
+
+            if (!info[0]->IsUndefined() && !deadlineFromValue(info[0], &deadline))
+                return; // the exception is pending
+            if (!info[1]->IsUndefined())
+            {
+                Nan::Maybe<uint32_t> codel = Nan::To<uint32_t>(info[1]);
+                if (codel.IsNothing())
+                    return;
+                code = codel.FromJust();
+            }
+
+            std::function<void()> task = [obj, deadline, code]()
+            {
+                obj->write_deadline_us_ = deadline;
+                obj->deadline_code_ = code;
+            };
+            obj->eventloop_->Schedule(task);
+        }
+
         static NAN_METHOD(writeChunk)
         {
             Http3WTStream *obj = Nan::ObjectWrap::Unwrap<Http3WTStream>(info.Holder());
             // ok we have to get the buffer
             if (!info[0]->IsUndefined())
             {
+                // optional deadline of this write in ms, -1 uses the stream deadline
+                int64_t deadline = -1;
+                if (info.Length() > 1 && !info[1]->IsUndefined() && !deadlineFromValue(info[1], &deadline))
+                    return; // the exception is pending
                 v8::Local<v8::Context> context = info.GetIsolate()->GetCurrentContext();
                 v8::Local<v8::Object> bufferlocal = info[0]->ToObject(context).ToLocalChecked();
                 Nan::Persistent<v8::Object> *bufferHandle = new Nan::Persistent<v8::Object>(bufferlocal);
                 char *buffer = node::Buffer::Data(bufferlocal);
                 size_t len = node::Buffer::Length(bufferlocal);
+                // numbers the writes of the stream, to report which expired
+                uint64_t seq = obj->next_write_seq_++;
+                // the datagrams written before must go out first
+                uint64_t fence = obj->fence_ ? obj->fence_->datagramsIssued() : 0;
+
+                // account the bytes right away, so that js gets a synchronous answer
+                int64_t desired = obj->desired_size_.fetch_sub(len) - len;
 
-                std::function<void()> task = [obj, bufferHandle, buffer, len]()
-                { obj->writeChunkInt(buffer, len, bufferHandle); };
+                std::function<void()> task = [obj, bufferHandle, buffer, len, seq, deadline, fence]()
+                { obj->writeChunkInt(buffer, len, bufferHandle, seq, deadline, fence); };
                 obj->eventloop_->Schedule(task);
+                info.GetReturnValue().Set(Nan::New<v8::Number>(static_cast<double>(desired)));
             }
         }
 
+        static NAN_METHOD(getDesiredSize)
+        {
+            Http3WTStream *obj = Nan::ObjectWrap::Unwrap<Http3WTStream>(info.Holder());
+            info.GetReturnValue().Set(Nan::New<v8::Number>(static_cast<double>(obj->desired_size_.load())));
+        }
+
         static NAN_METHOD(streamFinal)
         {
             Http3WTStream *obj = Nan::ObjectWrap::Unwrap<Http3WTStream>(info.Holder());
@@ -239,6 +474,9 @@ namespace quic
             return myconstr;
         }
 
+        // loop thread
+        void setPriorityInt(int urgency);
+
     protected:
         WebTransportStream *stream() { return stream_; }
 
@@ -247,38 +485,98 @@ namespace quic
             char *buffer;
             size_t len;
             Nan::Persistent<v8::Object> *bufferhandle;
+            uint64_t seq;
+            int64_t deadline; // absolute in us, 0 is none
+            uint64_t fence;   // datagram seq, that must be handed over first
         };
 
-        void writeChunkInt(char *buffer, size_t len, Nan::Persistent<v8::Object> *bufferhandle)
+        // a write with deadline, that is in quiche's send buffer
+        struct InflightChunk
         {
-            if (fin_was_sent_ || send_fin_)
+            uint64_t seq;
+            uint64_t end; // bytes_written_ after this chunk
+            int64_t deadline;
+        };
+
+        void writeChunkInt(char *buffer, size_t len, Nan::Persistent<v8::Object> *bufferhandle,
+                           uint64_t seq, int64_t deadline, uint64_t fence)
+        {
+            if (fin_was_sent_ || send_fin_ || deadline_reset_)
             {
-                cancelWrite(bufferhandle);
+                cancelWrite(bufferhandle, len);
                 return;
             }
             if (!stream_)
             {
-                cancelWrite(bufferhandle);
+                cancelWrite(bufferhandle, len);
                 return;
             }
+            if (deadline < 0)
+                deadline = write_deadline_us_;
             WChunks cur;
             cur.buffer = buffer;
             cur.len = len;
             cur.bufferhandle = bufferhandle;
+            cur.seq = seq;
+            cur.fence = fence;
+            cur.deadline = deadline > 0 ? eventloop_->NowInUsec() + deadline : 0;
             chunks_.push_back(cur);
+            if (cur.deadline > 0)
+                armDeadline(cur.deadline);
             tryWrite();
         }
 
-        void cancelWrite(Nan::Persistent<v8::Object> *handle);
+        void armDeadline(int64_t deadline)
+        {
+            if (!deadline_alarm_.registered() || deadline < next_deadline_)
+            {
+                next_deadline_ = deadline;
+                deadline_alarm_.Arm(eventloop_->getEpollServer(), deadline);
+            }
+        }
+
+        // drops writes, that quiche has sent, from the inflight list
+        void pruneInflight();
+
+        // resets the stream, if a write missed its deadline
+        void checkDeadlines();
+
+        void cancelWrite(Nan::Persistent<v8::Object> *handle, size_t len);
+
+        // a message broke the framing rules, stop reading and tell js
+        void framingError(bool fin);
+
+        // returns the bytes of a chunk, that left the native queue, to the budget
+        int64_t releaseBytes(size_t len)
+        {
+            return desired_size_.fetch_add(len) + len;
+        }
 
     private:
         WebTransportStream *stream_;
+        QuicSession *quic_session_; // unowned, used to reach the scheduler of quiche
         Http3EventLoop *eventloop_;
         bool send_fin_ = false;
         bool fin_was_sent_ = false;
         bool stop_sending_received_ = false;
         bool pause_reading_ = false;
+        Http3ReadConfig read_config_;
+        bool framing_failed_ = false;
+        std::string *pending_read_ = nullptr; // coalesced data or partial messages
+        Http3LoopAlarm read_alarm_;
         std::deque<WChunks> chunks_;
+        Http3DatagramFence *fence_ = nullptr; // unowned, the session
+        // partial reliability, writes which are not delivered in time reset the stream
+        int64_t write_deadline_us_ = 0;
+        WebTransportStreamError deadline_code_ = 0;
+        bool deadline_reset_ = false;
+        int64_t next_deadline_ = 0;
+        uint64_t bytes_written_ = 0; // handed to quiche
+        uint64_t next_write_seq_ = 0; // js thread only
+        std::deque<InflightChunk> inflight_;
+        Http3LoopAlarm deadline_alarm_;
+        // high water mark minus bytes queued natively, written from js thread and event loop
+        std::atomic<int64_t> desired_size_{kStreamSendHighWaterMark};
     };
 }
 
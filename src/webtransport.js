@@ -20,6 +20,15 @@ if (
 
 const wtrouter = require(wtpath)
 
+// quiche schedules by http3 urgency (0 first, 7 last, 3 default), so
+// sendOrder (higher first) is folded into these eight levels
+function sendOrderToUrgency(sendOrder) {
+  if (sendOrder === null || typeof sendOrder === 'undefined') return 3
+  const order = Math.trunc(Number(sendOrder))
+  if (Number.isNaN(order)) return 3
+  return 3 - Math.max(-4, Math.min(3, order))
+}
+
 class Http3WTStream {
   constructor(args) {
     this.objint = args.object
@@ -66,6 +75,8 @@ class Http3WTStream {
       )
     }
     if (this.bidirectional || !this.incoming) {
+      // the native side accounts queued bytes, so we size our queue in bytes, too
+      const sendHighWaterMark = this.objint.getDesiredSize()
       this.writable = new WritableStream(
         {
           start: (controller) => {
@@ -76,14 +87,21 @@ class Http3WTStream {
             if (this.writableclosed) {
               return Promise.resolve()
             }
+            // a chunk may carry its own deadline: { data, deadline }
+            let deadline
+            if (!(chunk instanceof Uint8Array) && chunk && chunk.data) {
+              deadline = chunk.deadline
+              chunk = chunk.data
+            }
             if (chunk instanceof Uint8Array) {
               this.pendingoperation = new Promise((res, rej) => {
                 this.pendingres = res
               })
-              const dataprom = this.parentobj.waitForDatagramsSend()
-              dataprom.finally(() => {
-                this.objint.writeChunk(chunk)
-              })
+              // datagrams written before are sent first, the native
+              // side keeps the chunk behind them
+              const desiredSize = this.objint.writeChunk(chunk, deadline)
+              // resolve early, if there is still room in the native queue
+              if (desiredSize > 0) this.resolvePendingWrite()
               return this.pendingoperation
             } else throw new Error('chunk is not of instanceof Uint8Array ')
           },
@@ -92,10 +110,10 @@ class Http3WTStream {
               return Promise.resolve()
             }
             this.objint.streamFinal()
-            this.pendingoperation = new Promise((res, rej) => {
-              this.pendingres = res
+            // writes may still be reported, so close waits on its own promise
+            return new Promise((res, rej) => {
+              this.pendingcloseres = res
             })
-            return this.pendingoperation
           },
           abort: (reason) => {
             if (this.writableclosed) {
@@ -116,11 +134,51 @@ class Http3WTStream {
             return promise
           }
         },
-        { highWaterMark: 4 }
+        {
+          highWaterMark: sendHighWaterMark,
+          size: (chunk) =>
+            chunk instanceof Uint8Array
+              ? chunk.byteLength
+              : (chunk.data && chunk.data.byteLength) || 0
+        }
       )
     }
   }
 
+  // coalesce reads natively: deliver once lowWaterMark bytes are pending,
+  // after maxDelay milliseconds or at FIN, whatever comes first
+  setReadOptions({ lowWaterMark = 0, maxDelay = 0 } = {}) {
+    if (this.readable) this.objint.setReadOptions({ lowWaterMark, maxDelay })
+  }
+
+  // higher sendOrder is sent first, see sendOrderToUrgency
+  setSendOrder(sendOrder) {
+    this.sendOrder = sendOrder
+    if (this.writable) this.objint.setPriority(sendOrderToUrgency(sendOrder))
+  }
+
+  // partial reliability: if a write is not sent within deadline
+  // milliseconds, the stream is reset with code, 0 disables it
+  // single writes may override it with { data, deadline } chunks
+  setWriteDeadline({ deadline = 0, code = 0 } = {}) {
+    if (this.writable) this.objint.setWriteDeadline(deadline, code)
+  }
+
+  // direct access to the http3 urgency, 0 (first) to 7 (last)
+  setUrgency(urgency) {
+    if (this.writable) this.objint.setPriority(urgency)
+  }
+
+  // let the native side reassemble messages, mode is 'lengthPrefixed'
+  // (prefix 'varint' or 'u32') or 'wholeStream', 'none' switches it off
+  setReadFraming({ mode = 'none', prefix = 'varint', maxMessageSize } = {}) {
+    if (!this.readable) return
+    const framing = { mode, prefix }
+    if (typeof maxMessageSize !== 'undefined')
+      framing.maxMessageSize = maxMessageSize
+    this.objint.setReadFraming(framing)
+  }
+
   onStreamRecvSignal(args) {
     // console.log('onStreamRecvSignal', args)
     // check if transport is closed
@@ -149,16 +207,24 @@ class Http3WTStream {
           this.writableController.error(args.code || 0)
         } else console.log('stopSending wihtout writable')
         break
+      case 'framingError':
+        if (this.readable) {
+          this.parentobj.removeReceiveStream(
+            this.readable,
+            this.readableController
+          )
+          this.readableclosed = true
+          this.readableController.error(
+            new Error('Stream data violates the configured framing')
+          )
+        }
+        break
       default:
         console.log('unhandled onStreamRecvSignal')
     }
 
-    if (this.pendingoperation) {
-      const res = this.pendingres
-      this.pendingoperation = null
-      this.pendingres = null
-      res()
-    }
+    this.resolvePendingWrite()
+    this.resolvePendingClose()
   }
 
   onStreamRead(args) {
@@ -172,8 +238,15 @@ class Http3WTStream {
     }
   }
 
-  onStreamWrite(args) {
-    // we ignore success
+  resolvePendingClose() {
+    if (this.pendingcloseres) {
+      const res = this.pendingcloseres
+      this.pendingcloseres = null
+      res()
+    }
+  }
+
+  resolvePendingWrite() {
     if (this.pendingoperation) {
       const res = this.pendingres
       this.pendingoperation = null
@@ -182,6 +255,26 @@ class Http3WTStream {
     }
   }
 
+  onStreamWrite(args) {
+    // we ignore success, a write waits only for room in the native queue
+    // the reported size may be stale, if js queued more in the meantime
+    if (args.desiredSize > 0 && this.objint.getDesiredSize() > 0)
+      this.resolvePendingWrite()
+  }
+
+  onStreamDeadlineExpired(args) {
+    // writes are numbered from 0 in the order they reached writeChunk
+    if (this.onDeadlineExpired)
+      this.onDeadlineExpired({ writes: args.writes, code: args.code })
+    if (this.writable && !this.writableclosed) {
+      this.parentobj.removeSendStream(this.writable, this.writableController)
+      this.writableclosed = true
+      this.writableController.error(new Error('Write deadline expired'))
+    }
+    this.resolvePendingWrite()
+    this.resolvePendingClose()
+  }
+
   onStreamReset(args) {
     if (this.abortres) {
       this.abortres()
@@ -221,12 +314,7 @@ class Http3WTStream {
 
       case "streamFinal":
         {
-          if (this.pendingoperation) {
-            const res = this.pendingres
-            this.pendingoperation = null
-            this.pendingres = null
-            res()
-          }
+          this.resolvePendingClose()
         } break
       default:
         console.log('onStreamNetworkFinish unknown task')
@@ -272,6 +360,11 @@ class Http3WTStream {
             visitor.onStreamNetworkFinish(args)
           }
           break
+        case 'StreamDeadlineExpired':
+          {
+            visitor.onStreamDeadlineExpired(args)
+          }
+          break
         default: {
           throw new Error('unknown purpose Streamcb')
         }
@@ -311,9 +404,61 @@ class Http3WTSession {
     })
 
     this.datagrams = {}
-    this.datagrams.readable = new ReadableStream({
-      start: (controller) => {
-        this.incomDatagramController = controller
+    // received datagrams wait here, so that they can expire before a read
+    this.incomDatagrams = []
+    this.incomDatagramPull = false
+    this.incomingMaxAge = null
+    // datagrams js asks for in advance, the rest waits natively
+    this.incomingHighWaterMark = 64
+    this.datagramCredit = 0
+    this.datagramsExpiredIncoming = 0
+    this.datagramOptions = {}
+    this.incomingDatagramOptions = {}
+    this.datagramFeedback = null
+    this.datagramFec = null
+    this.datagramFragmentation = null
+    this.datagrams.readable = new ReadableStream(
+      {
+        start: (controller) => {
+          this.incomDatagramController = controller
+        },
+        pull: (controller) => {
+          if (!this.deliverDatagram()) this.incomDatagramPull = true
+          this.requestDatagrams()
+        }
+      },
+      { highWaterMark: 0 }
+    )
+    Object.defineProperties(this.datagrams, {
+      // in ms, null is infinite
+      incomingMaxAge: {
+        get: () => this.incomingMaxAge,
+        set: (value) => {
+          this.incomingMaxAge = value
+          this.setIncomingDatagramOptions({ maxAge: value })
+        }
+      },
+      incomingHighWaterMark: {
+        get: () => this.incomingHighWaterMark,
+        set: (value) => {
+          this.incomingHighWaterMark = Math.max(1, value)
+        }
+      },
+      outgoingMaxAge: {
+        get: () =>
+          typeof this.datagramOptions.outgoingMaxAge === 'undefined'
+            ? null
+            : this.datagramOptions.outgoingMaxAge,
+        set: (value) => this.setDatagramOptions({ outgoingMaxAge: value })
+      },
+      // outgoing datagrams queued natively, beyond it the oldest are dropped
+      outgoingHighWaterMark: {
+        get: () =>
+          typeof this.datagramOptions.outgoingHighWaterMark === 'undefined'
+            ? 64
+            : this.datagramOptions.outgoingHighWaterMark,
+        set: (value) =>
+          this.setDatagramOptions({ outgoingHighWaterMark: value })
       }
     })
     this.writeDatagramRes = []
@@ -331,7 +476,7 @@ class Http3WTSession {
             this.writeDatagramRej.push(rej)
           })
           this.writeDatagramProm.push(ret)
-          this.objint.writeDatagram(chunk)
+          this.objint.writeDatagrams([chunk])
           return ret
         } else throw new Error('chunk is not of type Uint8Array')
       },
@@ -344,6 +489,8 @@ class Http3WTSession {
     this.resolveUniDi = []
     this.rejectBiDi = []
     this.rejectUniDi = []
+    this.optionsBiDi = []
+    this.optionsUniDi = []
 
     this.sendStreams = new Set()
     this.receiveStreams = new Set()
@@ -357,17 +504,130 @@ class Http3WTSession {
     if (object) {
       this.objint = object
       this.objint.jsobj = this
+      if (this.streamReadOptions)
+        this.objint.setStreamReadOptions(this.streamReadOptions)
+      if (this.streamReadFraming)
+        this.objint.setStreamReadFraming(this.streamReadFraming)
+      if (Object.keys(this.datagramOptions).length > 0)
+        this.objint.setDatagramOptions(this.datagramOptions)
+      if (Object.keys(this.incomingDatagramOptions).length > 0)
+        this.objint.setIncomingDatagramOptions(this.incomingDatagramOptions)
+      if (this.incomDatagramPull) this.requestDatagrams()
+      if (this.datagramFeedback) this.objint.setDatagramFeedback(true)
+      if (this.datagramFec) this.objint.setDatagramFec(this.datagramFec)
+      if (this.datagramFragmentation)
+        this.objint.setDatagramFragmentation(this.datagramFragmentation)
     }
   }
 
-  async waitForDatagramsSend() {
-    while (this.writeDatagramProm.length > 0) {
-      try {
-        await Promise.allSettled(this.writeDatagramProm)
-      } catch (error) {
-        console.log('datagram promise failed ', error)
+  // handler({ acked, lost }) is called with the datagrams quic acknowledged
+  // or declared lost, each entry is { id, sendTime, elapsed } in ms, the ids
+  // count the datagrams written on this session from 1, streams and
+  // writeDatagrams alike; datagrams sent through a group are not reported
+  setDatagramFeedback(handler) {
+    this.datagramFeedback = handler || null
+    if (this.objint) this.objint.setDatagramFeedback(!!this.datagramFeedback)
+  }
+
+  // limits of the native queue, which holds datagrams js has not pulled:
+  // maxCount, maxBytes, policy 'drop-oldest' (default) or 'drop-newest'
+  setIncomingDatagramOptions(options) {
+    const cur = {}
+    for (const key of ['maxCount', 'maxBytes', 'policy', 'maxAge'])
+      if (typeof options[key] !== 'undefined') cur[key] = options[key]
+    this.incomingDatagramOptions = { ...this.incomingDatagramOptions, ...cur }
+    if (this.objint) this.objint.setIncomingDatagramOptions(cur)
+  }
+
+  // tops up the native credit, so that at most incomingHighWaterMark
+  // datagrams are on their way or waiting in js
+  requestDatagrams() {
+    if (!this.objint || this.state === 'closed') return
+    const want =
+      this.incomingHighWaterMark -
+      this.incomDatagrams.length -
+      this.datagramCredit
+    if (want > 0) {
+      this.datagramCredit += want
+      this.objint.pullDatagrams(want)
+    }
+  }
+
+  // forward error correction for datagrams, both peers must use the same
+  // { sources, repairs, delay }: after sources datagrams (default 8) or delay
+  // ms (default 10) repairs datagrams (default 2) follow, which restore lost
+  // ones; every datagram grows by 5 bytes and the repairs are 7 bytes
+  // larger than the largest datagram of their group, so datagrams within 7
+  // bytes of the maximum datagram size are dropped, null switches it off
+  setDatagramFec(options) {
+    this.datagramFec = options ? { ...options } : null
+    if (this.objint) this.objint.setDatagramFec(this.datagramFec)
+  }
+
+  // datagrams larger than the path allows are split into fragments and only
+  // delivered, if all arrive, both peers must use it with the same settings:
+  // { maxMessageSize (bytes, default 256 KiB), timeout (ms, default 1000) for
+  // incomplete messages, maxBytes (default 4 MiB) for all incomplete ones },
+  // every datagram grows by 1 byte and fragments by 9, null switches it off
+  setDatagramFragmentation(options) {
+    this.datagramFragmentation = options ? { ...options } : null
+    if (this.objint)
+      this.objint.setDatagramFragmentation(this.datagramFragmentation)
+  }
+
+  setDatagramOptions(options) {
+    const cur = {}
+    if (typeof options.outgoingMaxAge !== 'undefined')
+      cur.outgoingMaxAge = options.outgoingMaxAge
+    if (typeof options.outgoingHighWaterMark !== 'undefined')
+      cur.outgoingHighWaterMark = options.outgoingHighWaterMark
+    this.datagramOptions = { ...this.datagramOptions, ...cur }
+    if (this.objint) this.objint.setDatagramOptions(cur)
+  }
+
+  getStats() {
+    const datagrams = this.objint
+      ? this.objint.getDatagramStats()
+      : {
+          sent: 0,
+          expiredOutgoing: 0,
+          droppedOutgoing: 0,
+          droppedIncoming: 0,
+          expiredIncoming: 0,
+          fecRepairsSent: 0,
+          fecRepairsReceived: 0,
+          fecRecovered: 0,
+          fecLost: 0,
+          messagesReassembled: 0,
+          messagesDroppedIncoming: 0
+        }
+    datagrams.expiredIncoming += this.datagramsExpiredIncoming
+    return Promise.resolve({ datagrams })
+  }
+
+  // when the connection setup reached { start, sessionCreated, signStart,
+  // signDone, encrypted, handshakeComplete, settings, connect, response },
+  // in ms since its start (first chlo on the server, connecting on the
+  // client); connect and response belong to this session's request, points
+  // the side does not know or has not reached yet are left out
+  getHandshakeTiming() {
+    if (!this.objint) return null
+    return this.objint.getHandshakeTiming()
+  }
+
+  // enqueues the oldest datagram, that is still fresh, returns false if none
+  deliverDatagram() {
+    const now = performance.now()
+    while (this.incomDatagrams.length > 0) {
+      const cur = this.incomDatagrams.shift()
+      if (this.incomingMaxAge && now - cur.time > this.incomingMaxAge) {
+        this.datagramsExpiredIncoming++
+        continue
       }
+      this.incomDatagramController.enqueue(cur.data)
+      return true
     }
+    return false
   }
 
   addStreamObj(stream) {
@@ -398,22 +658,69 @@ class Http3WTSession {
     this.receiveStreamsController.delete(controller)
   }
 
-  createBidirectionalStream() {
-    const prom = new Promise((res, rej) => {
+  createBidirectionalStream(options = {}) {
+    // the stream starts with its priority, before the first write, a bad
+    // urgency throws here, before anything waits for the stream
+    this.objint.orderBidiStream(Http3WTSession.optionsUrgency(options))
+    this.optionsBiDi.push(options)
+    return new Promise((res, rej) => {
       this.resolveBiDi.push(res)
       this.rejectBiDi.push(rej)
     })
-    this.objint.orderBidiStream()
-    return prom
   }
 
-  createUnidirectionalStream() {
-    const prom = new Promise((res, rej) => {
+  createUnidirectionalStream(options = {}) {
+    // the stream starts with its priority, before the first write, a bad
+    // urgency throws here, before anything waits for the stream
+    this.objint.orderUnidiStream(Http3WTSession.optionsUrgency(options))
+    this.optionsUniDi.push(options)
+    return new Promise((res, rej) => {
       this.resolveUniDi.push(res)
       this.rejectUniDi.push(rej)
     })
-    this.objint.orderUnidiStream()
-    return prom
+  }
+
+  static optionsUrgency(options) {
+    if (typeof options.urgency !== 'undefined') return options.urgency
+    if (options.sendOrder !== null && typeof options.sendOrder !== 'undefined')
+      return sendOrderToUrgency(options.sendOrder)
+    return undefined
+  }
+
+  applyStreamOptions(strobj, options) {
+    if (typeof options.urgency !== 'undefined') strobj.setUrgency(options.urgency)
+    else if (
+      options.sendOrder !== null &&
+      typeof options.sendOrder !== 'undefined'
+    )
+      strobj.setSendOrder(options.sendOrder)
+  }
+
+  // sends a burst of datagrams with one native call, the data is copied,
+  // so the arrays may be reused right away, resolves once all are handed over
+  writeDatagrams(datagrams) {
+    if (this.state === 'closed')
+      return Promise.reject(new Error('Session is closed'))
+    if (!this.objint) return Promise.reject(new Error('Session is not ready'))
+    // throws on malformed input, before we wait for a completion
+    this.objint.writeDatagrams(datagrams)
+    const ret = new Promise((res, rej) => {
+      this.writeDatagramRes.push(res)
+      this.writeDatagramRej.push(rej)
+    })
+    this.writeDatagramProm.push(ret)
+    return ret
+  }
+
+  // read options and framing applied to every stream created after the call
+  setStreamReadOptions(options) {
+    this.streamReadOptions = options
+    if (this.objint) this.objint.setStreamReadOptions(options)
+  }
+
+  setStreamReadFraming(framing) {
+    this.streamReadFraming = framing
+    if (this.objint) this.objint.setStreamReadFraming(framing)
   }
 
   close(closeInfo) {
@@ -445,9 +752,13 @@ class Http3WTSession {
     this.resolveUniDi = []
     this.rejectBiDi = []
     this.rejectUniDi = []
+    this.optionsBiDi = []
+    this.optionsUniDi = []
 
     this.incomBiDiController.close()
     this.incomUniDiController.close()
+    // what is still fresh may be read after the close
+    while (this.deliverDatagram()) {}
     this.incomDatagramController.close()
     // this.outgoDatagramController.error(errorcode)
     this.state = 'closed'
@@ -489,20 +800,41 @@ class Http3WTSession {
         if (this.resolveBiDi.length === 0)
           throw new Error('Got bidirectional stream without asking for it')
         this.rejectBiDi.shift()
+        this.applyStreamOptions(strobj, this.optionsBiDi.shift())
         const curres = this.resolveBiDi.shift()
         curres(strobj)
       } else {
         if (this.resolveUniDi.length === 0)
           throw new Error('Got unidirectional stream without asking for it')
         this.rejectUniDi.shift()
+        this.applyStreamOptions(strobj, this.optionsUniDi.shift())
         const curres = this.resolveUniDi.shift()
         curres(strobj.writable)
       }
     }
   }
 
-  onDatagramReceived(args) {
-    this.incomDatagramController.enqueue(args.datagram)
+  onDatagramsReceived(args) {
+    if (this.state === 'closed') return
+    // all datagrams of one loop iteration share one buffer
+    const batch = args.datagrams
+    const time = performance.now()
+    this.datagramCredit = Math.max(0, this.datagramCredit - args.lengths.length)
+    let offset = 0
+    for (const length of args.lengths) {
+      this.incomDatagrams.push({
+        data: batch.subarray(offset, offset + length),
+        time
+      })
+      offset += length
+    }
+    if (this.incomDatagramPull && this.deliverDatagram())
+      this.incomDatagramPull = false
+  }
+
+  onDatagramFeedback(args) {
+    if (this.state === 'closed' || !this.datagramFeedback) return
+    this.datagramFeedback({ acked: args.acked, lost: args.lost })
   }
 
   onDatagramSend(args) {
@@ -530,10 +862,15 @@ class Http3WTSession {
             visitor.onClose(args.errorcode, args.error)
           }
           break
-        case 'DatagramReceived':
+        case 'DatagramsReceived':
           {
-            if (visitor && args.hasOwnProperty('datagram'))
-              visitor.onDatagramReceived(args)
+            if (visitor && args.hasOwnProperty('datagrams'))
+              visitor.onDatagramsReceived(args)
+          }
+          break
+        case 'DatagramFeedback':
+          {
+            if (visitor) visitor.onDatagramFeedback(args)
           }
           break
         case 'DatagramSend':
@@ -611,7 +948,55 @@ export class Http3Server extends Http3WebTransport {
     this.stopped = true
   }
 
-  sessionStream(path) {
+  // { signingThreads, signingQueue, signatures, signingLatencyAvg,
+  // signingLatencyMax }, latencies in ms from the request to the signature,
+  // certificates and certificateUpdates, certificate compression and ticket
+  // counters, early data sessions taken and refused with 425, chlosPending, chlosAccepted, chlosRetried,
+  // chlosDropped, the loopUtilization (0 to 1) and the chloBudget of new
+  // sessions per socket event derived from it, the sourcesTracked,
+  // handshakesThrottled and sourcesThrottled by the per source rate limit
+  // and rateLimitEvictions of the least recently seen sources
+  getHandshakeStats() {
+    return this.transportInt.getHandshakeStats()
+  }
+
+  // histograms { count, avg, p50, p90, p99, max } in ms of the phases of
+  // the connection setup: queue (first chlo to session), signing,
+  // handshake (session to handshake complete), total (first chlo to
+  // handshake complete), connect (handshake complete to the first CONNECT,
+  // 0 in 0-rtt) and decision (CONNECT to its answer)
+  getHandshakeTimings() {
+    return this.transportInt.getHandshakeTimings()
+  }
+
+  // session ticket keys (Uint8Arrays of at least 16 bytes), the first one
+  // encrypts, the others are still accepted, pass the same keys to all
+  // processes, so that they resume each other's sessions; rotate by
+  // putting a new key in front and dropping the oldest
+  // until it is called, the secret is the only key
+  // with earlyData, the replay filter belongs to one process, so only the
+  // process that issued a ticket takes its early data, the others resume
+  // without it (ticketsForeign in getHandshakeStats)
+  setTicketKeys(keys) {
+    this.transportInt.setTicketKeys(keys)
+  }
+
+  // adds or replaces a certificate at runtime, { cert, privKey, serverNames },
+  // pem strings like the constructor's; serverNames (e.g. ['example.com',
+  // '*.example.com']) select it by sni, without them it replaces the
+  // default certificate; only new handshakes see it, running sessions stay
+  setCertificate(options) {
+    this.transportInt.setCertificate(options)
+  }
+
+  removeCertificate(serverName) {
+    this.transportInt.removeCertificate(serverName)
+  }
+
+  // options: { earlyData }, earlyData takes sessions opened in 0-rtt
+  // (needs earlyData on the server), only for paths, whose session
+  // setup does no harm, if an attacker replays it
+  sessionStream(path, options = {}) {
     if (path in this.sessionStreams) {
       return this.sessionsStreams[path]
     }
@@ -620,7 +1005,7 @@ export class Http3Server extends Http3WebTransport {
         this.sessionController[path] = controller
       }
     })
-    this.transportInt.addPath(path)
+    this.transportInt.addPath(path, !!options.earlyData)
     return this.sessionStreams[path]
   }
 
@@ -651,18 +1036,62 @@ export class Http3Server extends Http3WebTransport {
 }
 
 class Http3Client extends Http3WebTransport {
+  // clients with allowPooling by origin and certificate hashes
+  static pool = new Map()
+
   constructor(args) {
     super(args, 'client')
 
-    this.sessionobj = new Promise((resolve, reject) => {
-      this.sessionProm = { resolve, reject }
-    }).catch(() => {}) // add default handler if no one cares
-    this.sessionobjint = null
+    // sessions wait for the native side in the order of their CONNECTs
+    this.pendingSessions = []
     this.closeHookSession = this.closeHookSession.bind(this)
 
+    if (args.allowPooling) {
+      this.pooled = true
+      // an early session has to settle first, it is answered out of order
+      this.poolReady = !args.earlyPath
+      this.poolKey = Http3Client.poolKey(args)
+      if (!Http3Client.pool.has(this.poolKey))
+        Http3Client.pool.set(this.poolKey, new Set())
+      Http3Client.pool.get(this.poolKey).add(this)
+    }
+
     this.handleConnection()
   }
 
+  static poolKey(args) {
+    const hashes = (args.serverCertificateHashes || [])
+      .map(
+        (hash) => hash.algorithm + ':' + Buffer.from(hash.value).toString('hex')
+      )
+      .sort()
+    return [args.hostname, args.port, args.localPort || 0, ...hashes].join('|')
+  }
+
+  // a connected client of the origin with room for one more session, the
+  // session is counted already, null if a new connection is needed
+  static fromPool(args) {
+    const clients = Http3Client.pool.get(Http3Client.poolKey(args))
+    if (!clients) return null
+    for (const client of clients) {
+      if (
+        client.poolReady &&
+        !client.stopped &&
+        client.transportInt.reservePooledSession()
+      )
+        return client
+    }
+    return null
+  }
+
+  leavePool() {
+    if (!this.pooled) return
+    const clients = Http3Client.pool.get(this.poolKey)
+    if (!clients) return
+    clients.delete(this)
+    if (clients.size === 0) Http3Client.pool.delete(this.poolKey)
+  }
+
   async handleConnection() {
     this.quicconnected = new Promise((resolve, reject) => {
       this.quicconnectedProm = { resolve, reject }
@@ -689,29 +1118,45 @@ class Http3Client extends Http3WebTransport {
   }
 
   async createWTSession(sessionobj, path) {
-    // TODO
     try {
       await this.webtransport // wait for webtransport support
-      // ok now we open the session
-      this.sessionobjint = sessionobj
-      this.transportInt.openWTSession(path)
-      console.log('wait for session')
-      // we wait for a new session
-      const sessobj = await this.sessionobj
-
-      delete this.sessionobj
-
+      // ok now we open the session and wait for it
+      const sessobj = await new Promise((resolve, reject) => {
+        this.pendingSessions.push({ sessionobj, resolve, reject })
+        this.transportInt.openWTSession(path)
+      })
       return sessobj
     } catch (error) {
       throw new Error('createWTSession failed ' + error)
     }
   }
 
+  // with earlyPath the native side opens the session by itself, in 0-rtt
+  // when it resumes, and replays it after the handshake, if the server
+  // answers 425, so we only wait for it
+  async earlyWTSession(sessionobj) {
+    const sessobj = await new Promise((resolve, reject) => {
+      this.pendingSessions.push({ sessionobj, resolve, reject })
+    })
+    if (!sessobj) throw new Error('early session failed')
+    this.poolReady = true
+    return sessobj
+  }
+
+  // a pooled connection stays, until its last session is gone
   closeHookSession() {
+    if (this.pooled && !this.transportInt.releasePooledSession()) return
+    this.leavePool()
     this.transportInt.closeClient()
     this.stopped = true
   }
 
+  rejectPendingSessions(error) {
+    const pending = this.pendingSessions
+    this.pendingSessions = []
+    for (const session of pending) session.reject(error)
+  }
+
   customCallback(args) {
     // console.log('incoming callback custom client', args)
     if (args.purpose) {
@@ -720,10 +1165,15 @@ class Http3Client extends Http3WebTransport {
           {
             if (this.quicconnectedProm) {
               if (args.success) this.quicconnectedProm.resolve()
-              else
+              else {
                 this.quicconnectedProm.reject(
                   new Error('Connecting quic client failed')
                 )
+                this.leavePool()
+                this.rejectPendingSessions(
+                  new Error('Connecting quic client failed')
+                )
+              }
             } else throw new Error('Client connected with no pending promise')
           }
           break
@@ -738,16 +1188,27 @@ class Http3Client extends Http3WebTransport {
         case 'Http3WTSessionVisitor':
           {
             // create Http3 Visitor
-            if (args.session && this.sessionProm && this.sessionobjint) {
-              this.sessionobjint.setSessionObj(args.session)
+            const pending = this.pendingSessions.shift()
+            if (!pending)
+              throw new Error('Http3WTSessionVisitor without pending session')
+            if (args.session) {
+              pending.sessionobj.setSessionObj(args.session)
               args.session.jsobj.closeHook = this.closeHookSession
-              delete this.sessionobjint
-              this.sessionProm.resolve(args.session)
-              delete this.sessionProm
-            } else
-              throw new Error(
-                'Http3WTSessionVisitor no object session or nor sessionprom'
-              )
+              pending.resolve(args.session)
+            } else {
+              // the failed session does not hold the connection
+              const last =
+                this.pooled && this.transportInt.releasePooledSession()
+              if (last) {
+                this.leavePool()
+                this.transportInt.closeClient()
+                this.stopped = true
+              }
+              // refused for the other sessions on the connection, null
+              // lets the session try a new connection
+              if (args.refused && this.pooled && !last) pending.resolve(null)
+              else pending.reject(new Error('Opening session failed'))
+            }
           }
           break
 
@@ -770,7 +1231,28 @@ export class WebTransport {
     let port = ourl.port
     if (port == '') port = 443
 
-    this.client = new Http3Client({ hostname, port, ...args })
+    // allowPooling: the session shares the connection with other pooled
+    // sessions to the origin, maxPooledSessions (100) caps them per
+    // connection, a session the server refuses with 429 closes the
+    // connection for new ones and goes to a new connection itself
+    this.clientArgs = { hostname, port, ...args }
+    const pooled = args?.allowPooling
+      ? Http3Client.fromPool(this.clientArgs)
+      : null
+    // earlyData: the session request goes in 0-rtt, when a ticket of an
+    // earlier connection to the server is in the session cache, a pooled
+    // connection does not need it
+    this.earlyData = !!args?.earlyData && !pooled
+    if (pooled) this.client = pooled
+    else if (this.earlyData)
+      this.client = new Http3Client({
+        hostname,
+        port,
+        sessionCache: true,
+        ...args,
+        earlyPath: ourl.pathname
+      })
+    else this.client = new Http3Client(this.clientArgs)
 
     this.sessionint = new Http3WTSession({
       /* object: args.session,*/
@@ -793,11 +1275,23 @@ export class WebTransport {
 
   async establishSession() {
     try {
-      await this.client.quicconnected
-      const session = await this.client.createWTSession(
-        this.sessionint,
-        this.urlint.pathname
-      )
+      if (this.earlyData) {
+        await this.client.earlyWTSession(this.sessionint)
+        return
+      }
+      for (;;) {
+        await this.client.quicconnected
+        const session = await this.client.createWTSession(
+          this.sessionint,
+          this.urlint.pathname
+        )
+        if (session) break
+        // refused on a pooled connection, the caller does not notice
+        this.client =
+          Http3Client.fromPool(this.clientArgs) ||
+          new Http3Client(this.clientArgs)
+        this.sessionint.parentobj = this.client
+      }
     } catch (error) {
       this.sessionint.readyReject(
         new Error('Establishing session failed ' + error)
@@ -810,17 +1304,91 @@ export class WebTransport {
     return this.sessionint.close(closeinfo)
   }
 
-  createBidirectionalStream() {
-    return this.sessionint.createBidirectionalStream()
+  createBidirectionalStream(options) {
+    return this.sessionint.createBidirectionalStream(options)
+  }
+
+  createUnidirectionalStream(options) {
+    return this.sessionint.createUnidirectionalStream(options)
+  }
+
+  writeDatagrams(datagrams) {
+    return this.sessionint.writeDatagrams(datagrams)
+  }
+
+  getStats() {
+    return this.sessionint.getStats()
   }
 
-  createUnidirectionalStream() {
-    return this.sessionint.createUnidirectionalStream()
+  setDatagramFeedback(handler) {
+    this.sessionint.setDatagramFeedback(handler)
+  }
+
+  setDatagramFec(options) {
+    this.sessionint.setDatagramFec(options)
+  }
+
+  setDatagramFragmentation(options) {
+    this.sessionint.setDatagramFragmentation(options)
+  }
+
+  setStreamReadOptions(options) {
+    this.sessionint.setStreamReadOptions(options)
+  }
+
+  setStreamReadFraming(framing) {
+    this.sessionint.setStreamReadFraming(framing)
+  }
+}
+
+// fans datagrams out to many sessions natively, one send copies the data
+// once for all members, call close() when the group is no longer needed
+export class DatagramGroup {
+  constructor() {
+    const eventloop = Http3EventLoop.getGlobalEventLoop(this).eventloopInt
+    this.groupInt = wtrouter.Http3DatagramGroup(eventloop)
+    this.closed = false
+  }
+
+  static sessionObj(session) {
+    // accepts server sessions as well as WebTransport client objects
+    const sessobj = session.sessionint ? session.sessionint : session
+    if (!sessobj.objint) throw new Error('Session is not ready')
+    return sessobj.objint
+  }
+
+  add(session) {
+    if (this.closed) throw new Error('DatagramGroup is closed')
+    this.groupInt.addSession(DatagramGroup.sessionObj(session))
+  }
+
+  remove(session) {
+    if (this.closed) return
+    this.groupInt.removeSession(DatagramGroup.sessionObj(session))
+  }
+
+  send(datagram) {
+    if (this.closed) throw new Error('DatagramGroup is closed')
+    if (!(datagram instanceof Uint8Array))
+      throw new Error('datagram is not of type Uint8Array')
+    this.groupInt.send(datagram)
+  }
+
+  // members, and copies queued at or dropped by members
+  getStats() {
+    return this.groupInt.getStats()
+  }
+
+  close() {
+    if (this.closed) return
+    this.closed = true
+    this.groupInt.close()
   }
 }
 
 class Http3EventLoop {
   static globalLoop = null
+  static sessionCacheOptions = null
   constructor(args) {
     this.eventloopInt = wtrouter.Http3EventLoop({
       transportCallback: Http3WebTransport.transportCallback,
@@ -829,6 +1397,10 @@ class Http3EventLoop {
       eventloopCallback: Http3EventLoop.callback
     })
     this.eventloopInt.jsobj = this
+    if (Http3EventLoop.sessionCacheOptions)
+      this.eventloopInt.setSessionCacheOptions(
+        Http3EventLoop.sessionCacheOptions
+      )
 
     this.refObjects = new Set()
     this.loopGuardian = this.loopGuardian.bind(this)
@@ -880,6 +1452,29 @@ class Http3EventLoop {
   }
 }
 
+// the session ticket cache shared by clients with { sessionCache: true },
+// { maxServers, ticketsPerServer }, kept for loops started later
+export function setSessionCacheOptions(options) {
+  Http3EventLoop.sessionCacheOptions = { ...options }
+  if (Http3EventLoop.globalLoop)
+    Http3EventLoop.globalLoop.eventloopInt.setSessionCacheOptions(options)
+}
+
+// { servers, hits, misses, expired, evictions } or null without a loop
+export function getSessionCacheStats() {
+  if (!Http3EventLoop.globalLoop) return null
+  return Http3EventLoop.globalLoop.eventloopInt.getSessionCacheStats()
+}
+
+// histograms like Http3Server.getHandshakeTimings of the clients: encryption,
+// handshake and settings (the server's webtransport support) since
+// connecting, session (CONNECT to answer) and total (connecting to the first
+// answer), null without a loop
+export function getClientHandshakeTimings() {
+  if (!Http3EventLoop.globalLoop) return null
+  return Http3EventLoop.globalLoop.eventloopInt.getClientHandshakeTimings()
+}
+
 export function testcheck() {
   return !Http3EventLoop.globalLoop
 }
@@ -0,0 +1,132 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// this benchmark sends datagrams from the server over a lossy link (the
+// server's packet writer drops a share of its packets) and counts, how many
+// arrive at the client, once without and once with forward error correction
+// run with: node test/fecbench.js [loss, default 0.05]
+
+import { generateWebTransportCertificate } from './certificate.js'
+import { Http3Server, WebTransport } from '../src/webtransport.js'
+
+const loss = Number(process.argv[2] || 0.05)
+const runTime = 5000 // ms per round
+const sendInterval = 5 // ms
+const datagramSize = 1000
+const fec = { sources: 8, repairs: 2, delay: 10 }
+
+async function sendDatagrams(session) {
+  const writer = session.datagrams.writable.getWriter()
+  const start = Date.now()
+  let seq = 0
+  while (Date.now() - start < runTime) {
+    const datagram = new Uint8Array(datagramSize)
+    new DataView(datagram.buffer).setUint32(0, seq++)
+    await writer.write(datagram)
+    await new Promise((resolve) => setTimeout(resolve, sendInterval))
+  }
+  // the last one tells the client how many were sent, send it a few times
+  const end = new Uint8Array(datagramSize)
+  new DataView(end.buffer).setUint32(0, 0xffffffff)
+  new DataView(end.buffer).setUint32(4, seq)
+  for (let i = 0; i < 10; i++) {
+    await writer.write(end)
+    await new Promise((resolve) => setTimeout(resolve, 50))
+  }
+  writer.releaseLock()
+}
+
+async function runBenchServer(server, path, useFec) {
+  const sessionReader = server.sessionStream(path).getReader()
+  while (true) {
+    const { done, value } = await sessionReader.read()
+    if (done) break
+    await value.ready
+    if (useFec) value.setDatagramFec(fec)
+    sendDatagrams(value).catch(() => {})
+  }
+}
+
+async function runRound(url, hash, name, useFec) {
+  const client = new WebTransport(url, {
+    serverCertificateHashes: [{ algorithm: 'sha-256', value: hash }]
+  })
+  if (useFec) client.setDatagramFec(fec)
+  await client.ready
+
+  const reader = client.datagrams.readable.getReader()
+  const seen = new Set()
+  let sent = 0
+  while (true) {
+    const { done, value } = await reader.read()
+    if (done) break
+    const view = new DataView(value.buffer, value.byteOffset)
+    const seq = view.getUint32(0)
+    if (seq === 0xffffffff) {
+      sent = view.getUint32(4)
+      break
+    }
+    seen.add(seq)
+  }
+  const stats = await client.getStats()
+  console.log(
+    name,
+    'delivered',
+    seen.size,
+    'of',
+    sent,
+    '(' + ((seen.size / sent) * 100).toFixed(1) + '%)',
+    'recovered',
+    stats.datagrams.fecRecovered,
+    'lost after fec',
+    stats.datagrams.fecLost
+  )
+  client.close({ closeCode: 0, reason: 'round finished' })
+}
+
+async function run() {
+  const attrs = [
+    { shortName: 'C', value: 'DE' },
+    { shortName: 'ST', value: 'Berlin' },
+    { shortName: 'L', value: 'Berlin' },
+    { shortName: 'O', value: 'WebTransport Bench Server' },
+    { shortName: 'CN', value: '127.0.0.1' }
+  ]
+  const certificate = await generateWebTransportCertificate(attrs, {
+    days: 13
+  })
+
+  const http3server = new Http3Server({
+    port: 8081,
+    host: '127.0.0.1',
+    secret: 'mysecret',
+    cert: certificate.cert,
+    privKey: certificate.private
+  })
+  // a test hook of the native server, not a server option
+  http3server.transportInt.setPacketLossForTesting(loss)
+  runBenchServer(http3server, '/plain', false)
+  runBenchServer(http3server, '/fec', true)
+  http3server.startServer()
+  await new Promise((resolve) => setTimeout(resolve, 2000))
+
+  console.log('packet loss', loss)
+  await runRound(
+    'https://127.0.0.1:8081/plain',
+    certificate.hash,
+    'without fec',
+    false
+  )
+  await runRound(
+    'https://127.0.0.1:8081/fec',
+    certificate.hash,
+    'with fec   ',
+    true
+  )
+
+  await new Promise((resolve) => setTimeout(resolve, 2000))
+  http3server.stopServer()
+  process.exit(0)
+}
+run()
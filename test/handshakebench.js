@@ -0,0 +1,148 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// this benchmark opens many connections at once, while an established
+// session measures its echo latency, once per number of signing threads
+// (0 signs on the loop thread)
+// run with: node test/handshakebench.js
+
+import { generateWebTransportCertificate } from './certificate.js'
+import { Http3Server, WebTransport } from '../src/webtransport.js'
+
+const stormSize = 200 // connections per round
+const pingInterval = 5 // ms
+const rounds = [0, 1, 2, 4] // signing threads
+
+async function echoBidi(session) {
+  try {
+    const bidiReader = session.incomingBidirectionalStreams.getReader()
+    while (true) {
+      const { done, value } = await bidiReader.read()
+      if (done) break
+      value.readable.pipeTo(value.writable).catch(() => {})
+    }
+  } catch (error) {
+    // session closed
+  }
+}
+
+async function runBenchServer(server) {
+  const sessionReader = server.sessionStream('/bench').getReader()
+  while (true) {
+    const { done, value } = await sessionReader.read()
+    if (done) break
+    value.ready.then(() => echoBidi(value)).catch(() => {})
+  }
+}
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return NaN
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))]
+}
+
+async function runRound(certificate, port, signingThreads) {
+  const server = new Http3Server({
+    port,
+    host: '127.0.0.1',
+    secret: 'mysecret',
+    cert: certificate.cert,
+    privKey: certificate.private,
+    signingThreads
+  })
+  runBenchServer(server)
+  server.startServer()
+  await new Promise((resolve) => setTimeout(resolve, 1000))
+
+  const url = 'https://127.0.0.1:' + port + '/bench'
+  const options = {
+    serverCertificateHashes: [{ algorithm: 'sha-256', value: certificate.hash }]
+  }
+  const control = new WebTransport(url, options)
+  await control.ready
+  const stream = await control.createBidirectionalStream()
+  const writer = stream.writable.getWriter()
+  const reader = stream.readable.getReader()
+
+  let running = true
+  const latencies = []
+  const pingLoop = (async () => {
+    while (running) {
+      const start = performance.now()
+      await writer.write(new Uint8Array(1))
+      const { done } = await reader.read()
+      if (done) break
+      latencies.push(performance.now() - start)
+      await new Promise((resolve) => setTimeout(resolve, pingInterval))
+    }
+  })()
+
+  const start = performance.now()
+  const clients = []
+  for (let i = 0; i < stormSize; i++) clients.push(new WebTransport(url, options))
+  await Promise.allSettled(clients.map((client) => client.ready))
+  const duration = performance.now() - start
+  running = false
+  await pingLoop
+
+  latencies.sort((a, b) => a - b)
+  const stats = server.getHandshakeStats()
+  console.log(
+    'signing threads',
+    signingThreads,
+    'handshakes/s',
+    ((stormSize / duration) * 1000).toFixed(0),
+    'echo latency ms: p50',
+    percentile(latencies, 0.5).toFixed(2),
+    'p99',
+    percentile(latencies, 0.99).toFixed(2),
+    'signing ms: avg',
+    stats.signingLatencyAvg.toFixed(2),
+    'max',
+    stats.signingLatencyMax.toFixed(2)
+  )
+  if (stats.certCompressions > 0)
+    console.log(
+      'certificate bytes per handshake',
+      (stats.certBytesUncompressed / stats.certCompressions).toFixed(0),
+      'compressed',
+      (stats.certBytesCompressed / stats.certCompressions).toFixed(0)
+    )
+
+  const timings = server.getHandshakeTimings()
+  for (const phase of ['queue', 'signing', 'handshake', 'total'])
+    console.log(
+      '  ' + phase,
+      'ms: p50',
+      timings[phase].p50.toFixed(2),
+      'p99',
+      timings[phase].p99.toFixed(2),
+      'max',
+      timings[phase].max.toFixed(2)
+    )
+
+  for (const client of clients)
+    client.close({ closeCode: 0, reason: 'round finished' })
+  control.close({ closeCode: 0, reason: 'round finished' })
+  await new Promise((resolve) => setTimeout(resolve, 1000))
+  server.stopServer()
+}
+
+async function run() {
+  const attrs = [
+    { shortName: 'C', value: 'DE' },
+    { shortName: 'ST', value: 'Berlin' },
+    { shortName: 'L', value: 'Berlin' },
+    { shortName: 'O', value: 'WebTransport Bench Server' },
+    { shortName: 'CN', value: '127.0.0.1' }
+  ]
+  const certificate = await generateWebTransportCertificate(attrs, {
+    days: 13
+  })
+
+  let port = 8081
+  for (const signingThreads of rounds)
+    await runRound(certificate, port++, signingThreads)
+  process.exit(0)
+}
+run()
@@ -0,0 +1,165 @@
+// Copyright (c) 2022 Marten Richter or other contributers (see commit). All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// this benchmark measures the latency of a small control stream, while
+// a bulk stream saturates the connection, once with equal priorities and
+// once with the control stream ahead of the bulk stream (sendOrder)
+// run with: node test/prioritybench.js
+
+import { generateWebTransportCertificate } from './certificate.js'
+import { Http3Server, WebTransport } from '../src/webtransport.js'
+
+const runTime = 5000 // ms per round
+const pingInterval = 20 // ms
+const bulkChunkSize = 64 * 1024
+
+async function drainUnidi(session) {
+  try {
+    const unidiReader = session.incomingUnidirectionalStreams.getReader()
+    while (true) {
+      const { done, value } = await unidiReader.read()
+      if (done) break
+      const reader = value.getReader()
+      ;(async () => {
+        try {
+          while (!(await reader.read()).done) {}
+        } catch (error) {
+          // bulk stream gets aborted at the end of a round
+        }
+      })()
+    }
+  } catch (error) {
+    console.log('drainUnidi exited with', error)
+  }
+}
+
+async function echoBidi(session) {
+  try {
+    const bidiReader = session.incomingBidirectionalStreams.getReader()
+    while (true) {
+      const { done, value } = await bidiReader.read()
+      if (done) break
+      value.readable.pipeTo(value.writable).catch(() => {})
+    }
+  } catch (error) {
+    console.log('echoBidi exited with', error)
+  }
+}
+
+async function runBenchServer(server) {
+  const sessionReader = server.sessionStream('/bench').getReader()
+  while (true) {
+    const { done, value } = await sessionReader.read()
+    if (done) break
+    await value.ready
+    drainUnidi(value)
+    echoBidi(value)
+  }
+}
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return NaN
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))]
+}
+
+async function runRound(client, name, controlOptions, bulkOptions) {
+  const bulk = await client.createUnidirectionalStream(bulkOptions)
+  const bulkWriter = bulk.getWriter()
+  const control = await client.createBidirectionalStream(controlOptions)
+  const controlWriter = control.writable.getWriter()
+  const controlReader = control.readable.getReader()
+
+  let running = true
+  let bulkBytes = 0
+  const bulkChunk = new Uint8Array(bulkChunkSize)
+  const bulkLoop = (async () => {
+    try {
+      while (running) {
+        await bulkWriter.ready
+        bulkWriter.write(bulkChunk)
+        bulkBytes += bulkChunk.byteLength
+      }
+    } catch (error) {
+      // stream gets aborted
+    }
+  })()
+
+  const latencies = []
+  const start = Date.now()
+  let pending = new Uint8Array(0)
+  while (Date.now() - start < runTime) {
+    const ping = new Uint8Array(8)
+    new DataView(ping.buffer).setFloat64(0, performance.now())
+    await controlWriter.write(ping)
+    // wait for the echo of the whole ping
+    while (pending.byteLength < 8) {
+      const { done, value } = await controlReader.read()
+      if (done) break
+      const merged = new Uint8Array(pending.byteLength + value.byteLength)
+      merged.set(pending)
+      merged.set(value, pending.byteLength)
+      pending = merged
+    }
+    const sent = new DataView(pending.buffer, pending.byteOffset).getFloat64(0)
+    latencies.push(performance.now() - sent)
+    pending = pending.slice(8)
+    await new Promise((resolve) => setTimeout(resolve, pingInterval))
+  }
+  running = false
+  await bulkWriter.abort({ code: 0 }).catch(() => {})
+  await bulkLoop
+  await controlWriter.close().catch(() => {})
+  await controlReader.cancel(0).catch(() => {})
+
+  latencies.sort((a, b) => a - b)
+  console.log(
+    name,
+    'control latency ms: p50',
+    percentile(latencies, 0.5).toFixed(2),
+    'p95',
+    percentile(latencies, 0.95).toFixed(2),
+    'max',
+    latencies[latencies.length - 1].toFixed(2),
+    'bulk MB/s',
+    (bulkBytes / 1024 / 1024 / (runTime / 1000)).toFixed(1)
+  )
+}
+
+async function run() {
+  const attrs = [
+    { shortName: 'C', value: 'DE' },
+    { shortName: 'ST', value: 'Berlin' },
+    { shortName: 'L', value: 'Berlin' },
+    { shortName: 'O', value: 'WebTransport Bench Server' },
+    { shortName: 'CN', value: '127.0.0.1' }
+  ]
+  const certificate = await generateWebTransportCertificate(attrs, {
+    days: 13
+  })
+
+  const http3server = new Http3Server({
+    port: 8081,
+    host: '127.0.0.1',
+    secret: 'mysecret',
+    cert: certificate.cert,
+    privKey: certificate.private
+  })
+  runBenchServer(http3server)
+  http3server.startServer()
+  await new Promise((resolve) => setTimeout(resolve, 2000))
+
+  const client = new WebTransport('https://127.0.0.1:8081/bench', {
+    serverCertificateHashes: [{ algorithm: 'sha-256', value: certificate.hash }]
+  })
+  await client.ready
+
+  await runRound(client, 'equal priority   ', {}, {})
+  await runRound(client, 'control sendOrder', { sendOrder: 3 }, { sendOrder: -4 })
+
+  client.close({ closeCode: 0, reason: 'benchmark finished' })
+  await new Promise((resolve) => setTimeout(resolve, 2000))
+  http3server.stopServer()
+  process.exit(0)
+}
+run()
@@ -4,9 +4,27 @@
 
 // this file runs various tests
 
+import { existsSync } from 'fs'
+import { createRequire } from 'module'
+import * as path from 'path'
+import * as url from 'url'
 import { generateWebTransportCertificate } from './certificate.js'
 import { Http3Server, WebTransport, testcheck } from '../src/webtransport.js'
-import { echoTestsConnection, runEchoServer } from './testsuite.js'
+import {
+  echoTestsConnection,
+  nativeUnitTests,
+  pooledCloseWhileQueuedTest,
+  runEchoServer
+} from './testsuite.js'
+
+// the test hooks are not part of the module, so they come from the addon
+const require = createRequire(import.meta.url)
+const dirname = url.fileURLToPath(new URL('.', import.meta.url))
+let wtpath = '../build/Release/webtransport.node'
+if (existsSync(path.join(dirname, '../build/Debug/webtransport.node'))) {
+  wtpath = '../build/Debug/webtransport.node'
+}
+const nativeTesting = require(wtpath).Http3Testing
 
 async function run() {
   setTimeout(() => {
@@ -18,6 +36,9 @@ async function run() {
       process.exit(0)
     }
   }, 40 * 1000)
+  console.log('start native unit tests')
+  nativeUnitTests(nativeTesting)
+
   console.log('start generating self signed certificate')
 
   const attrs = [
@@ -83,6 +104,11 @@ async function run() {
 
   client = null
 
+  console.log('now pooled sessions')
+  await pooledCloseWhileQueuedTest(WebTransport, url, {
+    serverCertificateHashes: [{ algorithm: 'sha-256', value: certificate.hash }]
+  })
+
   console.log('client closes now wait 2 seconds')
 
   await new Promise((resolve) => setTimeout(resolve, 2000))
@@ -109,6 +109,14 @@ function testArraysEqual(array1, array2) {
 
 export async function echoTestsConnection(transport) {
   // some echo tests for testing the webtransport library, not for production
+  // a bad urgency throws and leaves nothing waiting, the next stream is ours
+  let threw = false
+  try {
+    transport.createBidirectionalStream({ urgency: Symbol('bad') })
+  } catch (error) {
+    threw = true
+  }
+  check(threw, 'bad urgency throws')
   const stream = await transport.createBidirectionalStream()
   const writer = stream.writable.getWriter()
   const data1 = new Uint8Array([65, 66, 67])
@@ -295,3 +303,523 @@ export async function echoTestsConnection(transport) {
   console.log('test datagrams finished')
   console.log('start close stream tests')
 }
+
+// two pooled sessions share a connection, one closes with datagrams still
+// in quiche's queue, the other has to keep working after it is collected
+export async function pooledCloseWhileQueuedTest(WebTransport, url, options) {
+  const first = new WebTransport(url, { ...options, allowPooling: true })
+  const second = new WebTransport(url, { ...options, allowPooling: true })
+  await Promise.all([first.ready, second.ready])
+  if (first.client !== second.client)
+    throw new Error('pooled sessions got separate connections')
+
+  const payload = new Uint8Array(1000)
+  const firstWriter = first.datagrams.writable.getWriter()
+  for (let i = 0; i < 1000; i++) firstWriter.write(payload)
+  first.close({ closeCode: 0, reason: 'closing with queued datagrams' })
+  await first.closed
+  await new Promise((resolve) => setTimeout(resolve, 100))
+  if (global.gc) global.gc()
+
+  // the queued datagrams drain, while the second session echoes
+  const writer = second.datagrams.writable.getWriter()
+  const reader = second.datagrams.readable.getReader()
+  const sent = new Uint8Array([89, 90, 91])
+  let received = null
+  const receiving = reader.read().then(({ value }) => (received = value))
+  for (let i = 0; i < 50 && !received; i++) {
+    writer.write(sent)
+    await new Promise((resolve) => setTimeout(resolve, 50))
+  }
+  await Promise.race([
+    receiving,
+    new Promise((resolve) => setTimeout(resolve, 1000))
+  ])
+  if (!received) throw new Error('pooled session stalled after close')
+  testArraysEqual(sent, received)
+  second.close({ closeCode: 0, reason: 'tests finished' })
+  await second.closed
+  console.log('pooled close while queued test passed')
+}
+
+// the native building blocks on their own, round trips and edge cases,
+// they need no connection and no event loop
+
+function check(condition, message) {
+  if (!condition) throw new Error('check failed: ' + message)
+}
+
+function testBuffersEqual(list1, list2, message) {
+  check(list1.length === list2.length, message + ', count')
+  for (let i = 0; i < list1.length; i++)
+    check(Buffer.compare(list1[i], list2[i]) === 0, message + ', item ' + i)
+}
+
+function fecTests(testing) {
+  const payloads = []
+  for (let i = 0; i < 10; i++) payloads.push(Buffer.alloc(7 * i + 1, i))
+  // groups of 4 sources and 2 repairs, the last group holds 2 sources:
+  // 0-5 group 0, 6-11 group 1, 12-15 group 2
+  const datagrams = testing.fecEncode(4, 2, payloads)
+  check(datagrams.length === 16, 'fec datagram count')
+
+  let res = testing.fecDecode(datagrams)
+  testBuffersEqual(res.delivered, payloads, 'fec without loss')
+  check(res.recovered.length === 0, 'fec without loss recovers nothing')
+
+  // any 4 of the 6 datagrams of a group restore it
+  const lossy = datagrams.filter((d, i) => ![0, 2, 7, 11, 12].includes(i))
+  res = testing.fecDecode(lossy)
+  testBuffersEqual(
+    res.delivered,
+    payloads.filter((p, i) => ![0, 2, 5, 8].includes(i)),
+    'fec delivered'
+  )
+  testBuffersEqual(
+    res.recovered,
+    [payloads[0], payloads[2], payloads[5], payloads[8]],
+    'fec recovered'
+  )
+  check(res.recoveredCount === 4, 'fec recovered count')
+  check(res.malformed === 0, 'fec nothing malformed')
+
+  // repairs before sources, the group is known once the count arrives
+  res = testing.fecDecode([
+    datagrams[4],
+    datagrams[0],
+    datagrams[1],
+    datagrams[3]
+  ])
+  testBuffersEqual(res.recovered, [payloads[2]], 'fec repair first')
+
+  // three of six lost is one too many
+  res = testing.fecDecode([datagrams[2], datagrams[3], datagrams[5]])
+  check(res.recovered.length === 0, 'fec beyond its repairs')
+  check(res.delivered.length === 2, 'fec sources still delivered')
+
+  // too short and a repair without a source count
+  const broken = Buffer.from(datagrams[4])
+  broken[4] = 0
+  res = testing.fecDecode([Buffer.from([1, 0]), broken])
+  check(res.malformed === 2, 'fec malformed')
+  console.log('fec tests passed')
+}
+
+function fragmentTests(testing) {
+  const small = Buffer.alloc(10, 1)
+  const big1 = Buffer.alloc(5000)
+  const big2 = Buffer.alloc(3000)
+  for (let i = 0; i < big1.length; i++) big1[i] = i & 0xff
+  for (let i = 0; i < big2.length; i++) big2[i] = (i * 7) & 0xff
+  const [smallDg, big1Dg, big2Dg] = testing.fragmentSplit(
+    [small, big1, big2],
+    1200
+  )
+  check(smallDg.length === 1 && smallDg[0][0] === 0, 'fragment whole message')
+  check(big1Dg.length === 5 && big2Dg.length === 3, 'fragment count')
+  check(big1Dg.every((d) => d.length <= 1200), 'fragments fit into a datagram')
+
+  // interleaved and out of order
+  const steps = [smallDg[0], ...big2Dg.slice().reverse(), ...big1Dg]
+  let res = testing.fragmentReassemble(steps.map((datagram) => ({ datagram })))
+  testBuffersEqual(res.messages, [small, big2, big1], 'fragment reassembly')
+  check(res.reassembled === 2, 'fragment reassembled count')
+
+  // a duplicate fragment does not deliver twice
+  res = testing.fragmentReassemble(
+    [big2Dg[0], big2Dg[0], big2Dg[1], big2Dg[2], big2Dg[1]].map(
+      (datagram) => ({ datagram })
+    )
+  )
+  testBuffersEqual(res.messages, [big2], 'fragment duplicate')
+
+  // a message with a missing fragment is given up after the timeout
+  res = testing.fragmentReassemble(
+    [
+      ...big1Dg.slice(0, 4).map((datagram) => ({ datagram, now: 0 })),
+      { datagram: smallDg[0], now: 2000000 },
+      { datagram: big1Dg[4], now: 2000000 }
+    ],
+    { timeoutUs: 1000000 }
+  )
+  testBuffersEqual(res.messages, [small], 'fragment timeout')
+  check(res.dropped === 1, 'fragment dropped after timeout')
+
+  // the memory cap drops the oldest partial message
+  res = testing.fragmentReassemble(
+    [...big1Dg.slice(0, 4), ...big2Dg.slice(0, 2)].map((datagram) => ({
+      datagram
+    })),
+    { maxBytes: 6000 }
+  )
+  check(res.dropped === 1, 'fragment dropped for memory')
+
+  // too large for the limits
+  check(
+    testing.fragmentSplit([big1], 1200, 4000)[0] === null,
+    'fragment message too large'
+  )
+  check(testing.fragmentSplit([big1], 9)[0] === null, 'fragment no room')
+  res = testing.fragmentReassemble(
+    big1Dg.map((datagram) => ({ datagram })),
+    { maxMessageSize: 2000 }
+  )
+  check(
+    res.messages.length === 0 && res.malformed === 4,
+    'fragment above the receive limit'
+  )
+  res = testing.fragmentReassemble(
+    [Buffer.alloc(0), Buffer.from([7, 1]), big1Dg[0].subarray(0, 9)].map(
+      (datagram) => ({ datagram })
+    )
+  )
+  check(res.malformed === 3, 'fragment malformed')
+
+  // a peer announcing many fragments does not get them allocated for free
+  const fragment = (id, index, count, size) =>
+    Buffer.concat([
+      Buffer.from([1, 0, 0, 0, id, index >> 8, index & 0xff]),
+      Buffer.from([count >> 8, count & 0xff]),
+      Buffer.alloc(size)
+    ])
+  res = testing.fragmentReassemble([
+    { datagram: fragment(1, 0, 1000, 1000) }
+  ])
+  check(res.malformed === 1, 'fragment count does not fit the message size')
+  res = testing.fragmentReassemble(
+    [{ datagram: fragment(2, 64999, 65000, 1) }],
+    { maxBytes: 1000000 }
+  )
+  check(res.malformed === 1, 'fragment slots above the memory cap')
+  res = testing.fragmentReassemble(
+    [1, 2, 3].map((id) => ({ datagram: fragment(id, 2999, 3000, 1) })),
+    { maxBytes: 250000 }
+  )
+  check(res.dropped === 1, 'fragment slots count for the memory cap')
+  console.log('fragment tests passed')
+}
+
+function ticketTests(testing) {
+  const session1 = Buffer.from('session one')
+  const session2 = Buffer.from('session two')
+  let res = testing.ticketCrypter(['key a'], 0, [
+    { op: 'seal', session: session1, now: 1000 },
+    { op: 'keys', secrets: ['key b', 'key a'] },
+    { op: 'seal', session: session2, now: 1000 },
+    { op: 'keys', secrets: ['key b'] }
+  ])
+  const [ticketA, , ticketB] = res.results
+  check(ticketA && ticketB, 'tickets sealed')
+  check(res.issued === 2, 'tickets issued')
+
+  const tampered = Buffer.from(ticketA)
+  tampered[tampered.length - 1] ^= 1
+  res = testing.ticketCrypter(['key b', 'key a'], 0, [
+    { op: 'open', ticket: ticketA, now: 1000 },
+    { op: 'open', ticket: ticketB, now: 1000 },
+    { op: 'open', ticket: tampered, now: 1000 },
+    { op: 'open', ticket: ticketA.subarray(0, 10), now: 1000 },
+    { op: 'keys', secrets: ['key b'] },
+    // the old key is gone
+    { op: 'open', ticket: ticketA, now: 1000 },
+    { op: 'open', ticket: ticketB, now: 1000 }
+  ])
+  testBuffersEqual(
+    [res.results[0], res.results[1], res.results[6]],
+    [session1, session2, session2],
+    'tickets opened across rotation'
+  )
+  check(
+    res.results[2] === null && res.results[3] === null,
+    'broken tickets refused'
+  )
+  check(res.results[5] === null, 'ticket of a retired key refused')
+  check(res.hits === 3 && res.misses === 3, 'ticket hits and misses')
+  console.log('ticket tests passed')
+}
+
+function ticketReplayTests(testing) {
+  const session = Buffer.from('session one')
+  // with early data, a ticket is good for it once and within the window
+  let res = testing.ticketCrypter(['key a'], 60, [
+    { op: 'seal', session, now: 1000 },
+    { op: 'open', ticketOf: 0, now: 1010 },
+    { op: 'open', ticketOf: 0, now: 1020 },
+    { op: 'open', ticketOf: 0, now: 2000 },
+    { op: 'open', ticketOf: 0, now: 800 }
+  ])
+  testBuffersEqual([res.results[1]], [session], 'ticket first use')
+  check(res.replays === 1, 'ticket replay detected')
+  // too old, and from the future beyond the clock skew
+  check(res.expired === 2, 'ticket expiry detected')
+  // another process has the keys, but not our replay filter
+  const [ticket] = testing.ticketCrypter(['key a'], 0, [
+    { op: 'seal', session, now: 1000 }
+  ]).results
+  res = testing.ticketCrypter(['key a'], 60, [
+    { op: 'open', ticket, now: 1010 }
+  ])
+  check(
+    res.foreign === 1 && res.replays === 0,
+    'ticket of another process without early data'
+  )
+  // without anti replay it is not checked at all
+  res = testing.ticketCrypter(['key a'], 0, [
+    { op: 'open', ticket, now: 1010 },
+    { op: 'open', ticket, now: 5000 }
+  ])
+  testBuffersEqual(res.results, [session, session], 'ticket no anti replay')
+  console.log('ticket replay tests passed')
+}
+
+function replayFilterTests(testing) {
+  const seen = testing.replayFilter(30, [
+    { ticket: 'a', now: 0 },
+    { ticket: 'a', now: 5 },
+    { ticket: 'b', now: 5 },
+    { ticket: 'a', now: 29 },
+    // long gone
+    { ticket: 'a', now: 100 },
+    { ticket: 'c', now: 100 },
+    // the clock steps back
+    { ticket: 'c', now: 50 }
+  ])
+  testArraysEqual(seen, [false, true, false, true, false, false, true])
+
+  const distinct = []
+  for (let i = 0; i < 2000; i++) distinct.push({ ticket: 'ticket' + i, now: i })
+  check(
+    testing.replayFilter(600, distinct).every((cur) => !cur),
+    'replay filter without false positives'
+  )
+  console.log('replay filter tests passed')
+}
+
+function sessionCacheTests(testing) {
+  // newest ticket first, each one only once, at most 2 per server
+  let res = testing.sessionCache(10, 2, [
+    { op: 'insert', host: 'a', time: 1, timeout: 1000 },
+    { op: 'insert', host: 'a', time: 2, timeout: 1000 },
+    { op: 'insert', host: 'a', time: 3, timeout: 1000 },
+    { op: 'lookup', host: 'a', now: 10 },
+    { op: 'lookup', host: 'a', now: 10 },
+    { op: 'lookup', host: 'a', now: 10 },
+    { op: 'lookup', host: 'a', port: 444, now: 10 }
+  ])
+  testArraysEqual(res.results.slice(3), [3, 2, null, null])
+  check(res.hits === 2 && res.misses === 2, 'session cache hits and misses')
+
+  // the least recently used server goes first
+  res = testing.sessionCache(2, 2, [
+    { op: 'insert', host: 'a', time: 1, timeout: 1000 },
+    { op: 'insert', host: 'b', time: 2, timeout: 1000 },
+    { op: 'insert', host: 'a', time: 3, timeout: 1000 },
+    { op: 'insert', host: 'c', time: 4, timeout: 1000 },
+    { op: 'lookup', host: 'b', now: 10 },
+    { op: 'lookup', host: 'a', now: 10 },
+    { op: 'lookup', host: 'c', now: 10 }
+  ])
+  testArraysEqual(res.results.slice(4), [null, 3, 4])
+  check(res.evictions === 1, 'session cache eviction')
+
+  // expired tickets and tickets from the future are never used
+  res = testing.sessionCache(10, 4, [
+    { op: 'insert', host: 'a', time: 100, timeout: 10 },
+    { op: 'lookup', host: 'a', now: 200 },
+    { op: 'insert', host: 'b', time: 500, timeout: 100 },
+    { op: 'lookup', host: 'b', now: 400 },
+    { op: 'insert', host: 'c', time: 100, timeout: 10 },
+    { op: 'insert', host: 'd', time: 100, timeout: 1000 },
+    { op: 'expire', now: 200 }
+  ])
+  check(
+    res.results[1] === null && res.results[3] === null,
+    'session cache no expired tickets'
+  )
+  check(res.expired === 3, 'session cache expired count')
+  check(res.servers === 1, 'session cache servers after expiry')
+
+  // a server with a NEW_TOKEN stays, when its tickets expire
+  res = testing.sessionCache(10, 4, [
+    { op: 'insert', host: 'a', time: 100, timeout: 10 },
+    { op: 'token', host: 'a' },
+    { op: 'expire', now: 200 }
+  ])
+  check(res.servers === 1, 'session cache keeps a server with a token')
+  console.log('session cache tests passed')
+}
+
+function retryTokenTests(testing) {
+  const originalId = Buffer.from([1, 2, 3, 4, 5, 6, 7, 8])
+  const retryId = Buffer.from([9, 10, 11, 12, 13, 14, 15, 16])
+  const now = 1000000
+  // one admission per call, checks take the token of a make step
+  const res = testing.retryTokens([
+    { op: 'make', peer: '192.0.2.1', originalId, retryId, now },
+    { op: 'make', peer: '2001:db8::1', originalId, retryId, now },
+    { op: 'check', tokenOf: 0, peer: '192.0.2.1', retryId, now: now + 1000 },
+    { op: 'check', tokenOf: 1, peer: '2001:db8::1', retryId, now: now + 1000 },
+    // another address, even in the same /64, or another retry id
+    { op: 'check', tokenOf: 0, peer: '192.0.2.2', retryId, now: now + 1000 },
+    { op: 'check', tokenOf: 1, peer: '2001:db8::2', retryId, now: now + 1000 },
+    {
+      op: 'check',
+      tokenOf: 0,
+      peer: '192.0.2.1',
+      retryId: originalId,
+      now: now + 1000
+    },
+    // too old and issued in the future
+    { op: 'check', tokenOf: 0, peer: '192.0.2.1', retryId, now: now + 11e6 },
+    { op: 'check', tokenOf: 0, peer: '192.0.2.1', retryId, now: now - 1 },
+    // broken
+    {
+      op: 'check',
+      tokenOf: 0,
+      flip: 20,
+      peer: '192.0.2.1',
+      retryId,
+      now: now + 1000
+    },
+    {
+      op: 'check',
+      tokenOf: 0,
+      length: 20,
+      peer: '192.0.2.1',
+      retryId,
+      now: now + 1000
+    }
+  ])
+  check(res[0].length > 0 && res[1].length > 0, 'retry tokens made')
+  testBuffersEqual(res.slice(2, 4), [originalId, originalId], 'retry token')
+  check(res.slice(4).every((cur) => cur === null), 'retry tokens refused')
+
+  // a token of another admission, e.g. after a restart
+  const other = testing.retryTokens([
+    { op: 'make', peer: '192.0.2.1', originalId, retryId, now }
+  ])[0]
+  check(
+    testing.retryTokens([
+      { op: 'check', token: other, peer: '192.0.2.1', retryId, now }
+    ])[0] === null,
+    'retry token of another key'
+  )
+  console.log('retry token tests passed')
+}
+
+function sourceLimiterTests(testing) {
+  // 10 per s, a burst of 3
+  let res = testing.sourceLimiter(10, 3, 100, [
+    { peer: '192.0.2.1', now: 0 },
+    { peer: '192.0.2.1', now: 0 },
+    { peer: '192.0.2.1', now: 0 },
+    { peer: '192.0.2.1', now: 0 },
+    { peer: '192.0.2.2', now: 0 },
+    // 100 ms bring one token
+    { peer: '192.0.2.1', now: 100000 },
+    { peer: '192.0.2.1', now: 100000 },
+    // mapped ipv4 is the same host
+    { peer: '::ffff:192.0.2.1', now: 100000 },
+    // the clock steps back, no tokens are made up
+    { peer: '192.0.2.1', now: 50000 }
+  ])
+  testArraysEqual(res.allowed, [
+    true,
+    true,
+    true,
+    false,
+    true,
+    true,
+    false,
+    false,
+    false
+  ])
+  check(res.throttled === 4, 'rate limit throttled')
+  check(res.throttledSources === 1, 'rate limit throttled sources')
+  check(res.sources === 2, 'rate limit sources')
+
+  // an ipv6 /64 is one source
+  res = testing.sourceLimiter(1, 1, 100, [
+    { peer: '2001:db8::1', now: 0 },
+    { peer: '2001:db8::2', now: 0 },
+    { peer: '2001:db8:0:1::1', now: 0 }
+  ])
+  testArraysEqual(res.allowed, [true, false, true])
+
+  // the least recently seen source is forgotten
+  res = testing.sourceLimiter(1, 1, 2, [
+    { peer: '192.0.2.1', now: 0 },
+    { peer: '192.0.2.2', now: 0 },
+    { peer: '192.0.2.3', now: 0 },
+    { peer: '192.0.2.1', now: 0 }
+  ])
+  testArraysEqual(res.allowed, [true, true, true, true])
+  check(res.evictions === 2 && res.sources === 2, 'rate limit evictions')
+
+  // rate 0 is off
+  res = testing.sourceLimiter(0, 1, 100, [
+    { peer: '192.0.2.1', now: 0 },
+    { peer: '192.0.2.1', now: 0 }
+  ])
+  testArraysEqual(res.allowed, [true, true])
+  check(res.sources === 0, 'rate limit off')
+  console.log('rate limit tests passed')
+}
+
+function serverNameTests(testing) {
+  const names = ['example.com', '*.example.com', 'Exact.Example.Org']
+  const cases = [
+    ['example.com', 'example.com'],
+    ['www.example.com', '*.example.com'],
+    ['WWW.Example.COM', '*.example.com'],
+    // a wildcard covers a single label
+    ['a.b.example.com', null],
+    ['exact.example.org', 'exact.example.org'],
+    ['www.exact.example.org', null],
+    ['example.org', null],
+    ['com', null]
+  ]
+  for (const [hostname, expected] of cases)
+    check(
+      testing.matchServerName(names, hostname) === expected,
+      'server name ' + hostname
+    )
+  // an exact name wins over a wildcard
+  const exact = ['*.example.com', 'www.example.com']
+  check(
+    testing.matchServerName(exact, 'www.example.com') === 'www.example.com',
+    'server name exact before wildcard'
+  )
+  console.log('server name tests passed')
+}
+
+function datagramIdTests(testing) {
+  // without feedback, one waits in quiche's queue longer than its default age,
+  // it is sent anyway, so the tracked ones get the right ids
+  const res = testing.datagramIds([
+    { op: 'send', tag: 0, blocked: true, now: 0 },
+    { op: 'write', now: 5000 },
+    { op: 'send', tag: 7, now: 5000 },
+    { op: 'send', tag: 8, blocked: true, now: 5000 },
+    { op: 'write', now: 6000 },
+    { op: 'ack', id: 2 },
+    { op: 'lost', id: 3 },
+    { op: 'ack', id: 1 },
+    { op: 'ack', id: 4 }
+  ])
+  testArraysEqual(res.results, [null, 1, 2, null, 1, 7, 8, null, null])
+  check(res.expired === 0, 'datagram queue expired')
+}
+
+export function nativeUnitTests(testing) {
+  fecTests(testing)
+  fragmentTests(testing)
+  ticketTests(testing)
+  ticketReplayTests(testing)
+  replayFilterTests(testing)
+  sessionCacheTests(testing)
+  retryTokenTests(testing)
+  sourceLimiterTests(testing)
+  serverNameTests(testing)
+  datagramIdTests(testing)
+}